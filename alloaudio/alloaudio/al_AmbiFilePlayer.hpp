@@ -4,6 +4,8 @@
 #include "allocore/sound/al_Ambisonics.hpp"
 #include "allocore/sound/al_Speaker.hpp"
 #include "allocore/io/al_AudioIOData.hpp"
+#include "allocore/spatial/al_Pose.hpp"
+#include "allocore/types/al_TripleBuffer.hpp"
 #include "allocore/ui/al_Parameter.hpp"
 #include "alloaudio/al_SoundfileBuffered.hpp"
 #include "alloaudio/al_AmbiTunedDecoder.hpp"
@@ -19,6 +21,10 @@ using namespace std;
 ///
 /// \brief A class to play back Ambisonics encoded (B-format) audio files
 ///
+/// Each block is read from the file buffer straight into separate Ambisonic
+/// channels, rotated by the listener orientation set with setPose(), and
+/// decoded to the speakers through the decode matrix of AmbiDecode.
+///
 class AmbiFilePlayer : public AudioCallback, public SoundFileBuffered
 {
 
@@ -52,6 +58,17 @@ public:
 	bool done() const;
 	void setDone(bool done);
 
+	///
+	/// \brief Set the pose of the listener within the sound field
+	///
+	/// The sound field is rotated by the inverse of the pose's orientation,
+	/// as for AmbiRotate::orientation(), so a listener can look around a
+	/// recording without rendering it again. The rotation is interpolated
+	/// across the next audio block. The position of the pose is ignored.
+	/// This can be called from any thread.
+	///
+	void setPose(const Pose &pose);
+
 private:
 
 	int getFileDimensions();
@@ -60,8 +77,10 @@ private:
 	// Internal
 
 	AmbiDecode *mDecoder;
-	float *mReadBuffer;
-	float *mDeinterleavedBuffer;
+	AmbiRotate mRotator;
+	TripleBuffer<double> mOrientation; // Quaternion components w, x, y, z
+	bool mRotate;
+	std::vector<float> mAmbiBuffer; // Ambisonic channels of one audio block
 	bool mDone;
 	int mBufferSize;
 
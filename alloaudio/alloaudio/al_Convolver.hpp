@@ -1,8 +1,12 @@
 #ifndef AL_CONVOLVER_H
 #define AL_CONVOLVER_H
 
+#include <atomic>
+#include <cstdio>
+#include <mutex>
 #include <vector>
 #include "allocore/io/al_AudioIO.hpp"
+#include "allocore/system/al_Thread.hpp"
 
 #define MAXSIZE 0x00100000
 
@@ -32,6 +36,11 @@ using namespace std;
 	 * @ingroup alloaudio
      *
      * Built on zita convolver, which implements a realtime multithreaded multichannel convolution algorithm using non-uniform partitioning.
+     *
+     * The first partitions, of basePartitionSize samples, are processed in the audio callback. Later partitions
+     * grow in size up to maxPartitionSize and are processed by background threads, so long IRs add little
+     * to the cost of the callback. The IRs can be replaced while running with loadIRs(), which prepares the
+     * new set on a background thread and crossfades to it at a block boundary.
      *
 	 */
 class Convolver : public al::AudioCallback
@@ -72,6 +81,8 @@ public:
 	/// @param[in] disabledChannels Contains list of all channels which should not be processed.
 	/// @param[in] basePartitionSize Should be set to audio callback size to minimize latency. Cannot be less than 64 samples.
 	/// @param[in] options Options to be passed to zita convolver. Currently supports OPT_FFTW_MEASURE = 1, OPT_VECTOR_MODE  = 2.
+	/// @param[in] maxPartitionSize Largest partition size, a power of two up to 8192. Larger partitions are cheaper for long IRs but
+	/// leave their background threads more time to finish. Set to 0 to use the next power of two of half the IR length, up to 8192.
 	/// @return Returns 0 upon success
 
 	int configure(al::AudioIO &io,
@@ -80,7 +91,39 @@ public:
 				  int inputChannel = -1,
 				  bool inputsAreBuses = false,
 				  vector<int> disabledChannels = vector<int>(),
-				  unsigned int basePartitionSize=64, unsigned int options=0);
+				  unsigned int basePartitionSize=64, unsigned int options=0,
+				  unsigned int maxPartitionSize=0);
+
+	/// @brief Replaces the IRs while processing, without interrupting the output.
+	///
+	/// The IRs are copied, so they can be freed once this returns. They are partitioned and transformed on a
+	/// background thread. Once ready, they process the input alongside the current IRs for as many frames as
+	/// the longest IRs loaded, so that their reverberant tail holds all the input played before. The output
+	/// then crossfades to them. Until the crossfade ends, the callback runs two or three sets of IRs.
+	/// If called again before a set is in use, the newer set replaces it.
+	///
+	/// @param[in] IRs The deinterleaved IR channels, as many as given to configure().
+	/// @param[in] IRlength The number of samples of each IR. It may differ from the length given to configure().
+	/// @return Returns 0 upon success
+	int loadIRs(vector<float *> IRs, int IRlength);
+
+	/// @brief Sets the number of frames of the crossfade to IRs set by loadIRs(). Defaults to 4096.
+	void setCrossfade(int frames);
+
+	/// @brief Returns true while IRs set by loadIRs() are being prepared or crossfaded to.
+	bool swapPending() const;
+
+	/// @brief Sets the density hint of the IR matrix used to choose the partition sizes, the fraction of the
+	/// input-output pairs that have an IR. Set to 0 (the default) to assume one IR per output. Must be called
+	/// before configure().
+	void setDensity(float density);
+
+	/// @brief Sets the scheduling of the background threads, as for zita convolver's start_process(). The
+	/// thread processing the largest partitions runs at the lowest priority. Must be called before configure().
+	void setThreadPriority(int absPriority, int policy);
+
+	/// @brief Prints the partition schedule, one line per partition size, as reported by zita convolver.
+	void printPartitions(FILE *f = stdout);
 
 	/// @brief Handles all io for the convolution
 	/// @param[in,out] io The AudioIO object from which audio data will be read from and written to.
@@ -90,12 +133,41 @@ public:
 	/// @return Returns 0 upon success.
     int shutdown(void);
 
+	~Convolver();
+
 private:
 	vector<int> m_activeChannels;
 	vector<int> m_disabledChannels;
 	int m_inputChannel;
 	bool m_inputsAreBuses;
 	Convproc *m_Convproc;
+
+	// Configuration shared by all IR sets
+	int m_nActiveInputs, m_nActiveOutputs;
+	unsigned int m_bufferSize, m_basePartitionSize, m_maxPartitionSize, m_options;
+	float m_density;
+	int m_absPriority, m_policy;
+
+	// IR swapping. The loader thread prepares a new Convproc and hands it to the audio thread through
+	// m_pending. The audio thread runs it silently until it has processed m_warmLength frames, then
+	// crossfades to it and hands the old one back through m_retired.
+	Convproc *m_fadeFrom; // audio thread only
+	int m_fadePosition, m_crossfade;
+	Convproc *m_warming; // audio thread only
+	int m_warmPosition;
+	std::atomic<int> m_warmLength; // longest IRs loaded, only grows
+	std::atomic<Convproc *> m_pending, m_retired;
+	std::atomic<bool> m_loading;
+	std::atomic<int> m_swaps; // requested by loadIRs() and not yet finished
+	std::mutex m_requestMutex;
+	vector<float> m_requestIRs; // deinterleaved
+	int m_requestLength;
+	std::atomic<bool> m_runLoader;
+	al::Thread m_loaderThread;
+
+	Convproc *createConvproc(const vector<float *> &IRs, int IRlength);
+	static void destroyConvproc(Convproc *c);
+	void loaderThreadFunc();
 };
 
 /** @} */
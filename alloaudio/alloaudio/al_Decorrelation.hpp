@@ -48,6 +48,9 @@
 #ifndef INC_AL_DECORRELATION_HPP
 #define INC_AL_DECORRELATION_HPP
 
+#include <string>
+#include <vector>
+
 #include <allocore/io/al_AudioIO.hpp>
 #include <alloaudio/al_Convolver.hpp>
 
@@ -114,6 +117,32 @@ public:
 	                            float maxTau = 1.0,
 	                            float startPhase = 0.0, float phaseDev = 0.0);
 
+	/**
+	 * @brief Sets a directory where generated IRs are cached
+	 *
+	 * IR sets generated with a seed >= 0 are written to a file in this
+	 * directory, named from the size, number of outputs, seed and the other
+	 * generation parameters. Later calls to configure() or
+	 * configureDeterministic() with the same parameters, in this or another
+	 * process, map the file into memory instead of generating the IRs. The
+	 * directory is created if needed. An empty string (the default) disables
+	 * the cache.
+	 */
+	void setCacheDirectory(const std::string &dir);
+
+	/**
+	 * @brief Sets the number of threads used to generate IRs
+	 *
+	 * @param numThreads A value of 0 (the default) uses one thread per
+	 * hardware thread, or only the calling thread for small IR sets.
+	 */
+	void setNumThreads(int numThreads);
+
+	/**
+	 * @brief Returns true if the current IRs were loaded from the cache
+	 */
+	bool loadedFromCache();
+
 	/**
 	 * @brief getCurrentSeed returns the randon seed used to generate the current IRs
 	 */
@@ -138,12 +167,23 @@ public:
 private:
 
 	void freeIRs();
+	void allocateIRs();
+	void inverseTransform(vector<float> &spectra);
+	bool loadCache(int kind, const float *params, int numParams);
+	void saveCache(int kind, const float *params, int numParams);
+	std::string cachePath(int kind, const float *params, int numParams);
 	void generateIRs(long seed = -1, float maxjump = -1.0, float phaseFactor = 1.0);
 	void generateDeterministicIRs(long seed = -1,
 	                              float deltaFreq = 30, float maxFreqDev = 10, float maxTau = 1.0,
 	                              float startPhase = 0.0, float phaseDev = 0.0);
 
 	vector<float *>mIRs;
+	vector<float> mIRData; // IRs when generated
+	void *mMapped; // IRs when mapped from the cache, after the file header
+	size_t mMappedSize;
+	std::string mCacheDir;
+	int mNumThreads;
+	bool mLoadedFromCache;
 	int mSize;
 	int mInChannel;
 	int mNumOuts;
@@ -0,0 +1,29 @@
+#ifndef AL_FFTWLOCK_H
+#define AL_FFTWLOCK_H
+
+#include <mutex>
+
+namespace al {
+
+/** \addtogroup alloaudio
+ *  @{
+ */
+
+///
+/// \brief Mutex held while creating or destroying FFTW plans
+///
+/// Only the execution of FFTW plans is thread-safe. Every class in alloaudio
+/// that plans FFTs from a background thread, directly or through zita
+/// convolver or Gamma, holds this process-wide mutex while it does.
+///
+inline std::mutex &fftwPlannerMutex()
+{
+	static std::mutex mutex;
+	return mutex;
+}
+
+/** @} */
+
+} // namespace al
+
+#endif // AL_FFTWLOCK_H
@@ -34,7 +34,7 @@
 
     File description:
     Audio output control offering gain, bass management, room compensation
-    filtering and metering. OSC control of parameters.
+    filtering, speaker alignment and metering. OSC control of parameters.
 
     File author(s):
     Andres Cabrera, mantaraya36@gmail.com
@@ -44,19 +44,18 @@
 #ifndef INC_AL_OUTPUTMASTER_HPP
 #define INC_AL_OUTPUTMASTER_HPP
 
+#include <atomic>
 #include <vector>
 
-#include <pthread.h>
-
 #include "allocore/io/al_AudioIO.hpp"
-#include "allocore/types/al_SingleRWRingBuffer.hpp"
+#include "allocore/types/al_TripleBuffer.hpp"
 #include "allocore/types/al_MsgQueue.hpp"
 #include "allocore/protocol/al_OSC.hpp"
 #include "allocore/system/al_Thread.hpp"
+#include "allocore/sound/al_Biquad.hpp"
+#include "allocore/sound/al_Speaker.hpp"
 
 
-typedef struct BUTTER_ BUTTER;
-
 namespace al {
 
 typedef enum {
@@ -68,6 +67,11 @@ typedef enum {
     BASSMODE_COUNT
 } bass_mgmt_mode_t;
 
+typedef enum {
+    METER_BUNDLE = 0, /* one message per channel, grouped in bundles */
+    METER_BLOB = 1 /* all channels in a single message */
+} meter_format_t;
+
 typedef enum {
     CHANNEL_GAIN = 0,
     MASTER_GAIN,
@@ -79,6 +83,9 @@ typedef enum {
     SW_INDECES,
     METER_ON,
     METER_UPDATE_SAMPLES,
+    ALIGNMENT_ON,
+    ALIGNMENT_DELAY,
+    ALIGNMENT_GAIN,
     PARAMETER_COUNT,
 } parameter_t;
 
@@ -135,16 +142,26 @@ class OutputMaster : public osc::Recv, public al::AudioCallback
      */
     void setClipperOn(bool clipperOn);
 
-    /** Set the frequency at which peak meter data is updated. During the update period,
-     * a single value (maximum sample peak) is stored, and will only be avialable once
-     * the period is completed, as this is passed to the non-audio context through a
-     * lock-free ring buffer.
+    /** Set the frequency at which meter data is updated. During the update period,
+     * the sample peak and the RMS level of each channel are accumulated, and will only
+     * be available once the period is completed, as they are passed to the non-audio
+     * context as a lock-free snapshot. Only the latest snapshot is kept, so a slow
+     * reader skips updates rather than falling behind.
      */
     void setMeterUpdateFreq(double freq);
 
+    /** Set how meter values are sent via OSC. With METER_BUNDLE (the default), one
+     * message is sent per channel as described for setMeterAddrHasChannel(), and the
+     * messages of each update are grouped in bundles of up to 1024 bytes, the packet
+     * size read by al::osc::Recv. With METER_BLOB, each update is a single message
+     * to /Alloaudio/meters holding a blob of the peak levels of all channels, in dB,
+     * followed by their RMS levels, in dB, as big-endian 32 bit floats.
+     */
+    void setMeterFormat(meter_format_t format);
+
     /** Set bass management cross-over frequency. The signal from all channels will be run
-     * through a pair of linear-phase cross-over filters, and the signal from the low pass
-     * filters is sent to the subwoofers specified using setSwIndeces().
+     * through a pair of fourth order Linkwitz-Riley cross-over filters, and the signal from
+     * the low pass filters is sent to the subwoofers specified using setSwIndeces().
     */
     void setBassManagementFreq(double frequency);
 
@@ -161,13 +178,62 @@ class OutputMaster : public osc::Recv, public al::AudioCallback
     void setMeterOn(bool meterOn);
 
     /** Fill the values array with the peak meter values. Note that because the values
-     * are stored in a ringbuffer, this function cannot be used together with OSC meters
-     * as the OSC thread will empty the values before they are read here.
+     * are passed as a snapshot that is taken by its reader, this function cannot be
+     * used together with OSC meters as the OSC thread will take the values before
+     * they are read here.
      *
-     * @return returns the number of meter values read.
+     * @return returns the number of meter values read, or 0 if there has been no
+     * update since the last call.
      */
     int getMeterValues(float *values);
 
+    /** Fill the peaks and rms arrays with the peak and RMS meter values, as
+     * getMeterValues(float *values).
+     */
+    int getMeterValues(float *peaks, float *rms);
+
+    /** Set the largest number of frames processed at once. The working buffers
+     * and the alignment delay memory are allocated here, so this must not be called
+     * while audio is running. Larger blocks are processed in pieces. The default is
+     * 8192.
+     */
+    void setMaxBlockSize(int frames);
+
+    /** Enable the speaker alignment stage, which delays and scales each channel so
+     * that speakers at different distances from the center are heard in time and at
+     * the same level. It is applied to all channels, subwoofers included, after bass
+     * management and gain. It is on by default, but does nothing until delays or
+     * gains are set.
+     */
+    void setAlignmentOn(bool alignmentOn);
+
+    /** Set the largest alignment delay in seconds. The delay memory of all channels is
+     * allocated here, so this must not be called while audio is running. The default
+     * is 20 ms, about 7 meters of difference between speaker distances. Delays are
+     * cleared.
+     */
+    void setMaxAlignmentDelay(double seconds);
+
+    /** Set the alignment delay of a channel in seconds. Fractional sample delays are
+     * linearly interpolated. The delay is limited to the value set with
+     * setMaxAlignmentDelay().
+     */
+    void setAlignmentDelay(int channelIndex, double seconds);
+
+    /** Set the alignment gain of a channel. It is applied in addition to the gain set
+     * with setGain(), so the two can be controlled independently.
+     */
+    void setAlignmentGain(int channelIndex, double gain);
+
+    /** Set alignment delays and gains from the speaker radii of a layout, in meters.
+     * Each speaker is delayed by the time sound takes to travel the difference between
+     * its radius and that of the farthest speaker, and scaled by the ratio of the two
+     * radii to compensate the inverse distance law. Speakers are mapped to channels by
+     * their device channel. The maximum delay grows if needed, so this must not be
+     * called while audio is running.
+     */
+    void setSpeakerAlignment(const SpeakerLayout &layout, double speedOfSound = 343.0);
+
     /** Get the number of channels processed by this OutputMaster object */
     int getNumChnls();
 
@@ -205,6 +271,9 @@ protected:
     void setMeterupdateFreqTimestamped(al_sec until, double freq);
     void setBassManagementFreqTimestamped(al_sec until, double freq);
     void setBassManagementModeTimestamped(al_sec until, int mode);
+    void setAlignmentOnTimestamped(al_sec until, bool on);
+    void setAlignmentDelayTimestamped(al_sec until, int channelIndex, double seconds);
+    void setAlignmentGainTimestamped(al_sec until, int channelIndex, double gain);
 
 private:
 	const int m_numChnls;
@@ -225,25 +294,42 @@ private:
     MsgQueue m_parameterQueue;
 
     /* output data */
-    std::vector<float> m_meters;
-    SingleRWRingBuffer m_meterBuffer;
+    std::vector<float> m_meterPeaks, m_meterSumSquares;
+    TripleBuffer<float> m_meterSnapshot; /* peaks, then RMS, of all channels */
     int m_meterCounter; /* count samples for level updates */
+    meter_format_t m_meterFormat;
     std::string m_sendAddress;
     int m_sendPort;
-    int m_runMeterThread;
+    std::atomic<bool> m_runMeterThread;
     al::Thread m_meterThread;
-    pthread_mutex_t m_meterMutex;
-    pthread_cond_t m_meterCond;
 
-    /* bass management filters */
-    std::vector<BUTTER *> m_lopass1, m_lopass2, m_hipass1, m_hipass2;
+    /* bass management filters, two cascaded Butterworth sections per channel */
+    BiquadBank m_lowpass, m_highpass;
+    std::vector<float> m_lowBuffer; /* low passed signal of all channels */
+    std::vector<float *> m_inPtrs, m_lowPtrs;
+    int m_maxBlockSize; /* frames processed at once */
+
+    /* speaker alignment. The delay lines of all channels share one block of memory,
+     * each a ring of m_delayLength samples followed by a copy of its first
+     * m_maxBlockSize samples, so that a block can be read without wrapping. */
+    bool m_alignmentOn;
+    std::vector<double> m_alignDelays; /* in samples */
+    std::vector<double> m_alignGains;
+    std::vector<float> m_delayMemory;
+    int m_delayLength; /* power of two */
+    int m_delayWrite;
+    double m_maxDelay; /* in samples */
 
     double m_framesPerSec; // Sample rate
 
     int chanIsSubwoofer(int index);
     void initializeData();
     void allocateChannels(int numChnls);
-    static void *meterThreadFunc(void *arg);
+    void allocateDelays();
+    void processBlock(AudioIOData &io, int offset, int nframes);
+    void processAlignment(AudioIOData &io, int offset, int nframes);
+    void meterThreadFunc();
+    void sendMeters(osc::Send &s, const float *levels);
 
     struct OSCHandler : public osc::PacketHandler{
         OutputMaster *outputmaster;
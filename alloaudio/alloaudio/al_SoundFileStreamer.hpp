@@ -0,0 +1,108 @@
+#ifndef SOUNDFILESTREAMER_H
+#define SOUNDFILESTREAMER_H
+
+
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+
+
+namespace al
+{
+
+class SoundFileBuffered;
+
+/** \addtogroup alloaudio
+ *  @{
+ */
+
+///
+/// \brief Refill the ring buffers of many SoundFileBuffered objects from a small pool of threads
+///
+/// By default every SoundFileBuffered reads its file on a thread of its own.
+/// When hundreds of files play at once, those threads compete for the disk
+/// and for the scheduler. A SoundFileStreamer services any number of files
+/// from a few I/O threads instead. Files are attached with
+/// SoundFileBuffered::useStreamer() or add().
+///
+/// Each time an I/O thread is free, it refills the file whose ring buffer is
+/// the emptiest, so files about to run out are served first. Files with a
+/// pending seek go ahead of all others. A refill reads at most the number of
+/// frames the disk delivers in readTime(), measured from the reads done so
+/// far, so that a long read does not hold back files that are running low.
+///
+/// A ring buffer that cannot provide all the frames requested from
+/// SoundFileBuffered::read() before the end of the file counts as an
+/// underrun, both for the file and for its streamer.
+///
+class SoundFileStreamer
+{
+public:
+	///
+	/// \param numThreads number of I/O threads, started when the first file is added
+	///
+	SoundFileStreamer(int numThreads = 2);
+	~SoundFileStreamer();
+
+	///
+	/// \brief A streamer shared by the whole application
+	///
+	static SoundFileStreamer &shared();
+
+	void add(SoundFileBuffered &file);		///< Stream file from this streamer, as file.useStreamer(this)
+	void remove(SoundFileBuffered &file);	///< Return file to its own reader thread, as file.useStreamer(nullptr)
+
+	int numFiles();							///< Number of files streamed
+	int numThreads() const { return mNumThreads; }	///< Number of I/O threads
+
+	///
+	/// \brief Set how long a single refill may take, in seconds (0.005 by default)
+	///
+	void readTime(double seconds);
+	double readTime() const { return mReadTime; }	///< Get how long a single refill may take
+
+	///
+	/// \brief Disk throughput measured over the last reads, in bytes per second
+	///
+	/// This is 0 until the first read.
+	///
+	double throughput() const { return mThroughput.load(); }
+
+	int underruns() const { return mUnderruns.load(); }	///< Underruns of all files since the last resetUnderruns()
+	void resetUnderruns() { mUnderruns.store(0); }
+
+	///
+	/// \brief Wake the I/O threads
+	///
+	/// This is called by SoundFileBuffered::read(), so it is not normally
+	/// needed.
+	///
+	void wake() { mCondVar.notify_one(); }
+
+private:
+	friend class SoundFileBuffered;
+
+	void attach(SoundFileBuffered *file);
+	void detach(SoundFileBuffered *file);
+	SoundFileBuffered *nextFile();
+	static void ioFunction(SoundFileStreamer *obj);
+
+	int mNumThreads;
+	double mReadTime;
+	bool mRunning;
+	std::atomic<double> mThroughput;
+	std::atomic<int> mUnderruns;
+	std::vector<SoundFileBuffered *> mFiles;
+	std::vector<std::thread *> mThreads;
+	std::mutex mLock; // Protects mFiles, mRunning and the streaming state of files
+	std::condition_variable mCondVar;
+	std::condition_variable mIdle; // Notified when a file is no longer being refilled
+};
+
+/** @} */
+
+} // namespace al
+
+#endif // SOUNDFILESTREAMER_H
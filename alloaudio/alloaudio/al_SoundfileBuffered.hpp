@@ -16,6 +16,8 @@
 namespace al
 {
 
+class SoundFileStreamer;
+
 /** \addtogroup alloaudio
  *  @{
  */
@@ -29,6 +31,12 @@ namespace al
 /// within an audio callback as it will provide the most efficient mechanism
 /// for low latency, high efficiency and drop-out free soundfile access.
 ///
+/// Uncompressed 16, 24 and 32 bit integer and 32 bit float WAV and CAF files
+/// are mapped into memory and converted directly from the mapping, without
+/// going through Gamma's SoundFile.
+///
+/// Files can also be streamed by a SoundFileStreamer, which services many
+/// files from a small pool of threads, see useStreamer().
 ///
 class SoundFileBuffered
 {
@@ -38,7 +46,10 @@ public:
 	/// \param loop set to true if you want the sound file to start over when finished
 	/// \param bufferFrames the size of the ring buffer. Set to larger if experiencing dropouts or if planning to read more samples, e.g. the audio buffer size is large.
 	///
-	SoundFileBuffered(std::string fullPath, bool loop = false, int bufferFrames = 1024);
+	/// \param streamer streamer to refill the ring buffer from. If nullptr, the file is read on a thread of its own.
+	///
+	SoundFileBuffered(std::string fullPath, bool loop = false, int bufferFrames = 1024,
+	                  SoundFileStreamer *streamer = nullptr);
 	~SoundFileBuffered();
 
 	///
@@ -49,6 +60,20 @@ public:
 	///
 	int read(float *buffer, int numFrames);
 
+	///
+	/// \brief Read samples from the audio file into separate channels
+	///
+	/// The samples are deinterleaved straight out of the ring buffer, so
+	/// this saves the copy to an interleaved buffer that read() makes.
+	///
+	/// \param buffer pre-allocated buffer holding channels() channels of at least numFrames samples
+	/// \param numFrames number of frames to read
+	/// \param stride number of samples from the start of a channel to the next
+	/// \param gain gain applied to the samples
+	/// \return the number of frames actually read.
+	///
+	int readPlanar(float *buffer, int numFrames, int stride, float gain = 1.0f);
+
 	bool opened() const;								///< Returns whether the sound file is open
 	gam::SoundFile::EncodingType encoding() const;	///< Get encoding type
 	gam::SoundFile::Format format() const;			///< Get format
@@ -91,7 +116,39 @@ public:
 
     int currentPosition();
 
+	///
+	/// \brief Refill the ring buffer from a SoundFileStreamer
+	///
+	/// The reader thread of this file is stopped, or the file is moved from
+	/// the streamer it was using. Passing nullptr returns the file to a
+	/// reader thread of its own. This must not be called from the audio
+	/// thread.
+	///
+	void useStreamer(SoundFileStreamer *streamer);
+
+	SoundFileStreamer *streamer() const { return mStreamer.load(); }	///< Get the streamer refilling the file, or nullptr
+
+	///
+	/// \brief Number of calls to read() that got fewer frames than requested before the end of the file
+	///
+	int underruns() const { return mUnderruns.load(); }
+
+	bool mapped() const { return mMapData != nullptr; }	///< Returns whether the file is read from a memory mapping
+
 private:
+	friend class SoundFileStreamer;
+
+	void readDone(int framesRead, int numFrames);
+	int refill(int maxFrames);
+	int readFrames(float *buffer, int numFrames);
+	void seekFrames(int frame);
+	bool mapFile(const std::string &path);
+	void unmapFile();
+	void startThread();
+	void stopThread();
+	float fillLevel() const;
+	bool needsRefill() const;
+
 	bool mRunning;
 	bool mLoop;
 	std::atomic<int> mRepeats;
@@ -109,6 +166,21 @@ private:
 
 	float *mFileBuffer; // Buffer to copy file samples to (in the reader thread before passing to ring buffer)
 
+	std::atomic<SoundFileStreamer *> mStreamer;
+	bool mStreamBusy; // Being refilled by a thread of mStreamer, protected by its lock
+	std::atomic<bool> mFinished; // Whole file is in the ring buffer, when not looping
+	std::atomic<int> mUnderruns;
+
+	// Memory mapped file
+	void *mMapped;
+	size_t mMappedSize;
+	const unsigned char *mMapData; // First frame
+	int mMapFrames;
+	int mMapPos;
+	int mMapSampleBytes;
+	bool mMapFloat;
+	bool mMapBigEndian;
+
 	static void readFunction(SoundFileBuffered *obj);
 };
 
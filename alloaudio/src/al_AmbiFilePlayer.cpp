@@ -1,5 +1,6 @@
 
 #include <iostream>
+#include <algorithm>
 #include <cassert>
 
 #include "alloaudio/al_AmbiFilePlayer.hpp"
@@ -8,7 +9,9 @@ using namespace al;
 
 AmbiFilePlayer::AmbiFilePlayer(string fullPath, bool loop, int bufferFrames, SpeakerLayout &layout)
     : SoundFileBuffered(fullPath, loop, bufferFrames),
-      mReadBuffer(nullptr),
+      mRotator(getFileDimensions(), getFileOrder(), bufferFrames),
+      mOrientation(4),
+      mRotate(false),
       mDone(false),
       mBufferSize(bufferFrames),
       mGain("Gain", "", 0.25)
@@ -16,27 +19,27 @@ AmbiFilePlayer::AmbiFilePlayer(string fullPath, bool loop, int bufferFrames, Spe
 	// Create spatializer
 	mDecoder = new AmbiDecode(getFileDimensions(), getFileOrder(), layout.numSpeakers());
 	mDecoder->setSpeakers(layout.speakers());
-	mReadBuffer = (float *) calloc(mBufferSize * channels(), sizeof(float));
-	mDeinterleavedBuffer = (float *) calloc(mBufferSize * channels(), sizeof(float));
+	mAmbiBuffer.reserve(mBufferSize * channels());
 }
 
 AmbiFilePlayer::AmbiFilePlayer(std::string fullPath, bool loop, int bufferFrames, string configPath)
     : SoundFileBuffered(fullPath, loop, bufferFrames),
-      mReadBuffer(nullptr),
+      mRotator(getFileDimensions(), getFileOrder(), bufferFrames),
+      mOrientation(4),
+      mRotate(false),
       mDone(false),
       mBufferSize(bufferFrames),
       mGain("Gain", "", 0.25)
 {
 	// Create spatializer
 	mDecoder = new AmbiTunedDecoder(configPath);
-	mReadBuffer = (float *) calloc(mBufferSize * channels(), sizeof(float));
-	mDeinterleavedBuffer = (float *) calloc(mBufferSize * channels(), sizeof(float));
+	mAmbiBuffer.reserve(mBufferSize * channels());
 }
 
 
 AmbiFilePlayer::~AmbiFilePlayer()
 {
-	free(mReadBuffer);
+	delete mDecoder;
 }
 
 int AmbiFilePlayer::getFileDimensions()
@@ -59,30 +62,49 @@ void AmbiFilePlayer::setDone(bool done)
 	mDone = done;
 }
 
+void AmbiFilePlayer::setPose(const Pose &pose)
+{
+	const Quatd &q = pose.quat();
+	double *back = mOrientation.back();
+	back[0] = q.w;
+	back[1] = q.x;
+	back[2] = q.y;
+	back[3] = q.z;
+	mOrientation.publish();
+}
+
 void AmbiFilePlayer::onAudioCB(AudioIOData &io)
 {
 	int numFrames = io.framesPerBuffer();
 
 	assert(mBufferSize >= numFrames);
 
-	int framesRead = read(mReadBuffer, numFrames);
-
-	float *outs = &io.out(0,0);
-
-	// We need to de-interleave the file buffers
-	for (int chan = 0; chan < channels(); chan++) {
-		for (int j = 0; j < framesRead; j++) {
-			float sample = (mReadBuffer[j*channels() + chan] * mGain.get());
-			mDeinterleavedBuffer[chan*mBufferSize + j] = sample;
-//			io.out(chan, j) = sample;
+	// Channels are spaced by the block size, as AmbiDecode::decode() expects
+	const size_t ambiSize = numFrames * channels();
+	if (mAmbiBuffer.size() != ambiSize) {
+		mAmbiBuffer.assign(ambiSize, 0.0f);
+	}
+	int framesRead = readPlanar(mAmbiBuffer.data(), numFrames, numFrames, mGain.get());
+	if (framesRead < numFrames) {
+		for (int chan = 0; chan < channels(); chan++) {
+			std::fill(mAmbiBuffer.begin() + chan * numFrames + framesRead,
+			          mAmbiBuffer.begin() + (chan + 1) * numFrames, 0.0f);
 		}
 	}
 
-	mDecoder->decode(outs, mDeinterleavedBuffer, framesRead);
+	if (mOrientation.update()) {
+		const double *q = mOrientation.front();
+		mRotator.orientation(Quatd(q[0], q[1], q[2], q[3]));
+		mRotate = true;
+	}
+	if (mRotate) {
+		mRotator.rotate(mAmbiBuffer.data(), numFrames);
+	}
+
+	float *outs = &io.out(0,0);
+	mDecoder->decode(outs, mAmbiBuffer.data(), numFrames);
 
 	if (repeats() > 0) {
 		mDone = true;
 	}
 }
-
-
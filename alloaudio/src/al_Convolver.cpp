@@ -5,20 +5,35 @@
 #include <string.h>
 #include <assert.h>
 #include "alloaudio/al_Convolver.hpp"
+#include "alloaudio/al_FFTWLock.hpp"
+#include "allocore/system/al_Time.hpp"
 
 using namespace al;
 
 Convolver::Convolver() :
-	m_Convproc(NULL)
+	m_Convproc(NULL),
+	m_density(0.0f), m_absPriority(0), m_policy(0),
+	m_fadeFrom(NULL), m_fadePosition(0), m_crossfade(4096),
+	m_warming(NULL), m_warmPosition(0), m_warmLength(0),
+	m_pending(NULL), m_retired(NULL), m_loading(false), m_swaps(0),
+	m_requestLength(0), m_runLoader(false)
 {
 }
 
+Convolver::~Convolver()
+{
+	if (m_Convproc != NULL) {
+		shutdown();
+	}
+}
+
 int Convolver::configure(al::AudioIO &io, vector<float *> IRs, int IRlength,
 						 int inputChannel, bool inputsAreBuses,
-						 vector<int> disabledChannels, unsigned int basePartitionSize, unsigned int options)
+						 vector<int> disabledChannels, unsigned int basePartitionSize, unsigned int options,
+						 unsigned int maxPartitionSize)
 {
 	int bufferSize = io.framesPerBuffer(), nActiveOutputs = io.channels(true) - disabledChannels.size(),
-			nActiveInputs, configResult;
+			nActiveInputs;
 	m_inputChannel = inputChannel;
 	m_inputsAreBuses = inputsAreBuses;
 	m_disabledChannels = disabledChannels;
@@ -50,36 +65,194 @@ int Convolver::configure(al::AudioIO &io, vector<float *> IRs, int IRlength,
 	assert(basePartitionSize >= Convproc::MINPART);
 	assert(basePartitionSize <= Convproc::MAXPART);
 
+	if (maxPartitionSize == 0) {
+		// The next power of two of half the IR length
+		maxPartitionSize = basePartitionSize;
+		while (maxPartitionSize < (unsigned int) IRlength/2 && maxPartitionSize < Convproc::MAXPART) {
+			maxPartitionSize *= 2;
+		}
+	}
+	assert((maxPartitionSize & (maxPartitionSize - 1)) == 0);
+	assert(maxPartitionSize >= basePartitionSize);
+	assert(maxPartitionSize <= Convproc::MAXPART);
+
 	if(m_Convproc != NULL) {
-		delete m_Convproc;
+		shutdown();
+	}
+	m_nActiveInputs = nActiveInputs;
+	m_nActiveOutputs = nActiveOutputs;
+	m_bufferSize = bufferSize;
+	m_basePartitionSize = basePartitionSize;
+	m_maxPartitionSize = maxPartitionSize;
+	m_options = options;
+	m_Convproc = createConvproc(IRs, IRlength);
+	if (m_Convproc == NULL) {
+		return -1;
+	}
+	m_fadeFrom = NULL;
+	m_warming = NULL;
+	m_warmLength = IRlength;
+	m_runLoader = true;
+	m_loaderThread.start([this](){ loaderThreadFunc(); });
+	return 0;
+}
+
+int Convolver::loadIRs(vector<float *> IRs, int IRlength)
+{
+	if (m_Convproc == NULL || (int) IRs.size() < m_nActiveOutputs
+			|| IRlength < Convproc::MINPART || IRlength > MAXSIZE) {
+		return -1;
+	}
+	std::lock_guard<std::mutex> lock(m_requestMutex);
+	m_requestIRs.resize(m_nActiveOutputs * IRlength);
+	for (int i = 0; i < m_nActiveOutputs; i++) {
+		memcpy(&m_requestIRs[i * IRlength], IRs[i], IRlength * sizeof(float));
+	}
+	m_requestLength = IRlength;
+	if (!m_loading) {
+		m_swaps++; // otherwise the request not yet taken is replaced
+	}
+	m_loading = true;
+	return 0;
+}
+
+void Convolver::setCrossfade(int frames)
+{
+	m_crossfade = frames > 0 ? frames : 1;
+}
+
+bool Convolver::swapPending() const
+{
+	return m_swaps > 0;
+}
+
+void Convolver::setDensity(float density)
+{
+	m_density = density;
+}
+
+void Convolver::setThreadPriority(int absPriority, int policy)
+{
+	m_absPriority = absPriority;
+	m_policy = policy;
+}
+
+void Convolver::printPartitions(FILE *f)
+{
+	if (m_Convproc != NULL) {
+		m_Convproc->print(f);
+	}
+}
+
+Convproc *Convolver::createConvproc(const vector<float *> &IRs, int IRlength)
+{
+	Convproc *c = new Convproc;
+	c->set_options(m_options);
+	c->set_density(m_density);
+	int configResult;
+	{
+		// configure() creates the FFTW plans
+		std::lock_guard<std::mutex> lock(fftwPlannerMutex());
+		configResult = c->configure(m_nActiveInputs, m_nActiveOutputs, IRlength,
+									m_bufferSize, m_basePartitionSize, m_maxPartitionSize);
 	}
-	m_Convproc = new Convproc;
-	m_Convproc->set_options(options);
-	m_Convproc->set_density(0.0f);
-	configResult = m_Convproc->configure(nActiveInputs, nActiveOutputs,
-										 IRlength, bufferSize, basePartitionSize, (IRlength/2 < Convproc::MAXPART)?IRlength:Convproc::MAXPART);
 	if(configResult != 0){
 		std::cout << "Config failed" << std::endl;
+		delete c;
+		return NULL;
 	}
 	//create IRs
 	if(m_inputChannel < 0){//many to many
-		for(int i = 0; i < nActiveOutputs; i++){
-			m_Convproc->impdata_create(i, i, 1, IRs[i], 0, IRlength);
+		for(int i = 0; i < m_nActiveOutputs; i++){
+			c->impdata_create(i, i, 1, IRs[i], 0, IRlength);
 		}
 	}
 	else{//one to many
-		for(int i = 0; i < nActiveOutputs; i++){
-			m_Convproc->impdata_create(0, i, 1, IRs[i], 0, IRlength);
+		for(int i = 0; i < m_nActiveOutputs; i++){
+			c->impdata_create(0, i, 1, IRs[i], 0, IRlength);
 		}
 	}
-	m_Convproc->start_process(0, 0);
-	return 0;
+	c->start_process(m_absPriority, m_policy);
+	return c;
+}
+
+void Convolver::destroyConvproc(Convproc *c)
+{
+	if (c->state() == Convproc::ST_PROC && c->stop_process()) {
+		cout << "Warning: could not stop process" << endl;
+	}
+	{
+		// cleanup() destroys the FFTW plans
+		std::lock_guard<std::mutex> lock(fftwPlannerMutex());
+		if (c->cleanup()) {
+			cout << "Warning: cleanup failed" << endl;
+		}
+	}
+	delete c;
+}
+
+void Convolver::loaderThreadFunc()
+{
+	vector<float> data;
+	vector<float *> IRs;
+	while (m_runLoader) {
+		Convproc *retired = m_retired.exchange(NULL);
+		if (retired != NULL) {
+			destroyConvproc(retired);
+			m_swaps--;
+		}
+		if (m_loading) {
+			int length;
+			{
+				std::lock_guard<std::mutex> lock(m_requestMutex);
+				data.swap(m_requestIRs);
+				length = m_requestLength;
+				m_loading = false;
+			}
+			IRs.resize(m_nActiveOutputs);
+			for (int i = 0; i < m_nActiveOutputs; i++) {
+				IRs[i] = &data[i * length];
+			}
+			Convproc *c = createConvproc(IRs, length);
+			if (c != NULL) {
+				// Set before handing over, so it covers the set the audio thread takes
+				if (length > m_warmLength) {
+					m_warmLength = length;
+				}
+				// A set the audio thread has not taken yet is replaced
+				Convproc *old = m_pending.exchange(c);
+				if (old != NULL) {
+					destroyConvproc(old);
+					m_swaps--;
+				}
+			} else {
+				m_swaps--;
+			}
+		}
+		al_sleep(0.01);
+	}
 }
 
 void Convolver::onAudioCB(al::AudioIOData &io)
 {
 	int blockSize = io.framesPerBuffer();
 
+	// New IRs run on the input alongside the current ones until they have
+	// heard as much input as their length, so that their tail is complete
+	// when the output crossfades to them
+	if (m_warming != NULL && m_warmPosition >= m_warmLength) {
+		m_fadeFrom = m_Convproc;
+		m_Convproc = m_warming;
+		m_warming = NULL;
+		m_fadePosition = 0;
+	}
+	// Take new IRs once the previous swap is cleaned up
+	if (m_warming == NULL && m_fadeFrom == NULL && m_retired.load() == NULL) {
+		m_warming = m_pending.exchange(NULL);
+		m_warmPosition = 0;
+	}
+	Convproc *procs[3] = {m_Convproc, m_fadeFrom, m_warming};
+
 	//fill the input buffers
 	if(m_inputChannel < 0){
 		// many to many
@@ -87,14 +260,17 @@ void Convolver::onAudioCB(al::AudioIOData &io)
 		for(vector<int>::iterator it = m_activeChannels.begin();
 			it != m_activeChannels.end(); ++it, ++i){
 			const float *inbuf;
-			float *dest = m_Convproc->inpdata(i);
 			if (m_inputsAreBuses){
 				inbuf = io.busBuffer(*it);
 			}
 			else{
 				inbuf = io.inBuffer(*it);
 			}
-			memcpy(dest, inbuf, sizeof(float) * blockSize);
+			for (int p = 0; p < 3; p++) {
+				if (procs[p] != NULL) {
+					memcpy(procs[p]->inpdata(i), inbuf, sizeof(float) * blockSize);
+				}
+			}
 		}
 	}
 	else{
@@ -106,11 +282,22 @@ void Convolver::onAudioCB(al::AudioIOData &io)
 		else{
 			inbuf = io.inBuffer(m_inputChannel);
 		}
-		memcpy(m_Convproc->inpdata(0), inbuf, sizeof(float) * blockSize);
+		for (int p = 0; p < 3; p++) {
+			if (procs[p] != NULL) {
+				memcpy(procs[p]->inpdata(0), inbuf, sizeof(float) * blockSize);
+			}
+		}
 	}
 
 	//process
-	int ret = m_Convproc->process(false);
+	for (int p = 0; p < 3; p++) {
+		if (procs[p] != NULL) {
+			procs[p]->process(false);
+		}
+	}
+	if (m_warming != NULL) {
+		m_warmPosition += blockSize;
+	}
 
 	//fill the output buffers
 	int i = 0;
@@ -118,6 +305,24 @@ void Convolver::onAudioCB(al::AudioIOData &io)
 		it != m_activeChannels.end(); ++it, ++i) {
 		float *outbuf = io.outBuffer(*it);
 		memcpy(outbuf, m_Convproc->outdata(i), sizeof(float) * blockSize);
+		if (m_fadeFrom != NULL) {
+			// Linear crossfade from the old IRs
+			const float *old = m_fadeFrom->outdata(i);
+			float step = 1.0f / m_crossfade;
+			float g = m_fadePosition * step;
+			for (int n = 0; n < blockSize; n++) {
+				if (g > 1.0f) g = 1.0f;
+				outbuf[n] = old[n] + g * (outbuf[n] - old[n]);
+				g += step;
+			}
+		}
+	}
+	if (m_fadeFrom != NULL) {
+		m_fadePosition += blockSize;
+		if (m_fadePosition >= m_crossfade) {
+			m_retired.store(m_fadeFrom); // stopped and freed by the loader thread
+			m_fadeFrom = NULL;
+		}
 	}
 
 	//clear output for disabled channels
@@ -128,12 +333,21 @@ void Convolver::onAudioCB(al::AudioIOData &io)
 }
 
 int Convolver::shutdown(void){
-	if(m_Convproc->stop_process()){
-		cout << "Warning: could not stop process" << endl;
+	if (m_runLoader) {
+		m_runLoader = false;
+		m_loaderThread.join();
 	}
-	if(m_Convproc->cleanup()){
-		cout << "Warning: cleanup failed" << endl;
+	Convproc *procs[5] = {m_Convproc, m_fadeFrom, m_warming, m_pending.exchange(NULL), m_retired.exchange(NULL)};
+	for (int i = 0; i < 5; i++) {
+		if (procs[i] != NULL) {
+			destroyConvproc(procs[i]);
+		}
 	}
+	m_Convproc = NULL;
+	m_fadeFrom = NULL;
+	m_warming = NULL;
+	m_loading = false;
+	m_swaps = 0;
 	return 0;
 }
 
@@ -45,13 +45,30 @@
 	Andres Cabrera, mantaraya36@gmail.com
 */
 
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <ctime>
 #include <iostream>
 #include <cmath>
 #include <cassert>
+#include <memory>
+#include <sstream>
+#include <thread>
+
+#ifndef AL_WINDOWS
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 #include "alloaudio/al_Decorrelation.hpp"
+#include "alloaudio/al_FFTWLock.hpp"
+#include "allocore/io/al_File.hpp"
+#include "allocore/system/al_Thread.hpp"
 #include <Gamma/FFT.h>
 
 using namespace al;
@@ -61,8 +78,25 @@ using namespace std;
 #define M_PI		3.14159265358979323846
 #endif
 
+enum { IRS_RANDOM = 0, IRS_DETERMINISTIC = 1 };
+
+/* Header of a cache file, followed by the IRs one after the other */
+struct CacheHeader {
+	char magic[8];
+	int32_t kind;
+	int32_t size;
+	int32_t numOuts;
+	int32_t numParams;
+	int64_t seed;
+	float params[6];
+	int32_t reserved[2]; /* keeps the IRs 16 byte aligned */
+};
+
+static const char CACHE_MAGIC[8] = {'A', 'L', 'D', 'E', 'C', 'O', 'R', '1'};
+
 Decorrelation::Decorrelation(int size, int inChannel, int numOuts,
                              bool inputsAreBuses) :
+    mMapped(NULL), mMappedSize(0), mNumThreads(0), mLoadedFromCache(false),
     mSize(size), mInChannel(inChannel), mNumOuts(numOuts),
     mInputsAreBuses(inputsAreBuses)
 {
@@ -78,119 +112,289 @@ long al::Decorrelation::getCurrentSeed()
 	return mSeed;
 }
 
+void Decorrelation::setCacheDirectory(const std::string &dir)
+{
+	mCacheDir = dir;
+}
+
+void Decorrelation::setNumThreads(int numThreads)
+{
+	mNumThreads = numThreads;
+}
+
+bool Decorrelation::loadedFromCache()
+{
+	return mLoadedFromCache;
+}
+
+void Decorrelation::allocateIRs()
+{
+	freeIRs();
+	mIRData.assign(mSize * mNumOuts, 0.0f);
+	for (int i = 0; i < mNumOuts; i++) {
+		mIRs.push_back(&mIRData[i * mSize]);
+	}
+}
+
+void Decorrelation::inverseTransform(vector<float> &spectra)
+{
+	// Spectra are in the complex buffer layout of gam::RFFT, mSize + 2 values each
+	const int stride = mSize + 2;
+	int numThreads = mNumThreads > 0 ? mNumThreads : (int) std::thread::hardware_concurrency();
+	if (numThreads > mNumOuts) numThreads = mNumOuts;
+	if (numThreads < 1) numThreads = 1;
+	if (mNumThreads == 0 && (long) mSize * mNumOuts < 65536) numThreads = 1; // not worth starting threads
+
+	// One FFT per thread, reused for all its IRs. They are planned here, as
+	// FFTW planning is not thread-safe.
+	std::vector<std::unique_ptr<gam::RFFT<float> > > ffts;
+	{
+		std::lock_guard<std::mutex> lock(fftwPlannerMutex());
+		for (int i = 0; i < numThreads; i++) {
+			ffts.push_back(std::unique_ptr<gam::RFFT<float> >(new gam::RFFT<float>(mSize)));
+		}
+	}
+
+	std::atomic<int> nextIR(0);
+	auto work = [&](gam::RFFT<float> &fftObj) {
+		int irIndex;
+		while ((irIndex = nextIR++) < mNumOuts) {
+			float *spectrum = &spectra[irIndex * stride];
+			fftObj.inverse(spectrum, true);
+			float *irdata = mIRs[irIndex];
+			const float norm = 1.0f / mSize;
+			for (int i = 0; i < mSize; i++) {
+				irdata[i] = spectrum[i + 1] * norm;
+			}
+		}
+	};
+
+	std::vector<std::unique_ptr<Thread> > threads;
+	for (int i = 1; i < numThreads; i++) {
+		gam::RFFT<float> &fftObj = *ffts[i];
+		threads.push_back(std::unique_ptr<Thread>(new Thread));
+		threads.back()->start([&work, &fftObj](){ work(fftObj); });
+	}
+	work(*ffts[0]);
+	for (unsigned i = 0; i < threads.size(); i++) {
+		threads[i]->join();
+	}
+
+	std::lock_guard<std::mutex> lock(fftwPlannerMutex());
+	ffts.clear();
+}
+
+std::string Decorrelation::cachePath(int kind, const float *params, int numParams)
+{
+	std::stringstream name;
+	name << File::conformDirectory(mCacheDir) << "decorrelation_"
+	     << (kind == IRS_RANDOM ? "random" : "deterministic") << "_"
+	     << mSize << "_" << mNumOuts << "_" << mSeed;
+	for (int i = 0; i < numParams; i++) {
+		uint32_t bits;
+		memcpy(&bits, &params[i], sizeof(bits));
+		name << "_" << std::hex << bits << std::dec; // exact, unlike a printed float
+	}
+	name << ".irs";
+	return name.str();
+}
+
+static void fillHeader(CacheHeader &h, int kind, int size, int numOuts, long seed,
+                       const float *params, int numParams)
+{
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, CACHE_MAGIC, sizeof(h.magic));
+	h.kind = kind;
+	h.size = size;
+	h.numOuts = numOuts;
+	h.numParams = numParams;
+	h.seed = seed;
+	for (int i = 0; i < numParams; i++) {
+		h.params[i] = params[i];
+	}
+}
+
+bool Decorrelation::loadCache(int kind, const float *params, int numParams)
+{
+	if (mCacheDir.empty()) {
+		return false;
+	}
+	std::string path = cachePath(kind, params, numParams);
+	CacheHeader expected;
+	fillHeader(expected, kind, mSize, mNumOuts, mSeed, params, numParams);
+	size_t dataSize = sizeof(float) * mSize * mNumOuts;
+	size_t fileSize = sizeof(CacheHeader) + dataSize;
+
+#ifndef AL_WINDOWS
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	struct stat st;
+	void *mapped = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && (size_t) st.st_size == fileSize) {
+		// Private writable mapping, so getIR() data can be modified without touching the file
+		mapped = mmap(NULL, fileSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	}
+	close(fd);
+	if (mapped == MAP_FAILED) {
+		return false;
+	}
+	if (memcmp(mapped, &expected, sizeof(CacheHeader)) != 0) {
+		munmap(mapped, fileSize);
+		return false;
+	}
+	freeIRs();
+	mMapped = mapped;
+	mMappedSize = fileSize;
+	float *data = (float *) ((char *) mapped + sizeof(CacheHeader));
+	for (int i = 0; i < mNumOuts; i++) {
+		mIRs.push_back(data + i * mSize);
+	}
+	mLoadedFromCache = true;
+	return true;
+#else
+	FILE *f = fopen(path.c_str(), "rb");
+	if (f == NULL) {
+		return false;
+	}
+	CacheHeader h;
+	bool ok = fread(&h, sizeof(h), 1, f) == 1 && memcmp(&h, &expected, sizeof(h)) == 0;
+	if (ok) {
+		allocateIRs();
+		ok = fread(mIRData.data(), dataSize, 1, f) == 1;
+	}
+	fclose(f);
+	mLoadedFromCache = ok;
+	return ok;
+#endif
+}
+
+void Decorrelation::saveCache(int kind, const float *params, int numParams)
+{
+	if (mCacheDir.empty()) {
+		return;
+	}
+	if (!File::exists(mCacheDir) && !Dir::make(mCacheDir)) {
+		cout << "Decorrelation: could not create cache directory " << mCacheDir << endl;
+		return;
+	}
+	std::string path = cachePath(kind, params, numParams);
+	CacheHeader h;
+	fillHeader(h, kind, mSize, mNumOuts, mSeed, params, numParams);
+
+	// Written under a temporary name, so that other processes never map a partial file
+	std::stringstream tmpPath;
+	tmpPath << path << "." << time(0) << "." << rand() << ".tmp";
+	FILE *f = fopen(tmpPath.str().c_str(), "wb");
+	if (f == NULL) {
+		cout << "Decorrelation: could not write cache file " << path << endl;
+		return;
+	}
+	bool ok = fwrite(&h, sizeof(h), 1, f) == 1;
+	for (int i = 0; ok && i < mNumOuts; i++) {
+		ok = fwrite(mIRs[i], sizeof(float) * mSize, 1, f) == 1;
+	}
+	ok = (fclose(f) == 0) && ok;
+	if (!ok || std::rename(tmpPath.str().c_str(), path.c_str()) != 0) {
+		std::remove(tmpPath.str().c_str());
+		cout << "Decorrelation: could not write cache file " << path << endl;
+	}
+}
+
 void Decorrelation::generateIRs(long seed, float maxjump, float phaseFactor)
 {
-	float *ampSpectrum = (float *) calloc(mSize, sizeof(float));
-	float *phsSpectrum = (float *) calloc(mSize, sizeof(float));
-	float *complexSpectrum = (float *) calloc(mSize * 2, sizeof(float));;
 	//	#    max_jump -  is the maximum phase difference (in radians) between bins
 	//	#             if -1, the random numbers are used directly (no jumping).
 
-	freeIRs();
-
 	int n = mSize/2; // before mirroring
 
 	// Seed random number generator
 	if (seed >= 0) {
 		mSeed = seed;
+		const float params[] = {maxjump, phaseFactor};
+		if (loadCache(IRS_RANDOM, params, 2)) {
+			return;
+		}
 	} else {
 		mSeed = time(0);
 	}
+	allocateIRs();
+
+	// The random phases are drawn in sequence, so that a seed always gives the
+	// same IRs, and the inverse transforms are then computed in parallel
+	const int stride = mSize + 2;
+	vector<float> spectra(stride * mNumOuts);
 	srand(mSeed);
 	for (int irIndex = 0; irIndex < mNumOuts; irIndex++) {
+		float *complexSpectrum = &spectra[irIndex * stride];
 		// Fill in DC and Nyquist
-		ampSpectrum[0] = 1.0;
-		phsSpectrum[0] = 0.0;
-		complexSpectrum[0] = ampSpectrum[0] * cos(phsSpectrum[0]);
-		complexSpectrum[1] = ampSpectrum[0] * sin(phsSpectrum[0]);
-		complexSpectrum[(n*2)] = ampSpectrum[0] * cos(phsSpectrum[0]);
-		complexSpectrum[(n*2) + 1] = ampSpectrum[0] * sin(phsSpectrum[0]);
+		complexSpectrum[0] = 1.0;
+		complexSpectrum[1] = 0.0;
+		complexSpectrum[(n*2)] = 1.0;
+		complexSpectrum[(n*2) + 1] = 0.0;
 
 		float old_phase = 0;
 		for (int i=1; i < n; i++) {
-			ampSpectrum[i] = 1.0;
+			float phase;
 			if (maxjump == -1.0) {
-				phsSpectrum[i] = ((rand() / (float) RAND_MAX) * M_PI)- (M_PI/2.0);
+				phase = ((rand() / (float) RAND_MAX) * M_PI)- (M_PI/2.0);
 			} else {
 				// make phase only move +- limit
 				float delta = ((rand() / ((float) RAND_MAX)) * 2.0 * maxjump) - maxjump;
-//				std::cout << "delta " << delta << std::endl;
 				float new_phase = old_phase + delta;
-				phsSpectrum[i] = new_phase * phaseFactor;
+				phase = new_phase * phaseFactor;
 				old_phase = new_phase;
 			}
-			
-			complexSpectrum[i*2] = ampSpectrum[i] * cos(phsSpectrum[i]); // Real part
-			complexSpectrum[i*2 + 1] = ampSpectrum[i] * sin(phsSpectrum[i]); // Imaginary
-//			std::cout << complexSpectrum[i*2] << ", " << complexSpectrum[i*2 + 1] << ",";
-		}
-
-//		std::cout << ".... " <<std::endl;
-		gam::RFFT<float> fftObj(mSize);
-
-		fftObj.inverse(complexSpectrum, true);
-		float *irdata = (float *) calloc(mSize, sizeof(float));
 
-		for (int i=1; i <= mSize; i++) {
-			irdata[i - 1] = complexSpectrum[i]/mSize;
-//			std::cout << complexSpectrum[i]/mSize << "," << std::endl;
+			complexSpectrum[i*2] = cos(phase); // Real part
+			complexSpectrum[i*2 + 1] = sin(phase); // Imaginary
 		}
-		mIRs.push_back(irdata);
 	}
-	free(ampSpectrum);
-	free(phsSpectrum);
-	free(complexSpectrum);
+	inverseTransform(spectra);
+
+	if (seed >= 0) {
+		const float params[] = {maxjump, phaseFactor};
+		saveCache(IRS_RANDOM, params, 2);
+	}
 }
 
 void Decorrelation::generateDeterministicIRs(long seed, float deltaFreq, float maxFreqDev,
                                              float maxTau, float startPhase, float phaseDev)
 {
-	float *ampSpectrum = (float *) calloc(mSize, sizeof(float));
-	float *phsSpectrum = (float *) calloc(mSize, sizeof(float));
-	float *complexSpectrum = (float *) calloc(mSize * 2, sizeof(float));;
-	//	#    max_jump -  is the maximum phase difference (in radians) between bins
-	//	#             if -1, the random numbers are used directly (no jumping).
-
-	freeIRs();
-
 	int n = mSize/2; // before mirroring
+	const float params[] = {deltaFreq, maxFreqDev, maxTau, startPhase, phaseDev};
 
 	// Seed random number generator
 	if (seed >= 0) {
 		mSeed = seed;
+		if (loadCache(IRS_DETERMINISTIC, params, 5)) {
+			return;
+		}
 	} else {
 		mSeed = time(0);
 	}
-	srand(mSeed);
+	allocateIRs();
 
+	const int stride = mSize + 2;
+	vector<float> spectra(stride * mNumOuts);
+	srand(mSeed);
 	for (int irIndex = 0; irIndex < mNumOuts; irIndex++) {
+		float *complexSpectrum = &spectra[irIndex * stride];
 		float freq = deltaFreq + ((2.0 * maxFreqDev * rand() / (float) RAND_MAX) - maxFreqDev);
-		std::cout << "freq " << irIndex << ":" << freq << std::endl;
 		for (int i=0; i < n + 1; i++) {
-			ampSpectrum[i] = 1.0;
 			float phaseOffset = startPhase + ((2.0 * phaseDev * rand() / (float) RAND_MAX) - phaseDev);
-			phsSpectrum[i] = maxTau * sin(phaseOffset + (2 * M_PI * i * freq / n));
+			float phase = maxTau * sin(phaseOffset + (2 * M_PI * i * freq / n));
 
-			complexSpectrum[i*2] = ampSpectrum[i] * cos(phsSpectrum[i]); // Real part
-			complexSpectrum[i*2 + 1] = ampSpectrum[i] * sin(phsSpectrum[i]); // Imaginary
-//			std::cout << complexSpectrum[i*2] << ", " << complexSpectrum[i*2 + 1] << ",";
+			complexSpectrum[i*2] = cos(phase); // Real part
+			complexSpectrum[i*2 + 1] = sin(phase); // Imaginary
 		}
+	}
+	inverseTransform(spectra);
 
-//		std::cout << ".... " <<std::endl;
-		gam::RFFT<float> fftObj(mSize);
-
-		fftObj.inverse(complexSpectrum, true);
-		float *irdata = (float *) calloc(mSize, sizeof(float));
-
-		for (int i=1; i <= mSize; i++) {
-			irdata[i - 1] = complexSpectrum[i]/mSize;
-//			std::cout << complexSpectrum[i]/mSize << "," << std::endl;
-		}
-		mIRs.push_back(irdata);
+	if (seed >= 0) {
+		saveCache(IRS_DETERMINISTIC, params, 5);
 	}
-	free(ampSpectrum);
-	free(phsSpectrum);
-	free(complexSpectrum);
 }
 
 void Decorrelation::onAudioCB(al::AudioIOData &io)
@@ -213,10 +417,16 @@ int al::Decorrelation::getSize()
 
 void al::Decorrelation::freeIRs()
 {
-	for (unsigned int i = 0; i < mIRs.size(); i++){
-		free(mIRs[i]);
-	}
 	mIRs.clear();
+	mIRData.clear();
+#ifndef AL_WINDOWS
+	if (mMapped != NULL) {
+		munmap(mMapped, mMappedSize);
+	}
+#endif
+	mMapped = NULL;
+	mMappedSize = 0;
+	mLoadedFromCache = false;
 }
 
 void Decorrelation::configure(al::AudioIO &io, long seed, float maxjump, float phaseFactor)
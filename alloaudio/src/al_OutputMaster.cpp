@@ -1,25 +1,54 @@
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <sstream>
 
 #include "alloaudio/al_OutputMaster.hpp"
 #include "allocore/system/al_Time.hpp"
 
-#include "alloaudio/butter.h"
-
 //#include "firfilter.h"
 
 using namespace al;
 
+/* Size of the receive buffer of al::osc::Recv, used as the largest meter bundle */
+static const int METER_PACKET_SIZE = 1024;
+
+/* Accumulate the peak and sum of squares of a block. The eight partial results are
+ * independent, so the compiler can keep them in one vector register. */
+static void meterBlock(const float *in, int nframes, float &peak, float &sumSquares)
+{
+	float pk[8] = {0}, ss[8] = {0};
+	int i = 0;
+	for (; i + 8 <= nframes; i += 8) {
+		for (int k = 0; k < 8; k++) {
+			float v = in[i + k];
+			float a = std::fabs(v);
+			pk[k] = a > pk[k] ? a : pk[k];
+			ss[k] += v * v;
+		}
+	}
+	for (; i < nframes; i++) {
+		float a = std::fabs(in[i]);
+		pk[0] = a > pk[0] ? a : pk[0];
+		ss[0] += in[i] * in[i];
+	}
+	for (int k = 0; k < 8; k++) {
+		peak = pk[k] > peak ? pk[k] : peak;
+		sumSquares += ss[k];
+	}
+}
+
 OutputMaster::OutputMaster(int num_chnls, double sampleRate, const char *address, int port,
 						   const char *sendAddress, int sendPort, al_sec msg_timeout):
 	m_numChnls(num_chnls),
-	m_meterBuffer(1024 * sizeof(float)), m_framesPerSec(sampleRate),
+	m_framesPerSec(sampleRate),
 	osc::Recv(port, address, msg_timeout),
-	m_sendAddress(sendAddress), m_sendPort(sendPort)
+	m_sendAddress(sendAddress), m_sendPort(sendPort),
+	m_runMeterThread(false)
 {
-	pthread_mutex_init(&m_meterMutex, NULL);
-	pthread_cond_init(&m_meterCond, NULL);
 	allocateChannels(m_numChnls);
 	initializeData();
 
@@ -37,23 +66,18 @@ OutputMaster::OutputMaster(int num_chnls, double sampleRate, const char *address
 		}
 	}
 	if (m_sendPort > 0 && strlen(sendAddress) > 1) {
-		m_runMeterThread = 1;
-		m_meterThread.start(OutputMaster::meterThreadFunc, (void *) this);
+		m_runMeterThread = true;
+		m_meterThread.start([this](){ meterThreadFunc(); });
 	}
 }
 
 OutputMaster::~OutputMaster()
 {
-	for (int i = 0; i < m_numChnls; i++) {
-		butter_free(m_lopass1[i]);
-		butter_free(m_lopass2[i]);
-		butter_free(m_hipass1[i]);
-		butter_free(m_hipass2[i]);
-	}
 	stop(); /* Stops OSC listener */
-	m_runMeterThread = 0;
-	pthread_cond_signal(&m_meterCond);
-	m_meterThread.join();
+	if (m_runMeterThread) {
+		m_runMeterThread = false;
+		m_meterThread.join();
+	}
 }
 
 
@@ -86,15 +110,18 @@ void OutputMaster::setMeterUpdateFreq(double freq)
 	m_meterUpdateSamples = (int)(m_framesPerSec/freq);
 }
 
+void OutputMaster::setMeterFormat(meter_format_t format)
+{
+	m_meterFormat = format;
+}
+
 void OutputMaster::setBassManagementFreq(double frequency)
 {
 	int i;
 	if (frequency > 0) {
 		for (i = 0; i < m_numChnls; i++) {
-			butter_set_fc(m_lopass1[i], frequency);
-			butter_set_fc(m_lopass2[i], frequency);
-			butter_set_fc(m_hipass1[i], frequency);
-			butter_set_fc(m_hipass2[i], frequency);
+			m_lowpass.set(i, BIQUAD_LPF, frequency);
+			m_highpass.set(i, BIQUAD_HPF, frequency);
 		}
 	}
 }
@@ -121,7 +148,72 @@ void OutputMaster::setMeterOn(bool meterOn)
 
 int OutputMaster::getMeterValues(float *values)
 {
-	return m_meterBuffer.read((char *) values, m_numChnls * sizeof(float));
+	if (!m_meterSnapshot.update()) {
+		return 0;
+	}
+	memcpy(values, m_meterSnapshot.front(), m_numChnls * sizeof(float));
+	return m_numChnls;
+}
+
+int OutputMaster::getMeterValues(float *peaks, float *rms)
+{
+	if (!m_meterSnapshot.update()) {
+		return 0;
+	}
+	memcpy(peaks, m_meterSnapshot.front(), m_numChnls * sizeof(float));
+	memcpy(rms, m_meterSnapshot.front() + m_numChnls, m_numChnls * sizeof(float));
+	return m_numChnls;
+}
+
+void OutputMaster::setAlignmentOn(bool alignmentOn)
+{
+	m_alignmentOn = alignmentOn;
+}
+
+void OutputMaster::setMaxAlignmentDelay(double seconds)
+{
+	m_maxDelay = seconds > 0 ? seconds * m_framesPerSec : 0;
+	for (int i = 0; i < m_numChnls; i++) {
+		m_alignDelays[i] = 0;
+	}
+	allocateDelays();
+}
+
+void OutputMaster::setAlignmentDelay(int channelIndex, double seconds)
+{
+	if (channelIndex >= 0 && channelIndex < m_numChnls) {
+		double delay = seconds * m_framesPerSec;
+		m_alignDelays[channelIndex] = delay < 0 ? 0 : (delay > m_maxDelay ? m_maxDelay : delay);
+	}
+}
+
+void OutputMaster::setAlignmentGain(int channelIndex, double gain)
+{
+	if (channelIndex >= 0 && channelIndex < m_numChnls) {
+		m_alignGains[channelIndex] = gain;
+	}
+}
+
+void OutputMaster::setSpeakerAlignment(const SpeakerLayout &layout, double speedOfSound)
+{
+	const Speakers &speakers = layout.speakers();
+	float maxRadius = 0, minRadius = 0;
+	for (unsigned i = 0; i < speakers.size(); i++) {
+		if (i == 0 || speakers[i].radius > maxRadius) maxRadius = speakers[i].radius;
+		if (i == 0 || speakers[i].radius < minRadius) minRadius = speakers[i].radius;
+	}
+	if (maxRadius <= 0) {
+		return;
+	}
+	double maxDelay = (maxRadius - minRadius) / speedOfSound;
+	if (maxDelay * m_framesPerSec > m_maxDelay) {
+		setMaxAlignmentDelay(maxDelay);
+	}
+	for (unsigned i = 0; i < speakers.size(); i++) {
+		int chan = speakers[i].deviceChannel;
+		setAlignmentDelay(chan, (maxRadius - speakers[i].radius) / speedOfSound);
+		setAlignmentGain(chan, speakers[i].radius / maxRadius);
+	}
 }
 
 int OutputMaster::getNumChnls()
@@ -129,68 +221,61 @@ int OutputMaster::getNumChnls()
 	return m_numChnls;
 }
 
+void OutputMaster::setMaxBlockSize(int frames)
+{
+	m_maxBlockSize = frames > 0 ? frames : 1;
+	m_lowBuffer.assign(m_numChnls * m_maxBlockSize, 0.f);
+	allocateDelays();
+}
+
 void OutputMaster::onAudioCB(AudioIOData &io)
 {
-	int i, chan = 0;
 	int nframes = io.framesPerBuffer();
+	m_parameterQueue.update(0);
+	/* Blocks larger than the buffers allocated by setMaxBlockSize() are processed in pieces */
+	for (int offset = 0; offset < nframes; offset += m_maxBlockSize) {
+		processBlock(io, offset, std::min(m_maxBlockSize, nframes - offset));
+	}
+}
+
+void OutputMaster::processBlock(AudioIOData &io, int offset, int nframes)
+{
+	int i, chan = 0;
 	double bass_buf[nframes];
-	double filt_out[nframes];
-	double filt_low[nframes];
-	double in_buf[nframes];
 	double master_gain;
+	bool lowpass = m_BassManagementMode == BASSMODE_LOWPASS || m_BassManagementMode == BASSMODE_FULL;
+	bool highpass = m_BassManagementMode == BASSMODE_HIGHPASS || m_BassManagementMode == BASSMODE_FULL;
 
-	m_parameterQueue.update(0);
 	master_gain = m_masterGain * (m_muteAll ? 0.0 : 1.0);
 	memset(bass_buf, 0, nframes * sizeof(double));
+
+	/* The input here is the output from previous runs for the io object */
 	for (chan = 0; chan < m_numChnls; chan++) {
-		double gain = master_gain * m_gains[chan];
-		const float *in = io.outBuffer(chan);  // Yes, the input here is the output from previous runs for the io object
-		float *out = io.outBuffer(chan);
-		double filt_temp[nframes];
-		double *buf = bass_buf;
+		m_inPtrs[chan] = io.outBuffer(chan) + offset;
+		m_lowPtrs[chan] = &m_lowBuffer[chan * nframes];
+	}
 
-		for (i = 0; i < nframes; i++) {
-			in_buf[i] = *in++;
-		}
-		switch (m_BassManagementMode) {
-		case BASSMODE_NONE:
-			break;
-		case BASSMODE_MIX:
-			for (i = 0; i < nframes; i++) {
-				filt_low[i] = in_buf[i];
-			}
-			break;
-		case BASSMODE_LOWPASS:
-			butter_next(m_lopass1[chan], in_buf, filt_temp, nframes);
-			butter_next(m_lopass2[chan], filt_temp, filt_low, nframes);
-			break;
-		case BASSMODE_HIGHPASS:
-			for (i = 0; i < nframes; i++) {
-				filt_low[i] = in_buf[i];
-			}
-			butter_next(m_hipass1[chan], in_buf, filt_temp, nframes);
-			butter_next(m_hipass2[chan], filt_temp, filt_out, nframes);
-			for (i = 0; i < nframes; i++) {
-				in_buf[i] = filt_out[i];
-			}
-			break;
-		case BASSMODE_FULL:
-			butter_next(m_lopass1[chan], in_buf, filt_temp, nframes);
-			butter_next(m_lopass2[chan], filt_temp, filt_low, nframes);
-			butter_next(m_hipass1[chan], in_buf, filt_temp, nframes);
-			butter_next(m_hipass2[chan], filt_temp, filt_out, nframes);
+	/* Cross-over filters process all channels at once */
+	if (lowpass) {
+		m_lowpass.process(m_lowPtrs.data(), m_inPtrs.data(), nframes);
+	}
+	if (m_BassManagementMode != BASSMODE_NONE) {
+		for (chan = 0; chan < m_numChnls; chan++) { /* accumulate SW signal */
+			const float *low = lowpass ? m_lowPtrs[chan] : m_inPtrs[chan];
 			for (i = 0; i < nframes; i++) {
-				in_buf[i] = filt_out[i]; /* a bit inefficient to copy here, but makes code simpler below */
+				bass_buf[i] += low[i];
 			}
-			break;
-		default:
-			break;
-		}
-		for (i = 0; i < nframes; i++) { /* accumulate SW signal */
-			*buf++ += filt_low[i];
 		}
+	}
+	if (highpass) {
+		m_highpass.process(m_inPtrs.data(), nframes);
+	}
+
+	for (chan = 0; chan < m_numChnls; chan++) {
+		double gain = master_gain * m_gains[chan];
+		float *out = io.outBuffer(chan) + offset;
 		for (i = 0; i < nframes; i++) {
-			*out = in_buf[i] * gain;
+			*out = *out * gain;
 			if (m_clipperOn && *out > master_gain) {
 				*out = master_gain;
 			}
@@ -201,33 +286,90 @@ void OutputMaster::onAudioCB(AudioIOData &io)
 		int sw;
 		for(sw = 0; sw < 4; sw++) {
 			if (swIndex[sw] < 0) continue;
-			float *out = io.outBuffer(swIndex[sw]);
+			float *out = io.outBuffer(swIndex[sw]) + offset;
 			memset(out, 0, nframes * sizeof(float));
 			for (i = 0; i < nframes; i++) {
 				*out++ = bass_buf[i];
 			}
 		}
 	}
+	if (m_alignmentOn) {
+		processAlignment(io, offset, nframes);
+	}
 	if (m_meterOn) {
 		for (chan = 0; chan < m_numChnls; chan++) {
-			float *out = io.outBuffer(chan);
-			for (i = 0; i < nframes; i++) {
-				if (m_meters[chan] < *out) {
-					m_meters[chan] = *out;
-				}
-				out++;
-			}
+			meterBlock(io.outBuffer(chan) + offset, nframes, m_meterPeaks[chan], m_meterSumSquares[chan]);
 		}
 		m_meterCounter += nframes;
 		if (m_meterCounter >= m_meterUpdateSamples) {
-			m_meterBuffer.write( (char *) m_meters.data(), sizeof(float) * m_numChnls);
-			memset(m_meters.data(), 0, sizeof(float) * m_numChnls);
+			float *levels = m_meterSnapshot.back();
+			for (chan = 0; chan < m_numChnls; chan++) {
+				levels[chan] = m_meterPeaks[chan];
+				levels[m_numChnls + chan] = std::sqrt(m_meterSumSquares[chan] / m_meterCounter);
+				m_meterPeaks[chan] = 0;
+				m_meterSumSquares[chan] = 0;
+			}
+			m_meterSnapshot.publish();
 			m_meterCounter = 0; // A little jitter but efficient
-			pthread_cond_signal(&m_meterCond);
 		}
 	}
 }
 
+void OutputMaster::processAlignment(AudioIOData &io, int offset, int nframes)
+{
+	const int stride = m_delayLength + m_maxBlockSize;
+	const int mask = m_delayLength - 1;
+	/* A delay must not reach samples overwritten by this block */
+	const int longest = m_delayLength - nframes - 1;
+
+	/* The block is written in at most two pieces. The part of it that falls in
+	 * the first m_maxBlockSize samples of the ring is copied again to the guard. */
+	int first = m_delayLength - m_delayWrite;
+	if (first > nframes) first = nframes;
+	int mirrorStart = m_delayWrite, mirrorEnd = m_delayWrite + nframes;
+	if (first < nframes) { /* wrapped */
+		mirrorStart = 0;
+		mirrorEnd = m_delayWrite < m_maxBlockSize ? m_maxBlockSize : nframes - first;
+	}
+	if (mirrorEnd > m_maxBlockSize) mirrorEnd = m_maxBlockSize;
+
+	for (int chan = 0; chan < m_numChnls; chan++) {
+		float *line = &m_delayMemory[chan * stride];
+		float *out = io.outBuffer(chan) + offset;
+		memcpy(line + m_delayWrite, out, first * sizeof(float));
+		memcpy(line, out + first, (nframes - first) * sizeof(float));
+		if (mirrorStart < mirrorEnd) {
+			memcpy(line + m_delayLength + mirrorStart, line + mirrorStart,
+				   (mirrorEnd - mirrorStart) * sizeof(float));
+		}
+
+		double delay = m_alignDelays[chan];
+		float gain = m_alignGains[chan];
+		if (delay == 0) {
+			if (gain != 1) {
+				for (int i = 0; i < nframes; i++) {
+					out[i] *= gain;
+				}
+			}
+			continue;
+		}
+		int whole = (int) delay;
+		float frac = delay - whole;
+		if (whole > longest) {
+			whole = longest;
+			frac = 0;
+		}
+		/* out[i] = (1 - frac) x[n - whole] + frac x[n - whole - 1], reading from one
+		 * contiguous span so the loop vectorizes */
+		const float *in = line + ((m_delayWrite - whole - 1) & mask);
+		const float a = gain * (1 - frac), b = gain * frac;
+		for (int i = 0; i < nframes; i++) {
+			out[i] = a * in[i + 1] + b * in[i];
+		}
+	}
+	m_delayWrite = (m_delayWrite + nframes) & mask;
+}
+
 void OutputMaster::setGainTimestamped(al_sec until, int channelIndex, double gain)
 {
 	setGain(channelIndex, gain);
@@ -267,6 +409,21 @@ void OutputMaster::setBassManagementModeTimestamped(al_sec until, int mode)
 {
 	setBassManagementMode((bass_mgmt_mode_t) mode);
 }
+
+void OutputMaster::setAlignmentOnTimestamped(al_sec until, bool on)
+{
+	setAlignmentOn(on);
+}
+
+void OutputMaster::setAlignmentDelayTimestamped(al_sec until, int channelIndex, double seconds)
+{
+	setAlignmentDelay(channelIndex, seconds);
+}
+
+void OutputMaster::setAlignmentGainTimestamped(al_sec until, int channelIndex, double gain)
+{
+	setAlignmentGain(channelIndex, gain);
+}
 std::string OutputMaster::addressPrefix() const
 {
 	return m_addressPrefix;
@@ -306,6 +463,8 @@ void OutputMaster::initializeData()
 	m_meterCounter = 0;
 	m_meterOn = false;
 	m_meterAddrHasChannel = false;
+	m_meterFormat = METER_BUNDLE;
+	m_alignmentOn = true;
 
 	setBassManagementMode(BASSMODE_NONE);
 	setBassManagementFreq(150);
@@ -315,58 +474,102 @@ void OutputMaster::initializeData()
 void OutputMaster::allocateChannels(int numChnls)
 {
 	m_gains.resize(numChnls);
-	m_meters.resize(numChnls);
-	m_lopass1.resize(numChnls);
-	m_lopass2.resize(numChnls);
-	m_hipass1.resize(numChnls);
-	m_hipass2.resize(numChnls);
+	m_meterPeaks.resize(numChnls);
+	m_meterSumSquares.resize(numChnls);
+	m_meterSnapshot.resize(2 * numChnls);
+	m_alignDelays.assign(numChnls, 0.0);
+	m_alignGains.assign(numChnls, 1.0);
+	m_delayWrite = 0;
+	m_lowpass.resize(numChnls, 2);
+	m_highpass.resize(numChnls, 2);
+	m_lowpass.setSampleRate(m_framesPerSec);
+	m_highpass.setSampleRate(m_framesPerSec);
+	m_inPtrs.resize(numChnls);
+	m_lowPtrs.resize(numChnls);
+	m_maxDelay = 0;
+	setMaxBlockSize(8192);
+	setMaxAlignmentDelay(0.02);
 	swIndex[0] = numChnls - 1;
 	swIndex[1] =  swIndex[2] = swIndex[3] = -1;
 
 	for (int i = 0; i < numChnls; i++) {
 		m_gains[i] = 1.0;
-		m_meters[i] = 0;
-		m_lopass1[i] = butter_create(m_framesPerSec, BUTTER_LP);
-		m_lopass2[i] = butter_create(m_framesPerSec, BUTTER_LP);
-		m_hipass1[i] = butter_create(m_framesPerSec, BUTTER_HP);
-		m_hipass2[i] = butter_create(m_framesPerSec, BUTTER_HP);
-	}
-}
-
-void *OutputMaster::meterThreadFunc(void *arg) {
-	int chanindex = 0;
-	OutputMaster *om = static_cast<OutputMaster *>(arg);
-	float meter_levels[om->m_numChnls];
-
-	al::osc::Send s(om->m_sendPort, om->m_sendAddress.c_str());
-	while(om->m_runMeterThread) {
-		pthread_mutex_lock(&om->m_meterMutex);
-		pthread_cond_wait(&om->m_meterCond, &om->m_meterMutex);
-		int bytes_read = om->m_meterBuffer.read((char *) meter_levels, om->m_numChnls * sizeof(float));
-		if (bytes_read) {
-			if (bytes_read !=  om->m_numChnls * sizeof(float)) {
-				std::cerr << "Alloaudio: Warning. Meter values underrun." << std::endl;
-			}
-			for (int i = 0; i < bytes_read/sizeof(float); i++) {
-				if (om->m_meterAddrHasChannel) {
-					std::stringstream addr;
-					addr << om->m_addressPrefix << "/meterdb/" <<  chanindex + 1;
-					s.send(addr.str(),
-						   (float) (20.0 * log10(meter_levels[i])));
-				} else {
-					s.send(om->m_addressPrefix + "/meterdb", chanindex,
-						   (float) (20.0 * log10(meter_levels[i])));
-				}
+		m_meterPeaks[i] = 0;
+		m_meterSumSquares[i] = 0;
+	}
+}
 
-				chanindex++;
-				if (chanindex == om->m_numChnls) {
-					chanindex = 0;
-				}
-			}
+void OutputMaster::allocateDelays()
+{
+	/* Room for the longest delay, a block and the interpolation sample */
+	int length = 1;
+	while (length < (int) m_maxDelay + m_maxBlockSize + 2) {
+		length *= 2;
+	}
+	m_delayLength = length;
+	m_delayWrite = 0;
+	m_delayMemory.assign(m_numChnls * (m_delayLength + m_maxBlockSize), 0.f);
+}
+
+void OutputMaster::meterThreadFunc()
+{
+	int packetSize = METER_PACKET_SIZE;
+	if (packetSize < 8 * m_numChnls + 64) { /* a blob of all levels */
+		packetSize = 8 * m_numChnls + 64;
+	}
+	al::osc::Send s(m_sendPort, m_sendAddress.c_str(), 0, packetSize);
+	std::vector<float> levels(2 * m_numChnls);
+	while (m_runMeterThread) {
+		/* Poll at the update rate, or at least every 10 ms so that a change of rate
+		 * is picked up quickly; the audio thread only publishes snapshots */
+		double period = m_meterUpdateSamples / m_framesPerSec;
+		al_sleep(period < 0.0001 ? 0.0001 : (period > 0.01 ? 0.01 : period));
+		if (!m_meterSnapshot.update()) {
+			continue;
 		}
-		pthread_mutex_unlock(&om->m_meterMutex);
+		memcpy(levels.data(), m_meterSnapshot.front(), levels.size() * sizeof(float));
+		sendMeters(s, levels.data());
 	}
-	return NULL;
+}
+
+void OutputMaster::sendMeters(osc::Send &s, const float *levels)
+{
+	if (m_meterFormat == METER_BLOB) {
+		std::vector<unsigned char> blob(2 * m_numChnls * 4);
+		for (int i = 0; i < 2 * m_numChnls; i++) {
+			float db = 20.0 * log10(levels[i]);
+			uint32_t bits;
+			memcpy(&bits, &db, 4);
+			blob[4*i    ] = bits >> 24;
+			blob[4*i + 1] = bits >> 16;
+			blob[4*i + 2] = bits >> 8;
+			blob[4*i + 3] = bits;
+		}
+		s.send(m_addressPrefix + "/meters", osc::Blob(blob.data(), blob.size()));
+		return;
+	}
+
+	/* Upper bound of the size of a message in a bundle: padded address pattern,
+	 * type tags, two arguments and the element size */
+	const int messageSize = m_addressPrefix.size() + 16 + 8 + 8 + 4;
+	s.beginBundle();
+	for (int i = 0; i < m_numChnls; i++) {
+		if (s.size() + messageSize > METER_PACKET_SIZE) {
+			s.endBundle();
+			s.send();
+			s.beginBundle();
+		}
+		float db = 20.0 * log10(levels[i]);
+		if (m_meterAddrHasChannel) {
+			std::stringstream addr;
+			addr << m_addressPrefix << "/meterdb/" << i + 1;
+			s.addMessage(addr.str(), db);
+		} else {
+			s.addMessage(m_addressPrefix + "/meterdb", i, db);
+		}
+	}
+	s.endBundle();
+	s.send();
 }
 
 void OutputMaster::OSCHandler::onMessage(osc::Message &m)
@@ -488,6 +691,47 @@ void OutputMaster::OSCHandler::onMessage(osc::Message &m)
 			std::cerr << "Alloaudio: Wrong type tags for " + outputmaster->m_addressPrefix + "/bass_management_freq: "
 					 << m.typeTags() << std::endl;
 		}
+	} else if (m.addressPattern() == outputmaster->m_addressPrefix + "/alignment_on") {
+		if (m.typeTags() == "i") {
+			int on;
+			m >> on;
+			outputmaster->m_parameterQueue.send(outputmaster->m_parameterQueue.now(),
+												outputmaster, &OutputMaster::setAlignmentOnTimestamped,
+												(bool) on != 0);
+		} else if (m.typeTags() == "f") {
+			float on;
+			m >> on;
+			outputmaster->m_parameterQueue.send(outputmaster->m_parameterQueue.now(),
+												outputmaster, &OutputMaster::setAlignmentOnTimestamped,
+												(bool) on != 0);
+		} else {
+			std::cerr << "Alloaudio: Wrong type tags for " + outputmaster->m_addressPrefix + "/alignment_on: "
+					 << m.typeTags() << std::endl;
+		}
+	} else if (m.addressPattern() == outputmaster->m_addressPrefix + "/alignment_delay") {
+		if (m.typeTags() == "if") {
+			int chan;
+			float seconds;
+			m >> chan >> seconds;
+			outputmaster->m_parameterQueue.send(outputmaster->m_parameterQueue.now(),
+												outputmaster, &OutputMaster::setAlignmentDelayTimestamped,
+												chan, (double) seconds);
+		} else {
+			std::cerr << "Alloaudio: Wrong type tags for " + outputmaster->m_addressPrefix + "/alignment_delay: "
+					 << m.typeTags() << std::endl;
+		}
+	} else if (m.addressPattern() == outputmaster->m_addressPrefix + "/alignment_gain") {
+		if (m.typeTags() == "if") {
+			int chan;
+			float gain;
+			m >> chan >> gain;
+			outputmaster->m_parameterQueue.send(outputmaster->m_parameterQueue.now(),
+												outputmaster, &OutputMaster::setAlignmentGainTimestamped,
+												chan, (double) gain);
+		} else {
+			std::cerr << "Alloaudio: Wrong type tags for " + outputmaster->m_addressPrefix + "/alignment_gain: "
+					 << m.typeTags() << std::endl;
+		}
 	} else {
 		std::cout << "Alloaudio: Unrecognized address pattern: " << m.addressPattern() << std::endl;
 	}
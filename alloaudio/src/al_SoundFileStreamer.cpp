@@ -0,0 +1,139 @@
+#include <algorithm>
+#include <chrono>
+
+#include "alloaudio/al_SoundFileStreamer.hpp"
+#include "alloaudio/al_SoundfileBuffered.hpp"
+
+using namespace al;
+
+SoundFileStreamer::SoundFileStreamer(int numThreads) :
+    mNumThreads(numThreads > 0 ? numThreads : 1),
+    mReadTime(0.005),
+    mRunning(false),
+    mThroughput(0.0),
+    mUnderruns(0)
+{
+}
+
+SoundFileStreamer::~SoundFileStreamer()
+{
+	{
+		std::unique_lock<std::mutex> lk(mLock);
+		mRunning = false;
+	}
+	mCondVar.notify_all();
+	for (unsigned i = 0; i < mThreads.size(); i++) {
+		mThreads[i]->join();
+		delete mThreads[i];
+	}
+	// Files still attached stop being refilled
+	for (unsigned i = 0; i < mFiles.size(); i++) {
+		mFiles[i]->mStreamer = nullptr;
+	}
+}
+
+SoundFileStreamer &SoundFileStreamer::shared()
+{
+	static SoundFileStreamer streamer;
+	return streamer;
+}
+
+void SoundFileStreamer::add(SoundFileBuffered &file)
+{
+	file.useStreamer(this);
+}
+
+void SoundFileStreamer::remove(SoundFileBuffered &file)
+{
+	if (file.streamer() == this) {
+		file.useStreamer(nullptr);
+	}
+}
+
+int SoundFileStreamer::numFiles()
+{
+	std::unique_lock<std::mutex> lk(mLock);
+	return mFiles.size();
+}
+
+void SoundFileStreamer::readTime(double seconds)
+{
+	mReadTime = seconds;
+}
+
+void SoundFileStreamer::attach(SoundFileBuffered *file)
+{
+	{
+		std::unique_lock<std::mutex> lk(mLock);
+		mFiles.push_back(file);
+		if (!mRunning) {
+			mRunning = true;
+			for (int i = 0; i < mNumThreads; i++) {
+				mThreads.push_back(new std::thread(ioFunction, this));
+			}
+		}
+	}
+	mCondVar.notify_one();
+}
+
+void SoundFileStreamer::detach(SoundFileBuffered *file)
+{
+	std::unique_lock<std::mutex> lk(mLock);
+	mFiles.erase(std::remove(mFiles.begin(), mFiles.end(), file), mFiles.end());
+	mIdle.wait(lk, [file]{ return !file->mStreamBusy; });
+}
+
+SoundFileBuffered *SoundFileStreamer::nextFile()
+{
+	// Emptiest ring buffer first, files with a pending seek before all others
+	SoundFileBuffered *next = nullptr;
+	float lowest = 2.0f;
+	for (unsigned i = 0; i < mFiles.size(); i++) {
+		SoundFileBuffered *file = mFiles[i];
+		if (file->mStreamBusy || !file->needsRefill()) {
+			continue;
+		}
+		float level = file->mSeek.load() >= 0 ? -1.0f : file->fillLevel();
+		if (level < lowest) {
+			lowest = level;
+			next = file;
+		}
+	}
+	if (next) {
+		next->mStreamBusy = true;
+	}
+	return next;
+}
+
+void SoundFileStreamer::ioFunction(SoundFileStreamer *obj)
+{
+	std::unique_lock<std::mutex> lk(obj->mLock);
+	while (obj->mRunning) {
+		SoundFileBuffered *file = obj->nextFile();
+		if (!file) {
+			// Woken by reads, with a timeout in case a wake up came while all threads were busy
+			obj->mCondVar.wait_for(lk, std::chrono::milliseconds(2));
+			continue;
+		}
+		const int bytesPerFrame = file->channels() * sizeof(float);
+		int maxFrames = file->mBufferFrames;
+		double throughput = obj->mThroughput.load();
+		if (throughput > 0.0) {
+			int minFrames = std::min(256, file->mBufferFrames);
+			maxFrames = std::max(minFrames, std::min(maxFrames, int(throughput * obj->mReadTime / bytesPerFrame)));
+		}
+		lk.unlock();
+
+		auto start = std::chrono::steady_clock::now();
+		int framesRead = file->refill(maxFrames);
+		double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		lk.lock();
+		file->mStreamBusy = false;
+		if (framesRead > 0 && elapsed > 0.0) {
+			double rate = framesRead * bytesPerFrame / elapsed;
+			obj->mThroughput = throughput > 0.0 ? 0.9 * obj->mThroughput.load() + 0.1 * rate : rate;
+		}
+		obj->mIdle.notify_all();
+	}
+}
@@ -1,46 +1,147 @@
+#include <cstdint>
+#include <cstring>
+
+#include "allocore/system/al_Config.h"
 #include "alloaudio/al_SoundfileBuffered.hpp"
+#include "alloaudio/al_SoundFileStreamer.hpp"
+
+#ifndef AL_WINDOWS
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 using namespace al;
 
-SoundFileBuffered::SoundFileBuffered(std::string fullPath, bool loop, int bufferFrames) :
-    mRunning(true),
+SoundFileBuffered::SoundFileBuffered(std::string fullPath, bool loop, int bufferFrames,
+                                     SoundFileStreamer *streamer) :
+    mRunning(false),
     mLoop(loop),
     mRepeats(0),
     mSeek(-1),
     mCurPos(0),
+    mReaderThread(nullptr),
     mBufferFrames(bufferFrames),
-    mReadCallback(0)
+    mReadCallback(0),
+    mStreamer(nullptr),
+    mStreamBusy(false),
+    mFinished(false),
+    mUnderruns(0),
+    mMapped(nullptr),
+    mMappedSize(0),
+    mMapData(nullptr),
+    mMapFrames(0),
+    mMapPos(0)
 {
 	mSf.path(fullPath);
 	mSf.openRead();
 	if (mSf.opened()) {
+		mapFile(fullPath);
 		mRingBuffer = new SingleRWRingBuffer(mBufferFrames * channels() * sizeof(float));
-		mReaderThread = new std::thread(readFunction, this);
 		mFileBuffer = new float[mBufferFrames * channels()];
+		refill(mBufferFrames); // So that the first read() has samples
+		if (streamer) {
+			mStreamer = streamer;
+			streamer->attach(this);
+		} else {
+			startThread();
+		}
 	}
 }
 
 SoundFileBuffered::~SoundFileBuffered()
 {
 	if (mSf.opened()) {
-		mRunning = false;
-		mCondVar.notify_one();
-		mReaderThread->join();
-		delete mReaderThread;
+		if (mStreamer.load()) {
+			mStreamer.load()->detach(this);
+		} else {
+			stopThread();
+		}
 		delete mRingBuffer;
 		delete[] mFileBuffer;
 	}
+	unmapFile();
 	mSf.close();
 }
 
 int SoundFileBuffered::read(float *buffer, int numFrames)
 {
 	int bytesRead = mRingBuffer->read((char *) buffer, numFrames * channels() * sizeof(float));
-	if (bytesRead != numFrames * channels() * sizeof(float)) {
-		// TODO: handle underrun
+	int framesRead = bytesRead / (channels() * sizeof(float));
+	readDone(framesRead, numFrames);
+	return framesRead;
+}
+
+/* Copies interleaved samples into channels spaced by stride, starting at
+ * channel chan of frame */
+static void deinterleave(float *buffer, int stride, int numChannels, const float *src,
+                         int numSamples, int &frame, int &chan, float gain)
+{
+	// Samples of a frame split across the end of the ring buffer
+	while (chan != 0 && numSamples > 0) {
+		buffer[chan * stride + frame] = *src++ * gain;
+		numSamples--;
+		if (++chan == numChannels) {
+			chan = 0;
+			frame++;
+		}
+	}
+	const int numFrames = numSamples / numChannels;
+	for (int c = 0; c < numChannels; c++) {
+		float *out = buffer + c * stride + frame;
+		const float *in = src + c;
+		for (int i = 0; i < numFrames; i++) {
+			out[i] = in[i * numChannels] * gain;
+		}
+	}
+	frame += numFrames;
+	src += numFrames * numChannels;
+	numSamples -= numFrames * numChannels;
+	for (; numSamples > 0; numSamples--) {
+		buffer[chan++ * stride + frame] = *src++ * gain;
+	}
+}
+
+int SoundFileBuffered::readPlanar(float *buffer, int numFrames, int stride, float gain)
+{
+	const int numChannels = channels();
+	const char *first, *second;
+	size_t firstSize, secondSize;
+	size_t bytes = mRingBuffer->readRegions(&first, &firstSize, &second, &secondSize,
+	                                        numFrames * numChannels * sizeof(float));
+	int framesRead = bytes / (numChannels * sizeof(float));
+	// Only whole frames, the rest stays in the ring buffer
+	bytes = framesRead * numChannels * sizeof(float);
+	if (firstSize > bytes) {
+		firstSize = bytes;
+	}
+	secondSize = bytes - firstSize;
+
+	int frame = 0, chan = 0;
+	deinterleave(buffer, stride, numChannels, (const float *) first, firstSize / sizeof(float),
+	             frame, chan, gain);
+	deinterleave(buffer, stride, numChannels, (const float *) second, secondSize / sizeof(float),
+	             frame, chan, gain);
+	mRingBuffer->readAdvance(bytes);
+	readDone(framesRead, numFrames);
+	return framesRead;
+}
+
+void SoundFileBuffered::readDone(int framesRead, int numFrames)
+{
+	SoundFileStreamer *streamer = mStreamer.load();
+	if (framesRead != numFrames && !mFinished.load()) {
+		std::atomic_fetch_add(&mUnderruns, 1);
+		if (streamer) {
+			std::atomic_fetch_add(&(streamer->mUnderruns), 1);
+		}
+	}
+	if (streamer) {
+		streamer->wake();
+	} else {
+		mCondVar.notify_one();
 	}
-	mCondVar.notify_one();
-	return bytesRead / (channels() * sizeof(float));
 }
 
 bool SoundFileBuffered::opened() const
@@ -48,35 +149,269 @@ bool SoundFileBuffered::opened() const
 	return mSf.opened();
 }
 
+void SoundFileBuffered::useStreamer(SoundFileStreamer *streamer)
+{
+	if (!opened() || streamer == mStreamer.load()) {
+		return;
+	}
+	if (mStreamer.load()) {
+		mStreamer.load()->detach(this);
+	} else {
+		stopThread();
+	}
+	mStreamer = streamer;
+	if (streamer) {
+		streamer->attach(this);
+	} else {
+		startThread();
+	}
+}
+
+void SoundFileBuffered::startThread()
+{
+	mRunning = true;
+	mReaderThread = new std::thread(readFunction, this);
+}
+
+void SoundFileBuffered::stopThread()
+{
+	if (mReaderThread) {
+		{
+			std::unique_lock<std::mutex> lk(mLock);
+			mRunning = false;
+		}
+		mCondVar.notify_one();
+		mReaderThread->join();
+		delete mReaderThread;
+		mReaderThread = nullptr;
+	}
+}
+
+float SoundFileBuffered::fillLevel() const
+{
+	return mRingBuffer->readSpace() / float(mBufferFrames * channels() * sizeof(float));
+}
+
+bool SoundFileBuffered::needsRefill() const
+{
+	if (mSeek.load() >= 0) {
+		return true;
+	}
+	// Wait for a quarter of the buffer to be free, to avoid many small reads
+	int framesFree = mRingBuffer->writeSpace() / (channels() * sizeof(float));
+	return !mFinished.load() && framesFree >= (mBufferFrames + 3) / 4;
+}
+
+int SoundFileBuffered::refill(int maxFrames)
+{
+	int seek = mSeek.exchange(-1);
+	if (seek >= 0) { // Process seek request
+		seekFrames(seek);
+		mFinished = false;
+	}
+	int framesToRead = mRingBuffer->writeSpace() / (channels() * sizeof(float));
+	// The ring buffer size is rounded up to a power of two, so it can hold more than mFileBuffer
+	if (framesToRead > mBufferFrames) {
+		framesToRead = mBufferFrames;
+	}
+	if (framesToRead > maxFrames) {
+		framesToRead = maxFrames;
+	}
+	if (framesToRead <= 0 || mFinished.load()) {
+		return 0;
+	}
+	int framesRead = readFrames(mFileBuffer, framesToRead);
+	if (framesRead != framesToRead) { // Final incomplete buffer in the file
+		if (mLoop) {
+			seekFrames(0);
+			std::atomic_fetch_add(&mRepeats, 1);
+			framesRead += readFrames(mFileBuffer + framesRead * channels(), framesToRead - framesRead);
+		} else {
+			mFinished = true; // Before writing, so read() can't count the end as an underrun
+		}
+	}
+	std::atomic_fetch_add(&mCurPos, framesRead);
+	mRingBuffer->write((const char*) mFileBuffer, framesRead * sizeof(float) * channels());
+	if (mReadCallback) {
+		mReadCallback(mFileBuffer, channels(), framesRead, mCallbackData);
+	}
+	return framesRead;
+}
+
 void SoundFileBuffered::readFunction(SoundFileBuffered  *obj)
 {
+	std::unique_lock<std::mutex> lk(obj->mLock);
 	while (obj->mRunning) {
-		std::unique_lock<std::mutex> lk(obj->mLock);
 		obj->mCondVar.wait(lk);
-		int framesToRead = obj->mRingBuffer->writeSpace() / (obj->channels() * sizeof(float));
-	int framesRead = obj->mSf.read(obj->mFileBuffer, framesToRead);
-	std::atomic_fetch_add(&(obj->mCurPos), framesRead);
-	int seek = obj->mSeek.load();
-	if (seek >= 0) { // Process seek request
-	    obj->mSf.seek(seek, SEEK_SET);
-	    obj->mSeek.store(-1);
+		if (obj->mRunning) {
+			obj->refill(obj->mBufferFrames);
+		}
 	}
-	if (framesRead != framesToRead) { // Final incomplete buffer in the file
-	    framesRead += obj->mSf.read(obj->mFileBuffer + framesRead, framesToRead - framesRead);
-	    if (obj->mLoop) {
-		obj->mSf.seek(0, SEEK_SET);
-		std::atomic_fetch_add(&(obj->mRepeats), 1);
-	    }
+}
+
+static inline uint32_t bytesToInt(const unsigned char *p, int bytes, bool bigEndian)
+{
+	uint32_t v = 0;
+	if (bigEndian) {
+		for (int i = 0; i < bytes; i++) v = (v << 8) | p[i];
+	} else {
+		for (int i = bytes - 1; i >= 0; i--) v = (v << 8) | p[i];
 	}
-	int written = obj->mRingBuffer->write((const char*) obj->mFileBuffer, framesRead * sizeof(float) * obj->channels());
-	//		if (written != framesRead * sizeof(float) * obj->channels()) {
-	//			// TODO handle overrun
-	//		}
-	if (obj->mReadCallback) {
-	    obj->mReadCallback(obj->mFileBuffer, obj->mSf.channels(), framesRead, obj->mCallbackData);
+	return v << (32 - 8 * bytes); // Align to the most significant byte
+}
+
+int SoundFileBuffered::readFrames(float *buffer, int numFrames)
+{
+	if (!mMapData) {
+		return mSf.read(buffer, numFrames);
 	}
-	lk.unlock();
+	if (numFrames > mMapFrames - mMapPos) {
+		numFrames = mMapFrames - mMapPos;
+	}
+	const int numSamples = numFrames * channels();
+	const unsigned char *src = mMapData + (size_t) mMapPos * channels() * mMapSampleBytes;
+	const uint16_t one = 1;
+	const bool hostBigEndian = *(const unsigned char *) &one == 0;
+	if (mMapFloat && mMapBigEndian == hostBigEndian) {
+		memcpy(buffer, src, numSamples * sizeof(float));
+	} else if (mMapFloat) {
+		for (int i = 0; i < numSamples; i++) {
+			uint32_t v = bytesToInt(src + i * 4, 4, mMapBigEndian);
+			memcpy(buffer + i, &v, sizeof(float));
+		}
+	} else {
+		// Same scaling as libsndfile: full scale of a 32 bit integer
+		const float scale = 1.0f / 2147483648.0f;
+		for (int i = 0; i < numSamples; i++) {
+			buffer[i] = int32_t(bytesToInt(src + i * mMapSampleBytes, mMapSampleBytes, mMapBigEndian)) * scale;
+		}
+	}
+	mMapPos += numFrames;
+	return numFrames;
+}
+
+void SoundFileBuffered::seekFrames(int frame)
+{
+	if (mMapData) {
+		mMapPos = frame < mMapFrames ? frame : mMapFrames;
+	} else {
+		mSf.seek(frame, SEEK_SET);
+	}
+}
+
+static inline uint32_t le16(const unsigned char *p) { return p[0] | (p[1] << 8); }
+static inline uint32_t le32(const unsigned char *p) { return le16(p) | (le16(p + 2) << 16); }
+static inline uint32_t be32(const unsigned char *p) { return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3]; }
+static inline uint64_t be64(const unsigned char *p) { return (uint64_t(be32(p)) << 32) | be32(p + 4); }
+
+bool SoundFileBuffered::mapFile(const std::string &path)
+{
+#ifndef AL_WINDOWS
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	struct stat st;
+	void *mapped = MAP_FAILED;
+	size_t size = 0;
+	if (fstat(fd, &st) == 0 && st.st_size >= 12) {
+		size = st.st_size;
+		mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	}
+	close(fd);
+	if (mapped == MAP_FAILED) {
+		return false;
+	}
+	const unsigned char *data = (const unsigned char *) mapped;
+	size_t dataOffset = 0, dataSize = 0;
+	int numChannels = 0, bits = 0;
+	bool isFloat = false, bigEndian = false, supported = false;
+
+	if (!memcmp(data, "RIFF", 4) && !memcmp(data + 8, "WAVE", 4)) {
+		size_t pos = 12;
+		int formatTag = 0;
+		while (pos + 8 <= size) {
+			const unsigned char *chunk = data + pos;
+			size_t chunkSize = le32(chunk + 4);
+			size_t body = pos + 8;
+			if (!memcmp(chunk, "fmt ", 4) && chunkSize >= 16 && body + 16 <= size) {
+				formatTag = le16(data + body);
+				numChannels = le16(data + body + 2);
+				bits = le16(data + body + 14);
+				if (formatTag == 0xFFFE && chunkSize >= 26 && body + 26 <= size) { // WAVE_FORMAT_EXTENSIBLE
+					formatTag = le16(data + body + 24);
+				}
+			} else if (!memcmp(chunk, "data", 4)) {
+				dataOffset = body;
+				dataSize = chunkSize < size - body ? chunkSize : size - body;
+				break;
+			}
+			pos = body + chunkSize + (chunkSize & 1);
+		}
+		isFloat = formatTag == 3;
+		supported = dataOffset > 0 && ((formatTag == 1 && (bits == 16 || bits == 24 || bits == 32))
+		                               || (isFloat && bits == 32));
+	} else if (!memcmp(data, "caff", 4)) {
+		size_t pos = 8;
+		bool linearPCM = false;
+		while (pos + 12 <= size) {
+			const unsigned char *chunk = data + pos;
+			uint64_t chunkSize = be64(chunk + 4);
+			size_t body = pos + 12;
+			if (!memcmp(chunk, "desc", 4) && body + 32 <= size) {
+				uint32_t flags = be32(data + body + 12);
+				uint32_t bytesPerPacket = be32(data + body + 16);
+				uint32_t framesPerPacket = be32(data + body + 20);
+				numChannels = be32(data + body + 24);
+				bits = be32(data + body + 28);
+				isFloat = flags & 1;
+				bigEndian = !(flags & 2);
+				linearPCM = !memcmp(data + body + 8, "lpcm", 4) && framesPerPacket == 1
+				        && bytesPerPacket == numChannels * bits / 8u;
+			} else if (!memcmp(chunk, "data", 4) && body + 4 <= size) {
+				dataOffset = body + 4; // After the edit count
+				// A size of -1 means the data runs to the end of the file
+				dataSize = (chunkSize == ~uint64_t(0) || chunkSize - 4 > size - dataOffset) ?
+				            size - dataOffset : chunkSize - 4;
+				break;
+			}
+			if (chunkSize > size - body) {
+				break;
+			}
+			pos = body + chunkSize;
+		}
+		supported = dataOffset > 0 && linearPCM
+		        && ((!isFloat && (bits == 16 || bits == 24 || bits == 32)) || (isFloat && bits == 32));
+	}
+
+	// Only map files whose layout agrees with what libsndfile found
+	if (supported && numChannels == channels()
+	        && (int) (dataSize / (numChannels * bits / 8)) == frames()) {
+		madvise(mapped, size, MADV_SEQUENTIAL);
+		mMapped = mapped;
+		mMappedSize = size;
+		mMapData = data + dataOffset;
+		mMapFrames = frames();
+		mMapPos = 0;
+		mMapSampleBytes = bits / 8;
+		mMapFloat = isFloat;
+		mMapBigEndian = bigEndian;
+		return true;
+	}
+	munmap(mapped, size);
+#endif
+	return false;
+}
+
+void SoundFileBuffered::unmapFile()
+{
+#ifndef AL_WINDOWS
+	if (mMapped) {
+		munmap(mMapped, mMappedSize);
 	}
+#endif
+	mMapped = nullptr;
+	mMapData = nullptr;
 }
 
 gam::SoundFile::EncodingType SoundFileBuffered::encoding() const
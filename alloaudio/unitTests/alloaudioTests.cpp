@@ -3,13 +3,30 @@
 #include <string>
 #include <sstream>
 #include <cassert>
+#include <cmath>
 //#include <iostream>
 
 #include "alloaudio/al_OutputMaster.hpp"
+#include "alloaudio/al_SoundfileBuffered.hpp"
+#include "alloaudio/al_SoundFileStreamer.hpp"
 #include "allocore/system/al_Time.hpp"
 
 
 
+/* Writes a block of two channels into the output buffers ahead of the
+ * OutputMaster, as AudioIO::processAudio() zeroes them before the callbacks */
+struct BlockWriter : public al::AudioCallback
+{
+	float block[2][4];
+	void onAudioCB(al::AudioIOData &io) {
+		for (int chan = 0; chan < 2; chan++) {
+			for (int i = 0; i < 4; i++) {
+				io.outBuffer(chan)[i] = block[chan][i];
+			}
+		}
+	}
+};
+
 void ut_class_test(void)
 {
     al::OutputMaster outmaster(8, 44100);
@@ -64,6 +81,8 @@ void ut_meter_values(void)
 	assert(io.channelsOut() == 2);
 	assert(io.framesPerSecond() == 44100.0);
 	al::OutputMaster outmaster(io.channelsOut(), io.framesPerSecond());
+	BlockWriter input;
+	io.append(input);
 	io.append(outmaster);
 
 	outmaster.setMasterGain(1.0);
@@ -73,19 +92,112 @@ void ut_meter_values(void)
 	outmaster.setClipperOn(false);
 	outmaster.setMeterUpdateFreq(11025); // 4 samples
 
-    float *in_0 = io.outBuffer(0);
-    float *in_1 = io.outBuffer(1);
     for (int i = 0; i < 4; i++) {
-        in_0[i] = 1.0/(i + 2);
-        in_1[i] = i/4.0;
+        input.block[0][i] = 1.0/(i + 2);
+        input.block[1][i] = i/4.0;
     }
 	io.processAudio();
 
-    float meterValues[2];
-    outmaster.getMeterValues(meterValues);
+    float meterValues[2], rmsValues[2];
+    assert(outmaster.getMeterValues(meterValues, rmsValues) == 2);
 
 	assert(meterValues[0] == 0.5);
 	assert(meterValues[1] == 0.75);
+	assert(fabs(rmsValues[0] - sqrt((1/4.0 + 1/9.0 + 1/16.0 + 1/25.0)/4)) < 1e-6);
+	assert(fabs(rmsValues[1] - sqrt((1/16.0 + 4/16.0 + 9/16.0)/4)) < 1e-6);
+
+	// No new snapshot until the next update
+	assert(outmaster.getMeterValues(meterValues) == 0);
+}
+
+void ut_alignment(void)
+{
+	al::AudioIO io(4, 44100.0, NULL, NULL, 2, 2);
+	al::OutputMaster outmaster(io.channelsOut(), io.framesPerSecond());
+	BlockWriter input;
+	io.append(input);
+	io.append(outmaster);
+	outmaster.setMasterGain(1.0);
+	outmaster.setClipperOn(false);
+	outmaster.setAlignmentDelay(0, 2.5/44100.0);
+	outmaster.setAlignmentGain(0, 0.5);
+	outmaster.setAlignmentDelay(1, 5/44100.0);
+
+	// An impulse on both channels, followed by silence
+	float out_0[12], out_1[12];
+	for (int b = 0; b < 3; b++) {
+		for (int i = 0; i < 4; i++) {
+			input.block[0][i] = input.block[1][i] = (b == 0 && i == 0) ? 1 : 0;
+		}
+		io.processAudio();
+		for (int i = 0; i < 4; i++) {
+			out_0[4*b + i] = io.outBuffer(0)[i];
+			out_1[4*b + i] = io.outBuffer(1)[i];
+		}
+	}
+	for (int i = 0; i < 12; i++) {
+		float expected_0 = (i == 2 || i == 3) ? 0.25 : 0;
+		float expected_1 = (i == 5) ? 1 : 0;
+		assert(fabs(out_0[i] - expected_0) < 1e-7);
+		assert(fabs(out_1[i] - expected_1) < 1e-7);
+	}
+
+	// The farther speaker is not delayed, the nearer one is delayed by the
+	// difference in path and attenuated
+	al::SpeakerLayout layout;
+	layout.addSpeaker(al::Speaker(0, 0, 0, 3.43));
+	layout.addSpeaker(al::Speaker(1, 90, 0, 1.715));
+	outmaster.setSpeakerAlignment(layout, 343.0);
+	for (int b = 0; b < 60; b++) { // flush the first impulse out of the delay
+		io.processAudio();
+	}
+	input.block[0][0] = input.block[1][0] = 1;
+	io.processAudio();
+	assert(io.outBuffer(0)[0] == 1);
+	input.block[0][0] = input.block[1][0] = 0;
+	int blocks = 0;
+	while (io.outBuffer(1)[0] == 0 && blocks < 100) {
+		io.processAudio();
+		blocks++;
+	}
+	// 5 ms is 220.5 samples, so the impulse is split between two samples
+	assert(blocks == 55);
+	assert(fabs(io.outBuffer(1)[0] - 0.25) < 1e-4);
+	assert(fabs(io.outBuffer(1)[1] - 0.25) < 1e-4);
+}
+
+void ut_max_block_size(void)
+{
+	// Blocks larger than the maximum block size are processed in pieces
+	al::AudioIO io(4, 44100.0, NULL, NULL, 2, 2), io2(4, 44100.0, NULL, NULL, 2, 2);
+	al::OutputMaster outmaster(io.channelsOut(), io.framesPerSecond());
+	al::OutputMaster outmaster2(io2.channelsOut(), io2.framesPerSecond());
+	outmaster2.setMaxBlockSize(3);
+	BlockWriter input;
+	io.append(input);
+	io.append(outmaster);
+	io2.append(input);
+	io2.append(outmaster2);
+	al::OutputMaster *masters[2] = {&outmaster, &outmaster2};
+	for (int m = 0; m < 2; m++) {
+		masters[m]->setClipperOn(false);
+		masters[m]->setBassManagementMode(al::BASSMODE_FULL);
+		masters[m]->setMaxAlignmentDelay(6/44100.0);
+		masters[m]->setAlignmentDelay(0, 2.5/44100.0);
+		masters[m]->setAlignmentDelay(1, 6/44100.0);
+	}
+	for (int b = 0; b < 8; b++) {
+		for (int i = 0; i < 4; i++) {
+			input.block[0][i] = input.block[1][i] = (b == 0 && i == 0) ? 1 : 0.1 * i;
+		}
+		io.processAudio();
+		io2.processAudio();
+		for (int chan = 0; chan < 2; chan++) {
+			for (int i = 0; i < 4; i++) {
+				assert(fabs(io.outBuffer(chan)[i] - io2.outBuffer(chan)[i]) < 1e-6);
+			}
+		}
+	}
 }
 
 void ut_clipper(void)
@@ -225,6 +337,8 @@ void ut_osc_meters()
 	assert(io.channelsOut() == 2);
 	assert(io.framesPerSecond() == 44100.0f);
 	al::OutputMaster outmaster(io.channelsOut(), io.framesPerSecond(), "localhost", 9001, "localhost", 9002);
+	BlockWriter input;
+	io.append(input);
 	io.append(outmaster);
 	outmaster.setClipperOn(false);
 
@@ -235,41 +349,157 @@ void ut_osc_meters()
 	s.send("/Alloaudio/gain", 0, 1.0f);
 	s.send("/Alloaudio/gain", 1, 1.0f);
 
-	float *in_0 = io.outBuffer(0);
-	float *in_1 = io.outBuffer(1);
 	for (int i = 0; i < 4; i++) {
-		in_0[i] = 1.0/(i + 2);
-		in_1[i] = i/4.0;
+		input.block[0][i] = 1.0/(i + 2);
+		input.block[1][i] = i/4.0;
 	}
 
 	al::osc::Recv r(9002);
 	r.handler(handler);
 	r.timeout(0.1);
 	r.start();
+	al_sleep(0.05); // Wait for messages to arrive
 
 	io.processAudio();
-	al_sleep_nsec(1000000); // Wait for messages to arrive
+	al_sleep(0.05); // Wait for the meter thread to send levels
 	r.stop();
 	assert(meterValues[0] == 0.0);
 	assert(meterValues[1] == 0.0);
-	assert(meterValues2[0] == 0.5);
-	assert(meterValues2[1] == 0.75);
+	assert(fabs(meterValues2[0] - 0.5) < 1e-6); // dB round trip
+	assert(fabs(meterValues2[1] - 0.75) < 1e-6); // dB round trip
 
 	for (int i = 0; i < 4; i++) {
-		in_0[i] = i/4.0;
-		in_1[i] = 1.0/(i + 2);
+		input.block[0][i] = i/4.0;
+		input.block[1][i] = 1.0/(i + 2);
 	}
 	outmaster.setMeterAddrHasChannel(true);
 	r.start();
 	io.processAudio();
-	al_sleep_nsec(1000000); // Wait for messages to arrive
+	al_sleep(0.05); // Wait for the meter thread to send levels
 	r.stop();
-	assert(meterValues[0] == 0.75);
-	assert(meterValues[1] == 0.5);
+	assert(fabs(meterValues[0] - 0.75) < 1e-6); // dB round trip
+	assert(fabs(meterValues[1] - 0.5) < 1e-6); // dB round trip
 	assert(meterValues2[0] == 0.0);
 	assert(meterValues2[1] == 0.0);
 }
 
+/* Reads a whole file in blocks, waiting for the ring buffer when it runs dry */
+static bool readAndCheck(al::SoundFileBuffered &file, int start, int numFrames)
+{
+	float block[64 * 2];
+	int frame = start;
+	while (frame < start + numFrames) {
+		int framesRead = file.read(block, 64);
+		if (framesRead == 0) {
+			al_sleep(0.001);
+			continue;
+		}
+		for (int i = 0; i < framesRead; i++, frame++) {
+			float expected = ((frame % 1000) - 500) / 1024.0f;
+			if (block[i*2] != expected || block[i*2 + 1] != -expected) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+void ut_soundfile_streamer(void)
+{
+	const int numFrames = 20000;
+	const char *paths[] = {"/tmp/al_streamer_test_16.wav", "/tmp/al_streamer_test_float.wav"};
+	gam::SoundFile::EncodingType encodings[] = {gam::SoundFile::PCM_16, gam::SoundFile::FLOAT};
+	for (int f = 0; f < 2; f++) {
+		gam::SoundFile sf(paths[f]);
+		sf.format(gam::SoundFile::WAV);
+		sf.encoding(encodings[f]);
+		sf.channels(2);
+		sf.frameRate(44100);
+		assert(sf.openWrite());
+		std::vector<float> samples(numFrames * 2);
+		for (int i = 0; i < numFrames; i++) {
+			samples[i*2] = ((i % 1000) - 500) / 1024.0f; // Exact in 16 bits
+			samples[i*2 + 1] = -samples[i*2];
+		}
+		sf.write(samples.data(), numFrames);
+		sf.close();
+	}
+
+	al::SoundFileStreamer streamer(2);
+	std::vector<al::SoundFileBuffered *> files;
+	for (int i = 0; i < 16; i++) {
+		files.push_back(new al::SoundFileBuffered(paths[i % 2], false, 512, &streamer));
+		assert(files.back()->opened());
+		assert(files.back()->mapped());
+		assert(files.back()->streamer() == &streamer);
+	}
+	assert(streamer.numFiles() == 16);
+	for (int i = 0; i < 16; i++) {
+		assert(readAndCheck(*files[i], 0, numFrames));
+	}
+	assert(streamer.throughput() > 0.0);
+
+	// Seeking once the whole file has been read, and moving files between
+	// the streamer and their own threads
+	int underruns = 0;
+	for (int i = 0; i < 16; i++) {
+		if (i % 2) {
+			streamer.remove(*files[i]);
+			assert(files[i]->streamer() == nullptr);
+		}
+		files[i]->seek(5000);
+		assert(readAndCheck(*files[i], 5000, 1000));
+		underruns += files[i]->underruns();
+	}
+	assert(streamer.numFiles() == 8);
+	assert(streamer.underruns() <= underruns);
+
+	for (int i = 0; i < 16; i++) {
+		delete files[i];
+	}
+	assert(streamer.numFiles() == 0);
+	remove(paths[0]);
+	remove(paths[1]);
+}
+
+void ut_read_planar(void)
+{
+	// Three channels, so frames are split where the ring buffer wraps
+	const int numFrames = 5000;
+	const char *path = "/tmp/al_read_planar_test.wav";
+	gam::SoundFile sf(path);
+	sf.format(gam::SoundFile::WAV);
+	sf.encoding(gam::SoundFile::PCM_16);
+	sf.channels(3);
+	sf.frameRate(44100);
+	assert(sf.openWrite());
+	std::vector<float> samples(numFrames * 3);
+	for (int i = 0; i < numFrames * 3; i++) {
+		samples[i] = ((i % 999) - 500) / 1024.0f;
+	}
+	sf.write(samples.data(), numFrames);
+	sf.close();
+
+	al::SoundFileBuffered file(path, false, 100);
+	assert(file.opened());
+	const int stride = 40;
+	float planar[3 * stride];
+	int frame = 0;
+	while (frame < numFrames) {
+		int framesRead = file.readPlanar(planar, 37, stride, 0.5f);
+		if (framesRead == 0) {
+			al_sleep(0.001);
+			continue;
+		}
+		for (int i = 0; i < framesRead; i++, frame++) {
+			for (int chan = 0; chan < 3; chan++) {
+				assert(planar[chan * stride + i] == 0.5f * samples[frame * 3 + chan]);
+			}
+		}
+	}
+	remove(path);
+}
+
 
 #define RUNTEST(Name)\
 	printf("%s ", #Name);\
@@ -282,9 +512,13 @@ int main()
 	RUNTEST(class_test);
 	RUNTEST(gains);
 	RUNTEST(meter_values);
+	RUNTEST(alignment);
+	RUNTEST(max_block_size);
 	RUNTEST(clipper);
 	RUNTEST(osc_gain);
 	RUNTEST(osc_meters);
+	RUNTEST(soundfile_streamer);
+	RUNTEST(read_planar);
 
 	return 0;
 }
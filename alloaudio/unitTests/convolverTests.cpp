@@ -9,6 +9,7 @@
 
 #include "alloaudio/al_Convolver.hpp"
 #include "allocore/io/al_AudioIO.hpp"
+#include "allocore/system/al_Time.hpp"
 
 #define IR_SIZE 1024
 #define BLOCK_SIZE 64 //min 64, max 8192
@@ -150,6 +151,7 @@ void ut_disabled_channels(void)
     int IRlength = IR_SIZE;
 
 	vector<int> disabledOuts;
+    io.channelsBus(2);
 
     int nOutputs = io.channels(true);
 	unsigned int basePartitionSize = BLOCK_SIZE, options = 0;
@@ -209,6 +211,50 @@ void ut_vector_mode(void)
     conv.shutdown();
 }
 
+void ut_hot_swap(void)
+{
+	al::Convolver conv;
+	al::AudioIO io(BLOCK_SIZE, 44100.0, NULL, NULL, 2, 2);
+	io.append(conv);
+    io.channelsBus(2);
+
+    //unit and half gain IRs, the second a tail with a length that is not a power of two
+    vector<float> IR1(IR_SIZE, 0.0f), IR2(1000, 0.5f / 1000);
+    IR1[0] = 1.0f;
+    vector<float *> IRs(2, IR1.data());
+	conv.setCrossfade(4 * BLOCK_SIZE);
+    conv.configure(io, IRs, IR_SIZE, -1, true, vector<int>(), BLOCK_SIZE, 0, 256);
+
+    //constant input
+    for (int i = 0; i < BLOCK_SIZE; i++) {
+        io.busBuffer(0)[i] = io.busBuffer(1)[i] = 1.0f;
+    }
+	io.processAudio();
+	assert(fabs(io.out(0, BLOCK_SIZE - 1) - 1.0f) < 1e-06f);
+
+    IRs.assign(2, IR2.data());
+	assert(conv.loadIRs(IRs, 1000) == 0);
+	assert(conv.swapPending());
+	vector<float> out;
+	for (int b = 0; b < 1000 && conv.swapPending(); b++) {
+		io.processAudio();
+		out.insert(out.end(), &io.out(0, 0), &io.out(0, 0) + BLOCK_SIZE);
+		al_sleep(0.001); // let the loader thread work
+	}
+	assert(!conv.swapPending());
+
+	//the new IRs have heard the input before the swap, so the output ramps
+	//from the old to the new IRs without jumps or a gap in the tail
+	assert(out.size() * BLOCK_SIZE >= 1000 + 4 * BLOCK_SIZE);
+	assert(fabs(out.front() - 1.0f) < 1e-06f);
+	assert(fabs(out.back() - 0.5f) < 1e-05f);
+	for (unsigned i = 1; i < out.size(); i++) {
+		assert(out[i] <= out[i - 1] + 1e-05f);
+		assert(out[i - 1] - out[i] < 1.01f * 0.5f / (4 * BLOCK_SIZE));
+	}
+    conv.shutdown();
+}
+
 #define RUNTEST(Name)\
 	printf("%s ", #Name);\
 	ut_##Name();\
@@ -222,5 +268,6 @@ int main()
 	RUNTEST(one_to_many);
 	RUNTEST(disabled_channels);
 	RUNTEST(vector_mode);
+	RUNTEST(hot_swap);
 	return 0;
 }
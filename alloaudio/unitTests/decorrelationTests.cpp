@@ -8,6 +8,7 @@
 #include <cmath>
 
 #include "alloaudio/al_Decorrelation.hpp"
+#include "allocore/io/al_File.hpp"
 #include "allocore/system/al_Time.hpp"
 
 #include "Gamma/FFT.h"
@@ -210,6 +211,49 @@ void ut_deterministic_test(void)
 	float *ir = dec.getIR(0);
 }
 
+void ut_cache_test(void)
+{
+	const char *cacheDir = "/tmp/al_decorrelation_cache_test";
+	al::AudioIO io(64, 44100, 0, 0, 2, 2);
+
+	// Generated on one thread and on several, then mapped from the cache
+	al::Decorrelation dec(1024, 1, 32, false);
+	dec.setNumThreads(1);
+	dec.configure(io, 1001, 0.5);
+	assert(!dec.loadedFromCache());
+
+	al::Decorrelation dec2(1024, 1, 32, false);
+	dec2.setCacheDirectory(cacheDir);
+	dec2.setNumThreads(4);
+	dec2.configure(io, 1001, 0.5);
+	assert(!dec2.loadedFromCache());
+
+	al::Decorrelation dec3(1024, 1, 32, false);
+	dec3.setCacheDirectory(cacheDir);
+	dec3.configure(io, 1001, 0.5);
+	assert(dec3.loadedFromCache());
+
+	for (int i = 0; i < 32; i++) {
+		assert(memcmp(dec.getIR(i), dec2.getIR(i), 1024 * sizeof(float)) == 0);
+		assert(memcmp(dec.getIR(i), dec3.getIR(i), 1024 * sizeof(float)) == 0);
+	}
+
+	// Other parameters must not match the cached IRs
+	dec3.configure(io, 1001, 0.25);
+	assert(!dec3.loadedFromCache());
+	dec3.configure(io, 1002, 0.5);
+	assert(!dec3.loadedFromCache());
+
+	al::Decorrelation dec4(1024, 1, 32, false);
+	dec4.setCacheDirectory(cacheDir);
+	dec4.configureDeterministic(io, 1000, 30, 10, 1.0);
+	assert(!dec4.loadedFromCache());
+	dec4.configureDeterministic(io, 1000, 30, 10, 1.0);
+	assert(dec4.loadedFromCache());
+
+	al::Dir::removeRecursively(cacheDir);
+}
+
 #define RUNTEST(Name)\
 	printf("%s ", #Name);\
 	ut_##Name();\
@@ -223,6 +267,7 @@ int main()
 	RUNTEST(parallel_test);
 	RUNTEST(max_jump_test);
 	RUNTEST(deterministic_test);
+	RUNTEST(cache_test);
 
 	return 0;
 }
@@ -55,6 +55,8 @@
 #include "allocore/graphics/al_Texture.hpp"
 #include "allocore/io/al_App.hpp"
 #include "allocore/io/al_AudioIO.hpp"
+#include "allocore/io/al_AudioFileBackend.hpp"
+#include "allocore/io/al_AudioProfiler.hpp"
 #include "allocore/io/al_ControlNav.hpp"
 #include "allocore/io/al_File.hpp"
 #include "allocore/io/al_Socket.hpp"
@@ -78,7 +80,9 @@
 #include "allocore/sound/al_Speaker.hpp"
 #include "allocore/sound/al_AudioScene.hpp"
 #include "allocore/sound/al_Ambisonics.hpp"
+#include "allocore/sound/al_Binaural.hpp"
 #include "allocore/sound/al_Dbap.hpp"
+#include "allocore/sound/al_FDNReverb.hpp"
 #include "allocore/sound/al_StereoPanner.hpp"
 #include "allocore/sound/al_Vbap.hpp"
 #include "allocore/spatial/al_Curve.hpp"
@@ -93,3 +97,4 @@
 #include "allocore/types/al_Conversion.hpp"
 #include "allocore/types/al_Array.hpp"
 #include "allocore/types/al_SingleRWRingBuffer.hpp"
+#include "allocore/types/al_TripleBuffer.hpp"
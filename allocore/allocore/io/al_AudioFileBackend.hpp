@@ -0,0 +1,167 @@
+#ifndef INCLUDE_AL_AUDIO_FILE_BACKEND_HPP
+#define INCLUDE_AL_AUDIO_FILE_BACKEND_HPP
+
+/*	Allocore --
+	Multimedia / virtual environment application class library
+
+	Copyright (C) 2009. AlloSphere Research Group, Media Arts & Technology, UCSB.
+	Copyright (C) 2012. The Regents of the University of California.
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+		Redistributions of source code must retain the above copyright notice,
+		this list of conditions and the following disclaimer.
+
+		Redistributions in binary form must reproduce the above copyright
+		notice, this list of conditions and the following disclaimer in the
+		documentation and/or other materials provided with the distribution.
+
+		Neither the name of the University of California nor the names of its
+		contributors may be used to endorse or promote products derived from
+		this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+
+
+	File description:
+	Audio backend running AudioIO offline and writing its output to a sound file
+
+	File author(s):
+	AlloSystem contributors
+*/
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "allocore/io/al_AudioIO.hpp"
+
+namespace al{
+
+/// Audio backend rendering offline to a sound file
+
+/// Instead of waiting for a device, this backend runs the callbacks of an
+/// AudioIO one block after another as fast as they go, and writes the output
+/// channels to a sound file. The input channels can be fed from another
+/// sound file. Set it with AudioIO::backend(), then either call
+/// AudioIO::start() and wait(), or render() to render on the calling thread.
+///
+/// Files with a .au or .snd extension are written as 32 bit float Sun/NeXT
+/// files, others as 32 bit float WAV files, which switch to RF64 when larger
+/// than 4 GB. Input files can be 16, 24 or 32 bit integer or 32 bit float
+/// WAV or Sun/NeXT files.
+///
+/// All output channels are device channels, and time() is the time of the
+/// rendered frames, so a render does not depend on the speed of the machine.
+/// With a seed set, rand() is seeded with it before rendering, so that
+/// callbacks using it render the same file each time.
+///
+/// @ingroup allocore
+class AudioFileBackend : public AudioBackend{
+public:
+
+	/// @param[in] outputPath	path of the sound file to write
+	/// @param[in] seconds		duration to render; if 0, rendering goes
+	///							on until the input file ends or stop()
+	AudioFileBackend(const std::string& outputPath, double seconds = 0);
+
+	virtual ~AudioFileBackend();
+
+	/// Set sound file to feed the input channels from; empty for silence
+
+	/// File channels beyond the AudioIO input channels are ignored, and input
+	/// channels beyond the file channels are silent, as is the input after
+	/// the end of the file.
+	AudioFileBackend& inputPath(const std::string& v);
+
+	/// Set duration to render
+	AudioFileBackend& seconds(double v);
+
+	/// Set seed of rand() for deterministic renders; negative to not seed
+	AudioFileBackend& seed(long v);
+
+	/// Render on the calling thread until done
+
+	/// Fails without a duration or an input file, as it would never end.
+	/// The file is complete when it returns, even before closing.
+	bool render(AudioIO& io);
+
+	/// Wait for rendering started with AudioIO::start() to finish
+	void wait();
+
+	/// Get number of frames rendered
+	uint64_t framesRendered() const { return mFrames; }
+
+	/// Get seconds rendered per second of processing time
+	double speed() const;
+
+	virtual bool isOpen() const override;
+	virtual bool isRunning() const override;
+	virtual bool error() const override;
+	virtual void printError(const char *text = "") const override;
+	virtual void printInfo() const override;
+	virtual bool supportsFPS(double fps) override;
+	virtual void inDevice(int index) override;
+	virtual void outDevice(int index) override;
+	virtual void channels(int num, bool forOutput) override;
+	virtual int inDeviceChans() override;
+	virtual int outDeviceChans() override;
+	virtual void setInDeviceChans(int num) override;
+	virtual void setOutDeviceChans(int num) override;
+	virtual double time() override;
+	virtual bool open(int framesPerSecond, int framesPerBuffer, void *userdata) override;
+	virtual bool close() override;
+	virtual bool start(int framesPerSecond, int framesPerBuffer, void *userdata) override;
+	virtual bool stop() override;
+	virtual double cpu() override;
+
+private:
+	std::string mOutputPath, mInputPath;
+	double mSeconds;
+	long mSeed;
+	int mNumIn, mNumOut;
+	double mFPS;
+	int mFramesPerBuffer;
+	AudioIO * mIO;
+
+	FILE * mOutFile;
+	bool mOutAU;
+	std::vector<float> mOutBuffer;	// interleaved block
+
+	FILE * mInFile;
+	int mInChans, mInBytes;			// of input file
+	bool mInFloat, mInBigEndian;
+	uint64_t mInFrames;				// left in input file
+	std::vector<unsigned char> mInBuffer;
+
+	std::thread mThread;
+	std::atomic<bool> mRendering;
+	std::atomic<uint64_t> mFrames;
+	std::atomic<double> mProcessTime;	// seconds spent rendering
+	std::string mError;
+
+	bool openInput();
+	void writeHeader(uint64_t dataBytes);
+	void readInput(AudioIO& io);
+	void writeOutput(AudioIO& io, int numFrames);
+	void run();
+};
+
+} // al::
+
+#endif
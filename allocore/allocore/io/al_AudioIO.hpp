@@ -49,6 +49,7 @@
 #include <initializer_list>
 
 #include "allocore/io/al_AudioIOData.hpp"
+#include "allocore/io/al_AudioProfiler.hpp"
 
 namespace al {
 
@@ -59,40 +60,44 @@ class AudioDevice;
 
 /// Abstract audio backend
 ///
+/// The device backend is chosen when building. Other backends, such as
+/// AudioFileBackend, derive from this class and are set on an AudioIO with
+/// AudioIO::backend().
+///
 /// @ingroup allocore
 class AudioBackend {
 public:
 	AudioBackend();
 
-	~AudioBackend() {}
+	virtual ~AudioBackend() {}
 
-	bool isOpen() const;
-	bool isRunning() const;
-	bool error() const;
+	virtual bool isOpen() const;
+	virtual bool isRunning() const;
+	virtual bool error() const;
 
-	void printError(const char *text = "") const;
-	void printInfo() const;
+	virtual void printError(const char *text = "") const;
+	virtual void printInfo() const;
 
-	bool supportsFPS(double fps);
+	virtual bool supportsFPS(double fps);
 
-	void inDevice(int index);
-	void outDevice(int index);
+	virtual void inDevice(int index);
+	virtual void outDevice(int index);
 
-	void channels(int num, bool forOutput);
+	virtual void channels(int num, bool forOutput);
 
-	int inDeviceChans();
-	int outDeviceChans();
-	void setInDeviceChans(int num);
-	void setOutDeviceChans(int num);
+	virtual int inDeviceChans();
+	virtual int outDeviceChans();
+	virtual void setInDeviceChans(int num);
+	virtual void setOutDeviceChans(int num);
 
-	double time();
+	virtual double time();
 
-	bool open(int framesPerSecond, int framesPerBuffer, void *userdata);
-	bool close();
+	virtual bool open(int framesPerSecond, int framesPerBuffer, void *userdata);
+	virtual bool close();
 
-	bool start(int framesPerSecond, int framesPerBuffer, void *userdata);
-	bool stop();
-	double cpu();
+	virtual bool start(int framesPerSecond, int framesPerBuffer, void *userdata);
+	virtual bool stop();
+	virtual double cpu();
 
 	// Device information
 	static AudioDevice defaultInput();
@@ -232,12 +237,29 @@ public:
 	bool stop();			///< Stops the audio IO.
 	void processAudio();	///< Call callback manually
 
+	/// Set backend running the callbacks, or the device backend if null
+
+	/// This closes the stream. The current numbers of channels are passed on
+	/// to the new backend.
+	void backend(std::shared_ptr<AudioBackend> v);
+
+	/// Get backend running the callbacks
+	const std::shared_ptr<AudioBackend>& backend() const { return mBackend; }
+
 	bool autoZeroOut() const { return mAutoZeroOut; }
 	int channels(bool forOutput) const;
 	int channelsInDevice() const;	///< Get number of channels opened on input device
 	int channelsOutDevice()	const;	///< Get number of channels opened on output device
 	bool clipOut() const { return mClipOut; }	///< Returns clipOut setting
 	double cpu() const;				///< Returns current CPU usage of audio thread
+
+	/// Get timing of the callbacks
+
+	/// If the backend does not measure its CPU usage, cpu() returns the
+	/// smoothed load of the profiler.
+	AudioProfiler& profiler(){ return mProfiler; }
+	const AudioProfiler& profiler() const { return mProfiler; }
+
 	bool supportsFPS(double fps);	///< Return true if fps supported, otherwise false
 	bool zeroNANs()	const;			///< Returns whether to zero NANs in output buffer going to DAC
 
@@ -258,6 +280,25 @@ public:
 	void deviceOut(const AudioDevice &v);	///< Set output device
 	void framesPerSecond(double v);			///< Set number of frames per second
 	void framesPerBuffer(int n);			///< Set number of frames per processing buffer
+
+	/// Set number of frames per block passed to the callbacks; 0 to use framesPerBuffer
+
+	/// When this differs from the device buffer size set with
+	/// framesPerBuffer(), each device buffer goes through a FIFO and the
+	/// callbacks are called as many times as there are whole blocks in it.
+	/// Within the callbacks, framesPerBuffer() is then the block size. This
+	/// delays the output by blockLatency() frames.
+	void framesPerBlock(int n);
+
+	/// Get number of frames per block passed to the callbacks
+	int framesPerBlock() const { return mFramesPerBlock ? mFramesPerBlock : mFramesPerBuffer; }
+
+	/// Get frames of output delay added by processing in blocks
+
+	/// This is the block size minus the greatest common divisor of the block
+	/// and device buffer sizes, so it is 0 when the block size divides the
+	/// device buffer size.
+	int blockLatency() const;
 	void zeroNANs(bool v){ mZeroNANs = v; }	///< Set whether to zero NANs in output buffer going to DAC
 
 	void print() const;  ///< Prints info about current i/o devices to stdout.
@@ -290,12 +331,24 @@ private:
 	bool mAutoZeroOut = true;  // whether to automatically zero output buffers each block
 	std::vector<AudioCallback *> mAudioCallbacks;
 
+	// Processing in blocks other than the device buffer
+	int mFramesPerBlock = 0;
+	bool mBlocksReady = false;
+	int mFramesInFIFO = 0, mFramesOutFIFO = 0;
+	std::vector<float> mFIFOIn, mFIFOOut;  // channels of framesPerBuffer + framesPerBlock frames
+	std::vector<float> mBlockIn, mBlockOut, mBlockBus, mBlockTemp;
+
 	//	void init(int outChannels, int inChannels);			//
 	void reopen();  // reopen stream (restarts stream if needed)
 	void resizeBuffer(bool forOutput);
+	bool usingBlocks() const { return mFramesPerBlock && mFramesPerBlock != mFramesPerBuffer; }
+	void processBlock();	// run callbacks on the current buffers
+	void processBlocks();	// run callbacks on blocks through the FIFOs
+	void resetBlocks();
 	void operator=(const AudioIO &) = delete;  // Disallow copy
 
 	std::shared_ptr<AudioBackend> mBackend;
+	AudioProfiler mProfiler;
 };
 
 }  // al::
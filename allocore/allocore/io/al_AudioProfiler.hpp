@@ -0,0 +1,143 @@
+#ifndef INCLUDE_AL_AUDIO_PROFILER_HPP
+#define INCLUDE_AL_AUDIO_PROFILER_HPP
+
+/*	Allocore --
+	Multimedia / virtual environment application class library
+
+	Copyright (C) 2009. AlloSphere Research Group, Media Arts & Technology, UCSB.
+	Copyright (C) 2012. The Regents of the University of California.
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+		Redistributions of source code must retain the above copyright notice,
+		this list of conditions and the following disclaimer.
+
+		Redistributions in binary form must reproduce the above copyright
+		notice, this list of conditions and the following disclaimer in the
+		documentation and/or other materials provided with the distribution.
+
+		Neither the name of the University of California nor the names of its
+		contributors may be used to endorse or promote products derived from
+		this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+
+
+	File description:
+	Timing of audio callbacks
+
+	File author(s):
+	AlloSystem contributors
+*/
+
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace al{
+
+namespace osc{ class Send; }
+
+/// Timing of audio callbacks
+
+/// AudioIO times each block it processes with a monotonic clock and records
+/// how long it took relative to the block period, its load, in a histogram
+/// of NUM_BINS bins, each 1% of the period wide. A block with a load above 1
+/// overruns: it took longer than the time it had. A block is late when the
+/// audio thread waited for it more than 1.5 periods after the previous one
+/// ended, which happens when the driver drops blocks after an xrun.
+///
+/// Only the audio thread writes the statistics and does so without locks, so
+/// they can be read from any thread while the audio is running. A reset()
+/// from another thread may lose the blocks being recorded at that time.
+///
+/// @ingroup allocore
+class AudioProfiler{
+public:
+
+	static const int NUM_BINS = 400;		///< Number of histogram bins
+	static const int BINS_PER_PERIOD = 100;	///< Histogram bins per block period
+
+	AudioProfiler();
+
+	/// Set whether to time blocks (true by default)
+	AudioProfiler& enabled(bool v){ mEnabled = v; return *this; }
+
+	/// Get whether blocks are timed
+	bool enabled() const { return mEnabled; }
+
+	/// Start timing a block; called by the audio thread
+	void beginBlock();
+
+	/// Stop timing a block of the given period, in seconds; called by the audio thread
+	void endBlock(double period);
+
+	/// Forget when the last block ended, so the next is not counted late
+
+	/// AudioIO calls this when its stream starts.
+	void resume(){ mEnd = -1; }
+
+	/// Clear all statistics
+	void reset();
+
+	uint64_t blocks() const { return mBlocks.load(std::memory_order_relaxed); }		///< Get number of blocks timed
+	uint64_t overruns() const { return mOverruns.load(std::memory_order_relaxed); }	///< Get number of blocks that took longer than their period
+	uint64_t late() const { return mLate.load(std::memory_order_relaxed); }			///< Get number of blocks that started late
+
+	double load() const { return mLoad.load(std::memory_order_relaxed); }			///< Get load of the last blocks, smoothed over about 20 blocks
+	double maxLoad() const { return mMaxLoad.load(std::memory_order_relaxed); }		///< Get highest load of a block
+	double meanLoad() const;		///< Get mean load of all blocks
+
+	/// Get load not exceeded by a fraction p of the blocks, such as 0.99
+
+	/// The result is the upper edge of a histogram bin, so it is rounded up
+	/// to the next 1% of the period. Loads beyond the last bin are returned
+	/// as maxLoad().
+	double percentile(double p) const;
+
+	/// Get number of blocks in a histogram bin
+
+	/// Bin i counts the loads in [i, i+1) / BINS_PER_PERIOD; the last bin
+	/// also counts all loads above it.
+	uint64_t histogram(int bin) const { return mBins[bin].load(std::memory_order_relaxed); }
+
+	/// Print statistics to stdout
+	void print() const;
+
+	/// Send statistics as an OSC bundle
+
+	/// The bundle has the messages <prefix>/blocks, /overruns and /late with
+	/// an int and <prefix>/load with the smoothed, mean, 99th percentile,
+	/// 99.9th percentile and maximum loads as floats.
+	int send(osc::Send& s, const std::string& prefix = "/audio/profile") const;
+
+private:
+	// Counters are incremented with a load and store rather than an atomic
+	// read-modify-write since only the audio thread writes them
+	static void inc(std::atomic<uint64_t>& v){
+		v.store(v.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+
+	std::atomic<bool> mEnabled;
+	int64_t mBegin, mEnd;
+	std::atomic<uint64_t> mBlocks, mOverruns, mLate;
+	std::atomic<double> mLoad, mMaxLoad, mLoadSum;
+	std::atomic<uint64_t> mBins[NUM_BINS];
+};
+
+} // al::
+
+#endif
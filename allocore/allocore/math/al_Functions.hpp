@@ -44,6 +44,7 @@
 */
 
 #include <cmath>
+#include <cstring> // memcpy
 #include <utility> // forward
 #include "allocore/system/al_Config.h"
 #include "allocore/math/al_Constants.hpp"
@@ -268,6 +269,9 @@ template<class T> T poly(const T& x, const T& a0, const T& a1, const T& a2);
 /// Evaluates polynomial a0 + a1 x + a2 x^2 + a3 x^3
 template<class T> T poly(const T& x, const T& a0, const T& a1, const T& a2, const T& a3);
 
+/// Evaluates polynomial a0 + a1 x + a2 x^2 + a3 x^3 + a4 x^4
+template<class T> T poly(const T& x, const T& a0, const T& a1, const T& a2, const T& a3, const T& a4);
+
 template<class T> T pow2(const T& v);		///< Returns value to the 2nd power.
 template<class T> T pow2S(const T& v);		///< Returns value to the 2nd power preserving sign.
 template<class T> T pow3(const T& v);		///< Returns value to the 3rd power.
@@ -279,6 +283,13 @@ template<class T> T pow8(const T& v);		///< Returns value to the 8th power.
 template<class T> T pow16(const T& v);		///< Returns value to the 16th power.
 template<class T> T pow64(const T& v);		///< Returns value to the 64th power.
 
+/// Fast approximation to pow() for a positive base
+
+/// This evaluates 2^(exponent * log2(base)) with polynomial approximations
+/// of log2 and exp2. The relative error is about 0.007% times the magnitude
+/// of the exponent for results within the range of normalized floats.
+float powFast(float base, float exponent);
+
 /// Returns value to a positive integer power
 
 /// @param[in] base		the base value to exponentiate
@@ -714,6 +725,7 @@ TEM inline bool odd(const T& v){ return v & T(1); }
 
 TEM inline T poly(const T& v, const T& a0, const T& a1, const T& a2){ return a0 + v*(a1 + v*a2); }
 TEM inline T poly(const T& v, const T& a0, const T& a1, const T& a2, T a3){ return a0 + v*(a1 + v*(a2 + v*a3)); }
+TEM inline T poly(const T& v, const T& a0, const T& a1, const T& a2, const T& a3, const T& a4){ return a0 + v*(a1 + v*(a2 + v*(a3 + v*a4))); }
 
 TEM inline T pow2 (const T& v){ return v*v; }
 TEM inline T pow2S(const T& v){ return v*al::abs(v); }
@@ -726,6 +738,29 @@ TEM inline T pow8 (const T& v){ return pow4(pow2(v)); }
 TEM inline T pow16(const T& v){ return pow4(pow4(v)); }
 TEM inline T pow64(const T& v){ return pow8(pow8(v)); }
 
+inline float powFast(float base, float exponent){
+	float f;
+	int32_t i;
+
+	// log2(base) = exponent + log2(mantissa), mantissa in [1,2)
+	std::memcpy(&i, &base, 4);
+	float e = float(((i >> 23) & 0xff) - 127);
+	i = (i & 0x007fffff) | 0x3f800000;
+	std::memcpy(&f, &i, 4);
+	float l2 = e + poly(f, -2.5056147f, 4.0496169f, -2.0994023f, 0.6355111f, -0.0800109f);
+
+	// 2^y = 2^floor(y) * 2^fract(y)
+	float y = exponent * l2;
+	if(y < -126.f) y = -126.f;
+	else if(y > 126.f) y = 126.f;
+	float fl = float(int(y + 127.f) - 127);
+	float fr = y - fl;
+	float p = poly(fr, 1.0000025f, 0.6930066f, 0.2414275f, 0.0520374f, 0.0135206f);
+	i = (int32_t(fl) + 127) << 23;
+	std::memcpy(&f, &i, 4);
+	return f * p;
+}
+
 TEM inline T powN(T base, unsigned power){
 	switch(power){
 		case 0: return T(1);
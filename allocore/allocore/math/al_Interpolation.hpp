@@ -42,6 +42,7 @@
 	Lance Putnam, 2006, putnam.lance@gmail.com
 */
 
+#include <cmath>
 #include <initializer_list>
 
 namespace al {
@@ -197,6 +198,33 @@ inline Tv trilinear(
 	return trilinear(f[0],f[1],f[2],xyz,Xyz,xYz,XYz,xyZ,XyZ,xYZ,XYZ);
 }
 
+
+/// Windowed sinc interpolation with a polyphase coefficient table
+
+/// The sinc is windowed by a 4-term Blackman-Harris window and each phase
+/// is normalized to unity gain at DC. Coefficients are linearly
+/// interpolated between adjacent phases.
+///
+/// @tparam Taps	number of samples read per output sample; a multiple of 4
+/// @tparam Phases	number of phases tabulated between two samples
+template <int Taps, int Phases=256>
+class SincTable{
+public:
+	static const int taps = Taps;
+
+	SincTable();
+
+	/// Interpolate between x[0] and x[1]
+
+	/// @param[in] x	samples; x[1-Taps/2] through x[Taps/2] are read
+	/// @param[in] frac	fraction between x[0] and x[1], in [0, 1]
+	float operator()(const float * x, float frac) const;
+
+private:
+	float mCoefs[(Phases+1) * Taps];
+	float mDeltas[(Phases+1) * Taps];	// difference to coefficients of next phase
+};
+
 /// @} // end allocore group
 
 
@@ -423,6 +451,54 @@ inline Tv linearCyclic(Tf frac, const Tv& x, const Tv& y, const Tv& z){
 							return ipl::linear(frac-Tf(1), y,z);
 }
 
+template <int Taps, int Phases>
+SincTable<Taps,Phases>::SincTable(){
+	static_assert(Taps % 4 == 0, "SincTable taps must be a multiple of 4");
+	const double pi = 3.14159265358979323846;
+
+	for(int ph=0; ph<=Phases; ++ph){
+		float * c = mCoefs + ph*Taps;
+		double frac = double(ph) / Phases;
+		double sum = 0;
+		for(int k=0; k<Taps; ++k){
+			double t = (k + 1 - Taps/2) - frac;	// offset of tap from interpolated point
+			double u = (t + Taps/2) / Taps;		// position in window, in (0, 1]
+			double w = 0.35875 - 0.48829*cos(2*pi*u) + 0.14128*cos(4*pi*u) - 0.01168*cos(6*pi*u);
+			double h = t == 0 ? 1 : sin(pi*t) / (pi*t);
+			c[k] = h * w;
+			sum += c[k];
+		}
+		for(int k=0; k<Taps; ++k) c[k] /= sum;
+	}
+
+	for(int ph=0; ph<=Phases; ++ph){
+		for(int k=0; k<Taps; ++k){
+			mDeltas[ph*Taps + k] = ph < Phases ? mCoefs[(ph+1)*Taps + k] - mCoefs[ph*Taps + k] : 0.f;
+		}
+	}
+}
+
+template <int Taps, int Phases>
+inline float SincTable<Taps,Phases>::operator()(const float * x, float frac) const {
+	float pos = frac * Phases;
+	int ph = int(pos);
+	if(ph > Phases) ph = Phases;
+	float d = pos - ph;
+	const float * c = mCoefs + ph*Taps;
+	const float * dc = mDeltas + ph*Taps;
+	x += 1 - Taps/2;
+
+	// Independent sums let the compiler vectorize the dot product
+	float s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+	for(int k=0; k<Taps; k+=4){
+		s0 += (c[k  ] + d*dc[k  ]) * x[k  ];
+		s1 += (c[k+1] + d*dc[k+1]) * x[k+1];
+		s2 += (c[k+2] + d*dc[k+2]) * x[k+2];
+		s3 += (c[k+3] + d*dc[k+3]) * x[k+3];
+	}
+	return (s0 + s1) + (s2 + s3);
+}
+
 template <class Tf, class Tv>
 inline Tv nearest(Tf frac, const Tv& x, const Tv& y){
 	return (frac < Tf(0.5)) ? x : y;
@@ -706,7 +706,7 @@ bool invert(Mat<3,T>& m){
 	auto nx = cross(m.col(1), m.col(2));
 	auto ny = cross(m.col(2), m.col(0));
 	auto nz = cross(m.col(0), m.col(1));
-	auto det= m(0,0)*nx.x + m(1,0)*ny.x + m(2,0)*nz.x;
+	auto det= m(0,0)*nx.x + m(1,0)*nx.y + m(2,0)*nx.z;
 	if(det != T(0)){
 		m.set(
 			nx.x, nx.y, nx.z,
@@ -149,7 +149,7 @@ public:
 
 protected:
 	int mDim;			// dimensions - 2d or 3d
-	int mOrder;			// order - 0th, 1st, 2nd, or 3rd
+	int mOrder;			// order - 0th up to 5th
 	int mChannels;		// cached for efficiency
 	float * mWeights;	// weights for each ambi channel
 
@@ -179,6 +179,12 @@ public:
 	virtual ~AmbiDecode();
 
 
+	/// Decode a block of Ambisonic domain frames
+
+	/// The decode matrix, with the configuration applied, is kept up to date
+	/// as speakers and configuration change, so this only multiplies it
+	/// with the block of Ambisonic domain frames.
+	///
 	/// @param[out] dec				output time domain buffers (non-interleaved)
 	/// @param[in] enc				input Ambisonic domain buffers (non-interleaved)
 	/// @param[in] numDecFrames	number of frames in time domain buffers
@@ -190,7 +196,7 @@ public:
 	/// @param[in] timeIndex		index into enc buffer to decode
 	virtual void decode(float *dec, const float * enc, int numFrames, int timeIndex) const;
 
-	void setConfiguration(AmbiDecodeConfig &config) {mConfig = config;}
+	void setConfiguration(AmbiDecodeConfig &config) {mConfig = config; updateDecodeGains();}
 
 	float decodeWeight(int speaker, int channel) const {
 		return /*mWeights[channel] **/ mDecodeMatrix[speaker * channels() + channel];
@@ -232,17 +238,20 @@ protected:
 	int mFlavor;				// decode flavor
 	float * mDecodeMatrix;		// deccoding matrix for each ambi channel & speaker
 								// cols are channels and rows are speakers
-	float mWOrder[5];			// weights for each order
+	float mWOrder[6];			// weights for each order
+	std::vector<float> mDecodeGains;	// decoding matrix with configuration applied
     Speakers* mSpeakers;
     //float * mPositions;		// speakers' azimuths + elevations
 	//float * mFrame;			// an ambisonic channel frame used for decode(int)
 
 	void updateChanWeights();
+	void updateDecodeGains();
+	void updateDecodeGains(int speaker);
 	void resizeArrays(int numChannels, int numSpeakers);
 
 	float decode(float * encFrame, int encNumChannels, int speakerNum);	// is this useful?
 
-	static float flavorWeights[4][5][5];
+	static float flavorWeights[4][6][6];
 
 	AmbiDecodeConfig mConfig;
 };
@@ -298,6 +307,128 @@ public:
 };
 
 
+
+/// Higher Order Ambisonic encoder with order fixed at compile time
+
+/// The spherical harmonic recurrences have fixed trip counts, so the
+/// compiler unrolls them completely. Channels are in the same order and
+/// normalization as AmbiBase::encodeWeightsFuMa().
+///
+/// @ingroup allocore
+template <int Order, int Dim = 3>
+class AmbiEncoder{
+public:
+
+	/// Number of Ambisonic domain channels
+	static const int numChannels = 2*Order + 1 + (Dim == 3 ? Order*Order : 0);
+
+	/// Compute spherical harmonic weights
+
+	/// @param[out] ws	numChannels weights
+	/// @param[in] x	x component of unit direction (in the listener's coordinate frame)
+	/// @param[in] y	y component of unit direction
+	/// @param[in] z	z component of unit direction
+	static void encodeWeights(float * ws, float x, float y, float z);
+
+	/// Encode buffers of several sources, each in a constant direction
+
+	/// This makes one pass over the Ambisonic domain channels for every
+	/// four sources.
+	///
+	/// @param[in,out] ambiChans	Ambisonic domain channels (non-interleaved) to add to
+	/// @param[in] dirs			unit direction of each source
+	/// @param[in] inputs		time-domain sample buffer of each source
+	/// @param[in] numSources	number of sources
+	/// @param[in] numFrames	number of frames to encode
+	template <class XYZ>
+	static void encode(float * ambiChans, const XYZ * dirs, const float * const * inputs, int numSources, int numFrames);
+
+	/// Set Cartesian direction of source to be encoded
+	void direction(float x, float y, float z){ encodeWeights(mWeights, x,y,z); }
+
+	/// Get Ambisonic channel weights
+	const float * weights() const { return mWeights; }
+
+	/// Encode buffer in the current direction
+
+	/// @param[in,out] ambiChans	Ambisonic domain channels (non-interleaved) to add to
+	/// @param[in] input			time-domain sample buffer to encode
+	/// @param[in] numFrames		number of frames to encode
+	void encode(float * ambiChans, const float * input, int numFrames) const;
+
+private:
+	float mWeights[numChannels];
+};
+
+
+
+/// Rotation of Ambisonic domain signals
+
+/// The rotation matrix of each spherical harmonic degree is computed with
+/// the recursion of Ivanic and Ruedenberg and then scaled to the channel order
+/// and normalization of AmbiBase::encodeWeightsFuMa(). 2D signals use
+/// the horizontal part of the rotation, so only rotations about the z axis
+/// are exact for them.
+///
+/// @ingroup allocore
+class AmbiRotate : public AmbiBase{
+public:
+
+	/// @param[in] dim			number of spatial dimensions (2 or 3)
+	/// @param[in] order		highest spherical harmonic order, up to 5
+	/// @param[in] maxFrames	largest number of frames passed to rotate()
+	AmbiRotate(int dim, int order, int maxFrames=0);
+
+	/// Set largest number of frames passed to rotate()
+
+	/// The working buffer is allocated here, so this must not be called
+	/// while rotate() is running.
+	void maxFrames(int v);
+
+	/// Set rotation
+
+	/// @param[in] rot		rotation matrix, applied to column vectors of
+	///						directions in the Ambisonic coordinate frame
+	void rotation(const Mat3d& rot);
+
+	/// Set rotation from a listener orientation
+
+	/// The sound field is rotated by the inverse of the orientation, so that
+	/// it is heard as by a listener with that orientation. The orientation
+	/// is in the coordinate frame of Pose, and the Ambisonic coordinate
+	/// frame is (x, -z, y) in it, as for sources encoded by
+	/// AmbisonicsSpatializer.
+	///
+	/// @param[in] q		orientation of the listener
+	void orientation(const Quatd& q);
+
+	/// Rotate Ambisonic domain channels in place
+
+	/// The rotation matrix is interpolated linearly across the block from
+	/// the one applied to the last block. It reaches the current rotation on
+	/// the last frame. Blocks larger than maxFrames() are left unrotated.
+	///
+	/// @param[in,out] ambiChans	Ambisonic domain channels (non-interleaved)
+	/// @param[in] numFrames		number of frames in each channel
+	void rotate(float * ambiChans, int numFrames);
+
+	/// Get coefficient of input channel in output channel
+	float coef(int outChan, int inChan) const { return mMatrix[outChan * channels() + inChan]; }
+
+	virtual void onChannelsChange() override;
+
+protected:
+	std::vector<float> mMatrix;		// rotation matrix, rows are output channels
+	std::vector<float> mPrevMatrix;	// rotation matrix of last block
+	std::vector<float> mBuffer;		// copy of input channels
+	int mMaxFrames;
+	std::vector<int> mDegreeStart;	// start of each degree in mDegreeChans
+	std::vector<int> mDegreeChans;	// channels grouped by degree
+	std::vector<float> mScales;		// channel scales relative to SN3D
+	bool mHasRotation;
+};
+
+
 /// Ambisonic coder
 ///
 /// @ingroup allocore
@@ -322,23 +453,50 @@ public:
 	                          const float& sample,
 	                          const int& frameIndex) override;
 
+	/// Encode source, ramping from the source's encoding weights in the last block
+	virtual void renderSourceBuffer(AudioIOData& io,
+	                  const Pose& listeningPose,
+	                  const float *samples,
+	                  const int& numFrames,
+	                  SoundSource& src
+	                  ) override;
+
+	/// Get number of values kept per source, the encoding weights
+	virtual unsigned sourceStateSize() const override { return mEncoder.channels(); }
+
+	/// Decode ambisonic domain channels to the speakers
+	virtual void finalize(AudioIOData& io) override;
+
 	void numSpeakers(int num);
 
 	void setSpeakerLayout(SpeakerLayout& sl);
 
-	void zeroAmbi();
+	/// Set whether to rotate the Ambisonic domain by the listener orientation
 
-	float * ambiChans(unsigned channel=0);
+	/// When enabled, sources are encoded in world directions and the
+	/// Ambisonic domain is rotated once per block before decoding, so the
+	/// cost of following the listener's orientation does not grow with the
+	/// number of sources. The rotation is interpolated across the block.
+	/// Source orientations are ignored in this mode.
+	void rotateAmbi(bool v){ mRotateAmbi = v; }
 
+	/// Get whether the Ambisonic domain is rotated by the listener orientation
+	bool rotateAmbi() const { return mRotateAmbi; }
 
-//	virtual void finalize(AudioIOData& io) override;
+	void zeroAmbi();
+
+	float * ambiChans(unsigned channel=0);
 
 private:
 	AmbiDecode mDecoder;
 	AmbiEncode mEncoder;
+	AmbiRotate mRotator;
 	std::vector<float> mAmbiDomainChannels;
 	Listener* mListener;
 	int mNumFrames;
+	bool mRotateAmbi;
+
+	Vec3d sourceDirection(const Pose& listeningPose) const;
 };
 
 
@@ -370,6 +528,12 @@ inline int AmbiBase::channelsToOrder(int channels)
 	case 16:
 		order = 3;
 		break;
+	case 25:
+		order = 4;
+		break;
+	case 36:
+		order = 5;
+		break;
 	default:
 		order = -1;
 	}
@@ -386,6 +550,8 @@ inline int AmbiBase::channelsToDimensions(int channels)
 	case 4:
 	case 9:
 	case 16:
+	case 25:
+	case 36:
 		dim = 3;
 		break;
 	default:
@@ -446,6 +612,9 @@ inline void AmbiEncode::encode(float * ambiChans, int numFrames, int timeIndex,
 	#define CS(chanindex) case chanindex: ambiChans[chanindex*numFrames+timeIndex] += weights()[chanindex] * timeSample;
 	int ch = channels()-1;
 	switch(ch){
+		CS(35) CS(34) CS(33) CS(32) CS(31) CS(30) CS(29) CS(28)
+		CS(27) CS(26) CS(25) CS(24) CS(23) CS(22) CS(21) CS(20)
+		CS(19) CS(18) CS(17) CS(16)
 		CS(15) CS(14) CS(13) CS(12) CS(11) CS(10) CS( 9) CS( 8)
 		CS( 7) CS( 6) CS( 5) CS( 4) CS( 3) CS( 2) CS( 1) CS( 0)
 		default:;
@@ -498,6 +667,112 @@ void AmbiEncode::encode(float * ambiChans, const XYZ * dir, const float * input,
 }
 
 
+// AmbiEncoder
+template <int Order, int Dim>
+void AmbiEncoder<Order, Dim>::encodeWeights(float * ws, float x, float y, float z){
+
+	// Normalization of the vertical harmonics of degree l and index m < l.
+	// Up to 3rd order these are the (FuMa) factors of encodeWeightsFuMa;
+	// above they scale each harmonic to a maximum of 1.
+	static const float norms[6][5] = {
+		{0},
+		{1},
+		{1, 2.f/3.f},
+		{1, 16.f/33.f, 1.f/30.f},
+		{1, 0.37877847f, 0.10370370f, 0.029325728f},
+		{1, 0.31078829f, 0.068968084f, 0.015282437f, 0.0036972023f}
+	};
+
+	*ws++ = 0.707106781f;						// W = 1/sqrt(2)
+
+	// Horizontal harmonics: c[m] = cos(mA)cos^m(E), s[m] = sin(mA)cos^m(E)
+	float c[Order+1], s[Order+1];
+	c[0] = 1.f; s[0] = 0.f;
+	for(int m=1; m<=Order; ++m){
+		c[m] = x * c[m-1] - y * s[m-1];
+		s[m] = x * s[m-1] + y * c[m-1];
+		*ws++ = c[m];
+		*ws++ = s[m];
+	}
+
+	if(Dim == 3){
+		// Associated Legendre polynomials P[l][m] of z, without the factor
+		// of cos^m(E) already in c[m] and s[m]
+		float P[Order+1][Order+1];
+		float pmm = 1.f;
+		for(int m=0; m<Order; ++m){
+			P[m][m] = pmm;
+			P[m+1][m] = (2*m+1) * z * pmm;
+			for(int l=m+2; l<=Order; ++l){
+				P[l][m] = ((2*l-1) * z * P[l-1][m] - (l+m-1) * P[l-2][m]) / (l-m);
+			}
+			pmm *= 2*m+1;
+		}
+
+		// For each degree, pairs of harmonics from m = l-1 to 1, then m = 0
+		for(int l=1; l<=Order; ++l){
+			for(int m=l-1; m>0; --m){
+				float v = norms[l][m] * P[l][m];
+				*ws++ = v * c[m];
+				*ws++ = v * s[m];
+			}
+			*ws++ = P[l][0];
+		}
+	}
+}
+
+template <int Order, int Dim>
+template <class XYZ>
+void AmbiEncoder<Order, Dim>::encode(
+	float * ambiChans, const XYZ * dirs, const float * const * inputs, int numSources, int numFrames
+){
+	int j = 0;
+
+	// Four sources per pass over the Ambisonic domain channels
+	for(; j+4<=numSources; j+=4){
+		float w[4][numChannels];
+		for(int k=0; k<4; ++k){
+			encodeWeights(w[k], dirs[j+k][0], dirs[j+k][1], dirs[j+k][2]);
+		}
+		const float * in0 = inputs[j];
+		const float * in1 = inputs[j+1];
+		const float * in2 = inputs[j+2];
+		const float * in3 = inputs[j+3];
+		for(int c=0; c<numChannels; ++c){
+			float * out = ambiChans + c * numFrames;
+			const float w0 = w[0][c], w1 = w[1][c], w2 = w[2][c], w3 = w[3][c];
+			for(int i=0; i<numFrames; ++i){
+				out[i] += in0[i] * w0 + in1[i] * w1 + in2[i] * w2 + in3[i] * w3;
+			}
+		}
+	}
+
+	for(; j<numSources; ++j){
+		float w[numChannels];
+		encodeWeights(w, dirs[j][0], dirs[j][1], dirs[j][2]);
+		const float * in = inputs[j];
+		for(int c=0; c<numChannels; ++c){
+			float * out = ambiChans + c * numFrames;
+			const float w0 = w[c];
+			for(int i=0; i<numFrames; ++i){
+				out[i] += in[i] * w0;
+			}
+		}
+	}
+}
+
+template <int Order, int Dim>
+void AmbiEncoder<Order, Dim>::encode(float * ambiChans, const float * input, int numFrames) const {
+	for(int c=0; c<numChannels; ++c){
+		float * out = ambiChans + c * numFrames;
+		const float w = mWeights[c];
+		for(int i=0; i<numFrames; ++i){
+			out[i] += input[i] * w;
+		}
+	}
+}
+
+
 inline float * AmbisonicsSpatializer::ambiChans(unsigned channel) {
 	return &mAmbiDomainChannels[channel * mNumFrames];
 }
@@ -44,13 +44,17 @@
 	Ryan McGee, 2012, ryanmichaelmcgee@gmail.com
 */
 
+#include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <cstring>
+#include <utility>
 #include <vector>
 #include <list>
 #include <iostream>
 
 #include "allocore/types/al_Buffer.hpp"
+#include "allocore/types/al_SingleRWRingBuffer.hpp"
 #include "allocore/math/al_Interpolation.hpp"
 #include "allocore/math/al_Vec.hpp"
 #include "allocore/spatial/al_DistAtten.hpp"
@@ -59,6 +63,8 @@
 #include "allocore/sound/al_Speaker.hpp"
 #include "allocore/sound/al_Reverb.hpp"
 #include "allocore/sound/al_Biquad.hpp"
+#include "allocore/sound/al_FDNReverb.hpp"
+#include "allocore/system/al_Printing.hpp"
 
 namespace al{
 
@@ -157,6 +163,10 @@ protected:
 	std::vector<Quatd> mQuatHistory;// buffer of interpolated orientations
 	Quatd mQuatPrev;				// orientation in previous block
 	bool mIsCompiled;
+	int mPosition;					// index of the first listener at the same position
+	int mPrevPosition;				// mPosition in the last block, -1 before the first
+	Vec3d mPrevPos;					// position in the last block
+	bool mFirstAtPosition;			// whether first listener at its position
 };
 
 
@@ -170,6 +180,21 @@ enum DopplerType{
 	DOPPLER_PHYSICAL		/**< Physically Accurate Doppler Shift. Requires per sample processing for AudioScene and SoundSource. */
 };
 
+/// Interpolation types for reading a source's delay line
+
+/// Higher quality reduces aliasing of Doppler shifts. The cost per sample
+/// relative to cubic, as measured by allocoreBench, is about 0.5 for
+/// linear, 1.7 for 8-point, 2.1 for 16-point and 3 for 32-point sinc.
+/// Sinc interpolation reads taps/2-1 samples ahead of the read position,
+/// so sources are delayed by at least that many samples.
+enum DelayInterpolation{
+	INTERP_LINEAR=0,		/**< 2-point linear */
+	INTERP_CUBIC,			/**< 4-point cubic (Catmull-Rom) */
+	INTERP_SINC8,			/**< 8-point windowed sinc */
+	INTERP_SINC16,			/**< 16-point windowed sinc */
+	INTERP_SINC32			/**< 32-point windowed sinc */
+};
+
 /// The attenuation policy may be different per source, i.e., because a bee has
 /// a different attenuation characteristic than an airplane.
 ///
@@ -192,6 +217,12 @@ public:
 
 	virtual ~SoundSource(){}
 
+	/// Get next sample as heard at a relative listening pose
+
+	/// This is the accurate, per-sample mode: distance, Doppler and
+	/// attenuation are recomputed for every sample. When the source is not
+	/// using per sample processing, the sample read is offset by the frame
+	/// position set with frame() so that a whole block can be read back.
 	float getNextSample(Pose listeningPose) {
 
 		float s = 0.0f;
@@ -201,7 +232,7 @@ public:
 		Quatd srcRot = listeningPose.quat();
 		relDirection = srcRot.rotate(relDirection);
 		double distanceToSample = 0;
-		double samplesAgo = 1024; // TODO how can we set a better default
+		double samplesAgo = 0;
 		if(dopplerType() == DOPPLER_SYMMETRICAL) {
 			distanceToSample = mSampleRate / mSpeedOfSound;
 			samplesAgo = dist * distanceToSample;
@@ -218,22 +249,20 @@ public:
 		}
 		updateHistory();
 
-//		// Add on time delay (in samples) - only needed if the source is rendered per buffer
+		// Add on time delay (in samples) - only needed if the source is rendered per buffer
 		if(!usePerSampleProcessing()) {
-			samplesAgo -= mFrameCounter++;
+			samplesAgo += mFramesInBlock - 1 - mFrameCounter++;
 		}
 
+		samplesAgo = std::max(samplesAgo, double(minIndex()));
+
 		// Is our delay line big enough?
 		if(samplesAgo <= maxIndex()){
 			double gain = attenuation(dist);
 
-			//reading samplesAgo-i causes a discontinuity
 			s = readSample(samplesAgo) * gain;
-
-			// s = src.presenceFilter(s); //TODO: causing stopband ripple here, why?
-
 		} else {
-			std::cout << "Delay line exceeded in SoundSource" << std::endl;
+			AL_WARN_ONCE("Delay line exceeded in SoundSource");
 		}
 		return s;
 	}
@@ -243,35 +272,49 @@ public:
 	}
 
 	void getBuffer(Listener &l, float *buffer, const int size) {
-		frame(0);
-		for (int i = 0; i < size; i++) {
-			*buffer++ = getNextSample(l);
-		}
+		getBuffer(l.pose(), buffer, size);
 	}
 
-	void getBuffer(Pose listeningPose, float *buffer, const int size) {
-		frame(0);
-		for (int i = 0; i < size; i++) {
-			*buffer++ = getNextSample(listeningPose);
-		}
-	}
+	/// Get a block of samples as heard at a relative listening pose
+
+	/// This is the block-rate mode: distance and attenuation are computed
+	/// once per block and the propagation delay and gain are ramped linearly
+	/// from the values at the end of the previous block. This preserves
+	/// symmetrical Doppler shift at a fraction of the cost of calling
+	/// getNextSample() per frame. Physical Doppler requires per-sample
+	/// evaluation, so it falls back to getNextSample().
+	void getBuffer(const Pose& listeningPose, float *buffer, const int size);
+
+	/// Get a block of samples as heard from one of several listening positions
+
+	/// The delay and gain are ramped from the values at the end of the last
+	/// block for the same position index, so the source stays continuous
+	/// when heard from several positions in each block. Position 0 is the
+	/// one used by getBuffer() without a position.
+	void getBuffer(const Pose& listeningPose, float *buffer, const int size, int position);
+
+	/// Set frame position within block for getNextSample()
+
+	/// @param[in] v			frame index within the block
+	/// @param[in] numFrames	number of frames in the block; the last frame
+	///							of the block reads the most recent sample
+	void frame(int v, int numFrames) { mFrameCounter = v; mFramesInBlock = numFrames; }
 
 	void frame(int v) { mFrameCounter = v; }
 
-	/// Read sample from delay-line using linear interpolation
+	/// Read sample from delay-line using the source's interpolation
+
 	/// The index specifies how many samples ago by which to read back from
-	/// the buffer. The index must be less than or equal to bufferSize()-2.
-	float readSample(double index) const {
-		int index0 = (int) index;
-		float a = mSound.read(index0);
-		float b = mSound.read(index0-1);
-		float frac = -(index0 - index);
-		//return ipl::linear(frac, a, b);
-
-		float a0 = mSound.read(index0+1);
-		float b1 = mSound.read(index0-2);
-		return ipl::cubic(frac, a0, a, b, b1);
-	}
+	/// the buffer. It must be between minIndex() and maxIndex().
+	float readSample(double index) const;
+
+	/// Set interpolation used to read the delay line (INTERP_CUBIC by default)
+	void interpolation(DelayInterpolation v);
+	/// Get interpolation used to read the delay line
+	DelayInterpolation interpolation() const { return mInterpolation; }
+
+	/// Get number of delay line samples read for each interpolated sample
+	int interpolationTaps() const;
 
 	/// Returns whether distance-based attenuation is enabled
 	bool useAttenuation() const { return mUseAtten; }
@@ -314,7 +357,13 @@ public:
 	}
 
 	/// Returns maximum index that can be used for reading samples
-	int maxIndex() const { return delaySize()-2; }
+	int maxIndex() const { return delaySize() - interpolationTaps()/2 - 1; }
+
+	/// Returns minimum index that can be used for reading samples
+
+	/// This is 0 for linear and cubic interpolation. Sinc interpolation
+	/// reads samples newer than the index.
+	int minIndex() const { return mInterpolation >= INTERP_SINC8 ? interpolationTaps()/2 - 1 : 0; }
 
 	// calculate the buffersize needed for given samplerate, speed of sound & distance traveled (e.g. nearClip+clipRange).
 	// probably want to add io.samplesPerBuffer() to this for safety.
@@ -323,20 +372,108 @@ public:
 	/// Set speed of sound for computation in m/s
 	void setSpeedOfSound(float speedOfSound) {mSpeedOfSound = speedOfSound; }
 
-	void cachedIndex(unsigned int v){ mCachedIndex = v; } // FIXME: For VBAP. There should be a better place for this
-	unsigned int cachedIndex(){ return mCachedIndex; }
+	/// Set index cached by the spatializer, ex. the last VBAP triplet
+	void cachedIndex(unsigned int v){ mCachedIndex = v; }
+	/// Get index cached by the spatializer
+	unsigned int cachedIndex() const { return mCachedIndex; }
+
+	/// Get state kept by a spatializer for this source
+
+	/// Spatializers use this to carry values, such as the gains applied in
+	/// the last block, over to the next block. AudioScene allocates
+	/// Spatializer::sourceStateSize() values for each of its spatializers on
+	/// the control thread, so this only looks them up. The values are zero
+	/// and fresh is true the first time they are asked for after the source
+	/// was added, culled or resized.
+	///
+	/// @param[in] s		spatializer
+	/// @param[in] size		number of values needed
+	/// @param[out] fresh	whether the values were just zeroed
+	/// @return the values, or NULL if fewer were allocated for the spatializer
+	float * spatializerState(const Spatializer * s, unsigned size, bool& fresh);
+
+	/// Allocate the state of a spatializer rendering this source directly
+
+	/// AudioScene does this for the spatializers of its listeners. Call this
+	/// to render the source with a spatializer outside of an AudioScene, and
+	/// not while the spatializer renders the source.
+	void reserveSpatializerState(const Spatializer& s);
+
+	/// Set whether the source is rendered (true by default)
+
+	/// An inactive source is faded out over one block and then skipped by
+	/// AudioScene::render() until it is made active again.
+	void active(bool v){ mActive = v; }
+	/// Get whether the source is rendered
+	bool active() const { return mActive; }
+
+	/// Set priority used to rank sources against AudioScene::maxSources() (1 by default)
+	void priority(float v){ mPriority = v; }
+	/// Get priority used to rank sources against AudioScene::maxSources()
+	float priority() const { return mPriority; }
+
+	/// Set level sent to the reverb of the AudioScene (0 by default)
+	void reverbSend(float v){ mReverbSend = v; }
+	/// Get level sent to the reverb of the AudioScene
+	float reverbSend() const { return mReverbSend; }
+
+	/// Get RMS amplitude of samples in the delay line
+
+	/// @param[in] delay		samples ago of the newest sample to measure
+	/// @param[in] numFrames	number of samples to measure
+	float level(double delay, int numFrames) const;
 
 private:
+	friend class AudioScene;
+
 	RingBuffer<float> mSound;		// spherical wave around position
 	bool mUseAtten;
 	DopplerType mDopplerType;
+	DelayInterpolation mInterpolation;
 	bool mUsePerSampleProcessing;
     unsigned int mCachedIndex; // for VBAP with multiple sources
 	float mSampleRate;
 	float mSpeedOfSound;
 	int mFrameCounter;
-
-	BiQuadNX presenceFilter; //used for presence filtering and spatial modulation BW control
+	int mFramesInBlock;
+	double mPrevDelay;				// delay, in samples, at end of last block
+	double mPrevGain;				// attenuation at end of last block
+	std::vector<std::pair<double, double> > mPositionStates; // delay and attenuation for other positions
+	bool mActive;
+	float mPriority;
+	float mRenderGain;				// fade gain applied by AudioScene at end of block
+	float mRenderGainPrev;			// fade gain at end of last block
+	float mReverbSend;
+	float mReverbSendPrev;			// reverb send at end of last block
+
+	// Interpolate between p[0], the sample index0 ago, and p[-1], one older
+	float interpolate(const float * p, float frac) const;
+
+	// Forget delay and spatializer state, so a source entering the rendered
+	// set after being culled does not ramp from where it was then
+	void resetRenderState();
+
+	// Control thread: size the state kept per listener position, so that
+	// rendering does not allocate
+	void reserveListeners(int n);
+
+	// Start the state of a listener position from that of another
+	void copyRenderState(int from, int to);
+
+	struct SpatializerState{
+		const Spatializer * spatializer;
+		std::vector<float> values;
+		bool fresh;					// zeroed since last asked for
+	};
+	typedef std::vector<SpatializerState> SpatializerStates;
+	SpatializerStates mSpatializerStates;
+
+	// Audio thread: swap in states allocated by the control thread, keeping
+	// the values of those that did not change size
+	void swapSpatializerStates(SpatializerStates& states);
+
+	// Air absorption filter state and distance for each listener position
+	std::vector<float> mAirStates;
 };
 
 
@@ -370,15 +507,62 @@ public:
 	                          const float& sample,
 	                          const int& frameIndex) = 0;
 
+	/// Render audio buffer of a scene source in position
+
+	/// AudioScene calls this rather than renderBuffer() so that spatializers
+	/// can keep state per source, ex. the last triplet found by VBAP. The
+	/// default ignores the source.
+	virtual void renderSourceBuffer(AudioIOData& io,
+	                          const Pose& listeningPose,
+	                          const float *samples,
+	                          const int& numFrames,
+	                          SoundSource& src
+	                          ){
+		renderBuffer(io, listeningPose, samples, numFrames);
+	}
+
+	/// Render audio sample of a scene source in position
+
+	/// AudioScene calls this rather than renderSample(). The default ignores
+	/// the source.
+	virtual void renderSourceSample(AudioIOData& io, const Pose& listeningPose,
+	                          const float& sample,
+	                          const int& frameIndex,
+	                          SoundSource& src){
+		renderSample(io, listeningPose, sample, frameIndex);
+	}
+
 	/// Called once per listener, after sources are rendered. ex. ambisonics decode
 	virtual void finalize(AudioIOData& io){}
 
+	/// Returns whether renderBuffer() and renderSample() may be called
+	/// concurrently from several threads, each with its own AudioIOData.
+
+	/// Spatializers that keep intermediate state across sources (such as an
+	/// ambisonic bus) must return false. AudioScene will then still compute
+	/// the source signals in parallel, but spatialize them serially.
+	virtual bool reentrant() const { return false; }
+
+	/// Get number of values kept per source with SoundSource::spatializerState()
+
+	/// AudioScene allocates them on the control thread when sources and
+	/// listeners are added, when the number of frames changes and in
+	/// AudioScene::updateSourceStates(). The default keeps none.
+	virtual unsigned sourceStateSize() const { return 0; }
+
 	/// Print out information about spatializer
 	virtual void print(){}
 
 	/// Get number of speakers
 	int numSpeakers() const { return mSpeakers.size(); }
 
+	/// Get number of output channels written, up to the highest speaker device channel
+	int numDeviceChannels() const {
+		unsigned n = 0;
+		for(unsigned i=0; i<mSpeakers.size(); ++i) n = std::max(n, mSpeakers[i].deviceChannel + 1);
+		return n;
+	}
+
 	/// Set number of frames
 	virtual void numFrames(int v){ mNumFrames = v;}
 
@@ -386,6 +570,20 @@ public:
 	void setEnabled(bool _enable) {mEnabled = _enable;}
 
 protected:
+	/// Add input to output with a gain ramped linearly across the block
+
+	/// The gain reaches gainTo on the last frame, so consecutive blocks
+	/// ramped from the previous block's gain are free of steps.
+	static void addRamped(float * out, const float * in, int numFrames, float gainFrom, float gainTo){
+		if(gainFrom == gainTo){
+			for(int i=0; i<numFrames; ++i) out[i] += in[i] * gainTo;
+		}
+		else{
+			float inc = (gainTo - gainFrom) / numFrames;
+			for(int i=0; i<numFrames; ++i) out[i] += in[i] * (gainFrom + inc * (i+1));
+		}
+	}
+
 	/// Render each source per sample
 	virtual void perform(AudioIOData& io,
 	                     SoundSource& src,
@@ -423,6 +621,11 @@ protected:
 
 
 /// An audio scene consisting of Listeners and Sources.
+
+/// Sources and listeners may be added and removed while the scene is being
+/// rendered. Changes are queued by the calling (control) thread and applied
+/// by render() at the start of the next block, without locks or memory
+/// allocation on the audio thread. Only one thread may make changes.
 ///
 /// @ingroup allocore
 class AudioScene {
@@ -432,7 +635,7 @@ public:
 	typedef std::vector<Listener *> Listeners;
 
 	/// A set of sources
-	typedef std::list<SoundSource *> Sources;
+	typedef std::vector<SoundSource *> Sources;
 
 
 	/// @param[in] numFrames	block size of audio buffers
@@ -442,30 +645,114 @@ public:
 
 
 	/// Get listeners
+
+	/// These are the listeners rendered in the last block. Changes that are
+	/// still pending are not included. This must only be accessed from the
+	/// audio thread or while the scene is not being rendered.
 	Listeners& listeners(){ return mListeners; }
 	const Listeners& listeners() const { return mListeners; }
 
 	/// Get sources
+
+	/// These are the sources rendered in the last block. Changes that are
+	/// still pending are not included. This must only be accessed from the
+	/// audio thread or while the scene is not being rendered.
 	Sources& sources(){ return mSources; }
 	const Sources& sources() const { return mSources; }
 
+	/// Set block size of audio buffers
+
+	/// This must not be called while render() is running.
+	///
 	void numFrames(int v);
 
 	/// Create a new listener for this scene using the given spatializer
 
 	/// The returned Listener is allocated internally and will be deleted
-	/// in the AudioScene destructor.
+	/// in the AudioScene destructor. It is rendered from the next block on.
 	Listener * createListener(Spatializer * spatializer);
 
 	/// Add a sound source to scene
+
+	/// The source is rendered from the next block on.
+	///
 	void addSource(SoundSource& src);
 
 	/// Remove a sound source from scene
+
+	/// The source is removed at the start of the next block. The caller must
+	/// wait for pendingChanges() to return 0 before deleting the source, as
+	/// the audio thread may render it until then. Make the source inactive
+	/// for a block before removing it to fade it out.
 	void removeSource(SoundSource& src);
 
+	/// Reallocate the state the spatializers keep for each source
+
+	/// Call this after changing a setting of a spatializer that changes its
+	/// Spatializer::sourceStateSize(), such as its ambisonic order. Until the
+	/// change is applied, the spatializer renders sources without ramping.
+	void updateSourceStates();
+
+	/// Get number of changes to sources and listeners not yet applied by render()
+	unsigned pendingChanges();
+
 	/// Perform rendering
+
+	/// Before rendering, sources are culled that are inactive, out of reach
+	/// of the delay line for every listener, beyond their far clip distance
+	/// (see cullFarSources()), below the cull threshold or outside of the
+	/// source budget (see maxSources()). A source leaving the rendered set is
+	/// faded out over one block and one entering is faded in over one block.
 	void render(AudioIOData& io);
 
+	/// Set maximum number of sources rendered per block (0 for no limit)
+
+	/// When more sources pass culling, those with the highest priority x
+	/// attenuation x level are rendered, where the level is the RMS of the
+	/// source's delay line over the block about to be heard by the nearest
+	/// listener. Sources rendered in the last block are favored by 2 dB so
+	/// that sources of similar loudness do not swap in and out every block.
+	void maxSources(int n){ mMaxSources = n; }
+	/// Get maximum number of sources rendered per block
+	int maxSources() const { return mMaxSources; }
+
+	/// Set amplitude below which sources are culled (0 by default, which culls none)
+
+	/// The amplitude is the attenuation times the level of the source, as
+	/// ranked by maxSources().
+	void cullThreshold(float v){ mCullThreshold = v; }
+	/// Get amplitude below which sources are culled
+	float cullThreshold() const { return mCullThreshold; }
+
+	/// Set whether to cull sources beyond their far clip distance from all listeners (false by default)
+	void cullFarSources(bool v){ mCullFar = v; }
+	/// Get whether sources beyond their far clip distance are culled
+	bool cullFarSources() const { return mCullFar; }
+
+	/// Set amount of air absorption (0 by default, which disables it)
+
+	/// Each source is lowpassed by its distance to each listener. At 1, the
+	/// filter follows the absorption of high frequencies by air at 20 C and
+	/// 50% relative humidity, for distances in meters: about 3 dB at 14 kHz
+	/// for 10 m and at 4 kHz for 100 m. Larger amounts exaggerate the effect.
+	/// The filters of many sources run together in a BiquadBank.
+	void airAbsorption(float v){ mAirAbsorption = v; }
+	/// Get amount of air absorption
+	float airAbsorption() const { return mAirAbsorption; }
+
+	/// Set reverb fed by the reverb sends of sources (none by default)
+
+	/// The sources are sent as heard at the position of the first listener,
+	/// after distance attenuation and air absorption. The reverb adds its
+	/// outputs to its own device channels after the listeners are rendered.
+	/// Set the reverb to NULL before destroying it.
+	void reverb(FDNReverb * v){ mReverb = v; }
+	/// Get reverb fed by the reverb sends of sources
+	FDNReverb * reverb() const { return mReverb; }
+
+	/// Get number of sources rendered in the last block, including those fading out
+	int numRenderedSources() const { return mRendered.size(); }
+
 	/// Set per sample processing (false by default)
 	/// Per sample processing is useful for smoother doppler and gain
 	/// interpolation for high-speed sources, but uses much more CPU.
@@ -478,12 +765,142 @@ public:
 		mPerSampleProcessing = shouldUsePerSampleProcessing;
 	}
 
+	/// Set number of threads used to render sources (1 by default)
+
+	/// The sources are split into numThreads contiguous partitions. The first
+	/// partition is rendered by the thread calling render() and the others by
+	/// a persistent pool of numThreads-1 worker threads. Each partition is
+	/// rendered into its own scratch output buses, which are summed into the
+	/// AudioIOData at the end of the block, so the output matches the serial
+	/// path within float rounding. Any partition that a worker has not picked
+	/// up by the time the calling thread is free is rendered by the calling
+	/// thread. The calling thread spins only briefly on a partition a worker
+	/// is still rendering, then sleeps until it is done.
+	///
+	/// With several listeners, the partitions first compute the source
+	/// signals, once for each distinct listener position, and then render
+	/// whole listeners concurrently, each into the buses of one partition.
+	/// A spatializer must therefore not be shared by several listeners.
+	///
+	/// The buses are allocated here and by numFrames(), for the device
+	/// channels of the listeners created so far, so call this after creating
+	/// the listeners. Blocks with a listener writing more channels than the
+	/// buses hold are rendered serially. This must not be called while
+	/// render() is running.
+	///
+	/// @param[in] numThreads	total number of render threads; 1 renders serially
+	/// @param[in] priority		priority of worker threads in [0, 99]. It
+	///							should match that of the audio thread. If
+	///							the system refuses it, a warning is printed
+	///							and the worker is not started, leaving its
+	///							partition to the calling thread.
+	void numThreads(int numThreads, int priority = 90);
+
+	/// Get number of threads used to render sources
+	int numThreads() const;
+
+	/// Get seconds taken to render a partition of sources in the last block
+
+	/// When there are several listeners, this is the total for all listeners.
+	///
+	double threadTime(int partition) const;
+
 protected:
+	class ParallelRenderer;
+	friend class ParallelRenderer;
+
+	// Control thread: size the output buses of the render partitions
+	void resizeParallelBuses();
+
+	// Per source storage. When sources outgrow it, the control thread
+	// allocates larger storage that the audio thread fills and swaps in. The
+	// old storage is then sent back to the control thread to be freed.
+	struct SourceStorage{
+		Sources sources;
+		std::vector<SoundSource *> rendered;
+		std::vector<std::pair<float, SoundSource *> > ranked;
+		std::vector<float> buffers;
+		// State of each source for more listeners, when listeners outgrow theirs
+		std::vector<std::pair<SoundSource *, std::vector<std::pair<double, double> > > > positionStates;
+		std::vector<std::pair<SoundSource *, std::vector<float> > > airStates;
+		std::vector<std::pair<SoundSource *, SoundSource::SpatializerStates> > spatializerStates;
+	};
+
+	// A change to the scene queued by the control thread
+	struct Change{
+		enum Type{ ADD_SOURCE, REMOVE_SOURCE, ADD_LISTENER, GROW_SOURCES, GROW_LISTENERS, SOURCE_STATES };
+		Type type;
+		SoundSource * source;
+		Listener * listener;
+		SourceStorage * sources;	// storage to swap in for GROW_SOURCES and SOURCE_STATES
+		Listeners * listeners;			// storage to swap in for GROW_LISTENERS
+	};
+
 	Listeners mListeners;
 	Sources mSources;
 	int mNumFrames;				// audio frames per block
 	std::vector<float> mBuffer;	// temporary frame buffer
 	bool mPerSampleProcessing;
+	ParallelRenderer * mParallel;
+	int mMaxSources;
+	float mCullThreshold;
+	bool mCullFar;
+	std::vector<SoundSource *> mRendered;	// sources that passed culling, in scene order
+	std::vector<std::pair<float, SoundSource *> > mRanked;	// loudness of sources competing for the budget
+	std::vector<float> mSourceBuffers;		// signal of each rendered source, for parallel rendering
+	float mAirAbsorption;
+	float mAirAmount;						// air absorption latched for the block
+	enum{ AIR_LANES = 16 };					// source signals filtered together
+	BiquadBank mAir;						// air absorption of sources rendered serially
+	FDNReverb * mReverb;
+	std::vector<float> mReverbBus;			// sum of reverb sends
+
+	SingleRWRingBuffer mChanges;	// control to audio thread
+	SingleRWRingBuffer mGarbage;	// storage to free, audio to control thread
+	enum{ GARBAGE_SLOTS = 64 };		// storage swaps queued or not yet freed, at most
+	unsigned mGrowsInFlight;		// storage swaps queued or not yet freed
+	std::vector<Change> mOverflow;	// changes waiting for space in mChanges
+	Sources mRegistered;			// sources as seen by the control thread
+	std::vector<Spatializer *> mSpatializers;	// spatializers of listeners, as seen by the control thread
+	int mSourceCapacity, mNumListeners, mListenerCapacity;
+	unsigned mNumSent;
+	std::atomic<unsigned> mNumApplied;
+
+	// Control thread: queue change, growing the storage first if needed
+	void sendChange(const Change& c);
+	// Control thread: write change to the queue if there is room for it
+	bool queueChange(const Change& c);
+	// Control thread: free returned storage and queue overflowed changes
+	void flushChanges();
+	// Audio thread: apply queued changes
+	void applyChanges();
+	SourceStorage * newSourceStorage(int capacity);
+	// Control thread: allocate the state of a source for each spatializer
+	SoundSource::SpatializerStates newSpatializerStates() const;
+	// Audio thread: swap in the source state of a GROW_SOURCES or SOURCE_STATES change
+	void swapSourceStates(SourceStorage& st);
+
+	// Select sources to render in this block and set their fade gains
+	void cullSources();
+
+	// Find the first listener at the position of each listener, in this
+	// block and the last. Source state and signals are kept for each listener
+	// index, and listeners at the same position use those of the first.
+	void groupListeners();
+	// Signal of rendered source at a listener position
+	float * sourceBuffer(int s, int position){ return &mSourceBuffers[(s * mListeners.size() + position) * mNumFrames]; }
+	// Compute signals of a rendered source at all listener positions
+	void getSourceBuffers(int s);
+	// Apply air absorption to signals of a range of rendered sources
+	void absorbSources(int begin, int end, BiquadBank& bank);
+	// Sum reverb sends of rendered sources into the reverb bus
+	void sendSources();
+	// Spatialize all rendered sources for a listener
+	void renderListener(Listener& l, AudioIOData& io);
+	// Compute signal of a source as heard by a listener
+	void getSourceBuffer(Listener& l, SoundSource& src, float * buffer);
+	// Spatialize source signal
+	void spatializeSource(Listener& l, SoundSource& src, const float * buffer, AudioIOData& io);
 };
 
 } // al::
@@ -0,0 +1,284 @@
+#ifndef INCLUDE_AL_BINAURAL
+#define INCLUDE_AL_BINAURAL
+
+/*	Allocore --
+	Multimedia / virtual environment application class library
+
+	Copyright (C) 2009. AlloSphere Research Group, Media Arts & Technology, UCSB.
+	Copyright (C) 2012. The Regents of the University of California.
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+		Redistributions of source code must retain the above copyright notice,
+		this list of conditions and the following disclaimer.
+
+		Redistributions in binary form must reproduce the above copyright
+		notice, this list of conditions and the following disclaimer in the
+		documentation and/or other materials provided with the distribution.
+
+		Neither the name of the University of California nor the names of its
+		contributors may be used to endorse or promote products derived from
+		this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+
+
+	File description:
+	Binaural spatializer using head-related impulse responses (HRIRs)
+
+	File author(s):
+	AlloSystem contributors
+*/
+
+#include <string>
+#include <vector>
+
+#include "allocore/sound/al_AudioScene.hpp"
+
+namespace al{
+
+/// A set of head-related impulse responses
+
+/// Each measurement is a pair of impulse responses, for the left and right
+/// ears, of a direction given in the coordinates of Speaker, so that a
+/// source renders through the measurement nearest to the speaker it would
+/// play from in a SpeakerLayout.
+///
+/// @ingroup allocore
+class HRIRSet{
+public:
+
+	/// @param[in] length		number of samples of each impulse response
+	/// @param[in] sampleRate	sample rate of the impulse responses
+	HRIRSet(int length=0, double sampleRate=44100);
+
+	/// Load measurements from a text file
+
+	/// The file holds whitespace separated numbers. The first two are the
+	/// sample rate and the number of samples of each impulse response. Each
+	/// measurement then follows as its azimuth and elevation, in degrees,
+	/// the left ear samples and the right ear samples. Lines starting with
+	/// '#' are comments.
+	///
+	/// @return whether the file was read; the set is left empty if not
+	bool load(const std::string& path);
+
+	/// Add a measurement
+
+	/// @param[in] azimuth		azimuth in degrees, as for Speaker
+	/// @param[in] elevation	elevation in degrees, as for Speaker
+	/// @param[in] left			length() samples of left ear response
+	/// @param[in] right		length() samples of right ear response
+	void add(float azimuth, float elevation, const float * left, const float * right);
+
+	/// Remove all measurements and set the length of impulse responses
+	void clear(int length, double sampleRate);
+
+	/// Get number of measurements
+	int size() const { return mDirections.size(); }
+
+	/// Get number of samples of each impulse response
+	int length() const { return mLength; }
+
+	/// Get sample rate of the impulse responses
+	double sampleRate() const { return mSampleRate; }
+
+	/// Get azimuth of a measurement, in degrees
+	float azimuth(int i) const { return mAzimuths[i]; }
+
+	/// Get elevation of a measurement, in degrees
+	float elevation(int i) const { return mElevations[i]; }
+
+	/// Get direction of a measurement as a unit vector, as Speaker::vec()
+	const Vec3f& direction(int i) const { return mDirections[i]; }
+
+	/// Get impulse response of a measurement for the left (0) or right (1) ear
+	const float * ir(int i, int ear) const { return &mSamples[(2*i + ear) * mLength]; }
+
+private:
+	int mLength;
+	double mSampleRate;
+	std::vector<float> mAzimuths, mElevations;
+	std::vector<Vec3f> mDirections;
+	std::vector<float> mSamples;
+};
+
+
+
+/// How BinauralSpatializer renders sources
+enum BinauralMode{
+	BINAURAL_DIRECT=0,		/**< Convolve each source with the HRIRs nearest to its direction */
+	BINAURAL_AMBISONIC		/**< Encode sources into an Ambisonic bus rendered through virtual speakers */
+};
+
+
+/// Binaural spatializer for headphones
+
+/// Sources are convolved with head-related impulse responses using uniformly
+/// partitioned convolution in the frequency domain, with one partition per
+/// audio block. The output adds no latency.
+///
+/// In BINAURAL_DIRECT mode, each source is convolved with the measurement
+/// nearest to its direction. When a source moves to another measurement,
+/// the block is rendered with both and crossfaded. A source takes one
+/// forward FFT per block; the convolved spectra of all sources are summed,
+/// so the inverse FFTs are shared.
+///
+/// In BINAURAL_AMBISONIC mode, sources are only encoded into an Ambisonic
+/// bus, whose channels are convolved with filters combining a decode to
+/// virtual speakers with their HRIRs. The cost does not grow with the
+/// number of sources, at the price of the spatial resolution of the order.
+/// Sources rendered with renderBuffer() or renderSample(), which have no
+/// state of their own, always take this path.
+///
+/// The first speaker of the layout receives the left ear and the second
+/// the right ear.
+///
+/// @ingroup allocore
+class BinauralSpatializer : public Spatializer{
+public:
+
+	/// @param[in] sl	A speaker layout of the left and right ears
+	BinauralSpatializer(const SpeakerLayout& sl = HeadsetSpeakerLayout());
+
+	/// @param[in] hrirs	HRIRs to render with
+	/// @param[in] sl		A speaker layout of the left and right ears
+	BinauralSpatializer(const HRIRSet& hrirs, const SpeakerLayout& sl = HeadsetSpeakerLayout());
+
+	/// Set HRIRs to render with
+
+	/// This partitions and transforms the impulse responses, so it must not
+	/// be called while rendering. See sourceStateSize() for the state kept
+	/// in sources.
+	void hrirs(const HRIRSet& v);
+
+	/// Load HRIRs from a file, as HRIRSet::load()
+	bool load(const std::string& path);
+
+	/// Get HRIRs
+	const HRIRSet& hrirs() const { return mHRIRs; }
+
+	/// Set how sources are rendered; must not be called while rendering
+	void mode(BinauralMode v);
+
+	/// Get how sources are rendered
+	BinauralMode mode() const { return mMode; }
+
+	/// Set order of the Ambisonic bus (1 to 5, 3 by default)
+
+	/// The bus is rendered through about 2(order+1)^2 virtual speakers,
+	/// placed at the measurements nearest to directions spread evenly over
+	/// the sphere. This must not be called while rendering.
+	void ambisonicOrder(int v);
+
+	/// Get order of the Ambisonic bus
+	int ambisonicOrder() const { return mAmbiOrder; }
+
+	/// Get number of virtual speakers of the Ambisonic bus
+	int numVirtualSpeakers() const { return mVirtualSpeakers.size(); }
+
+	/// Find the measurement nearest to a direction
+
+	/// @param[in] dir		unit vector, in the coordinates of Speaker::vec()
+	/// @param[in] hint		measurement to start the search from, ex. the
+	///						last one found for a source; ignored if out of range
+	int findHRIR(const Vec3f& dir, int hint = -1) const;
+
+	virtual void numFrames(int v) override;
+
+	virtual void prepare() override;
+
+	virtual void renderBuffer(AudioIOData& io, const Pose& reldir, const float *samples, const int& numFrames) override;
+	virtual void renderSample(AudioIOData& io, const Pose& reldir, const float& sample, const int& frameIndex) override;
+
+	/// Convolve source with its nearest HRIRs, or encode it ramping from its
+	/// Ambisonic weights in the last block
+	virtual void renderSourceBuffer(AudioIOData& io, const Pose& reldir, const float *samples, const int& numFrames, SoundSource& src) override;
+
+	/// Gather source samples into a block, which is rendered as by
+	/// renderSourceBuffer() when the last frame arrives
+	virtual void renderSourceSample(AudioIOData& io, const Pose& reldir, const float& sample, const int& frameIndex, SoundSource& src) override;
+
+	/// Get number of values kept per source
+
+	/// These hold its input window and spectra, or its Ambisonic weights.
+	/// There is room for either mode and any Ambisonic order, so mode() and
+	/// ambisonicOrder() keep the state. The length of the HRIRs changes it:
+	/// after hrirs() or load(), call AudioScene::updateSourceStates(), or
+	/// SoundSource::reserveSpatializerState() for sources rendered directly.
+	/// Until then sources are rendered through the Ambisonic bus.
+	virtual unsigned sourceStateSize() const override;
+
+	/// Transform the summed spectra to the ears
+	virtual void finalize(AudioIOData& io) override;
+
+	virtual void print() override;
+
+private:
+	HRIRSet mHRIRs;
+	BinauralMode mMode;
+	int mAmbiOrder;
+
+	int mPartSize;					// samples per partition, the block size
+	int mFFTSize;					// power of two, at least twice mPartSize
+	int mNumBins;					// mFFTSize/2 + 1
+	int mNumParts;					// partitions of each impulse response
+	std::vector<float> mFFTTwiddles;	// of complex FFT of mFFTSize/2 points
+	std::vector<float> mRealTwiddles;	// to split it into a real FFT
+	std::vector<int> mBitReverse;
+
+	// Spectra are stored with all real parts followed by all imaginary parts
+	std::vector<float> mFilters;	// per measurement, ear and partition
+	std::vector<int> mNeighbors;	// nearest measurements of each measurement
+
+	// Ambisonic bus
+	std::vector<int> mVirtualSpeakers;
+	std::vector<float> mAmbiFilters;// per channel, ear and partition
+	std::vector<float> mAmbiBus;	// channels of the current block
+	std::vector<float> mAmbiInput;	// input windows of channels
+	std::vector<float> mAmbiSpectra;// delay lines of input spectra
+	int mAmbiSlot;
+	int mAmbiTail;					// blocks until the bus is silent
+
+	// Spectra summed across sources: for each ear, the current filters and
+	// the difference between the previous and current filters of sources
+	// that changed measurement in this block
+	std::vector<float> mSum;
+	std::vector<float> mWork;
+	unsigned mBlock;
+	bool mRendered, mFaded;
+	float mAmbiWeights[36];
+
+	void init();
+	void rebuild();
+	int spectrumSize() const { return 2 * mNumBins; }
+	float * filter(int hrir, int ear, int part){ return &mFilters[((hrir*2 + ear)*mNumParts + part) * spectrumSize()]; }
+	float * sum(int ear, int which){ return &mSum[(ear*2 + which) * spectrumSize()]; }
+
+	void complexFFT(float * z, bool inverse) const;
+	void forwardFFT(float * spectrum, const float * input);
+	void inverseFFT(float * output, const float * spectrum) const;
+	void convolve(float * out, const float * spectra, int slot, const float * filters, float gain) const;
+
+	float * sourceState(SoundSource& src);
+	void convolveSource(float * state, const Pose& reldir);
+	void encode(const Pose& reldir);
+	void renderAmbi();
+};
+
+
+} // al::
+
+#endif
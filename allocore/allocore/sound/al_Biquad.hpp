@@ -5,6 +5,8 @@
 #ifndef __AL_BIQUAD__
 #define __AL_BIQUAD__
 
+#include <vector>
+
 namespace al
 {
     
@@ -73,6 +75,101 @@ private:
     BiQuad *mFilters;
 };
 
+/// Bank of independent biquad filters processing many channels at once
+///
+/// Each channel, or lane, runs its own cascade of numStages() biquads with
+/// its own coefficients, so a bank can, for example, lowpass every output
+/// channel for bass management or give every sound source its own air
+/// absorption. The filters are in transposed direct form II and the lanes
+/// are laid out side by side in memory, eight at a time, so that the
+/// compiler processes them in vector registers.
+///
+/// A tiny offset is added to the input of each stage so that the state
+/// never decays into denormal numbers when the input falls silent.
+///
+/// Coefficients and state may be changed per lane between calls to
+/// process() without allocating; only resize() allocates.
+///
+/// @ingroup allocore
+class BiquadBank
+{
+public:
+
+    /// Number of lanes processed together
+    static const int LANES_PER_GROUP = 8;
+
+    /// @param[in] numLanes     number of independent channels
+    /// @param[in] numStages    number of cascaded biquads per channel
+    /// @param[in] sampleRate   sample rate for set()
+    BiquadBank(int numLanes = 0, int numStages = 1, double sampleRate = 44100);
+
+    /// Set number of lanes and stages; all lanes are reset and bypassed
+    void resize(int numLanes, int numStages = 1);
+
+    int numLanes() const { return mNumLanes; }
+    int numStages() const { return mNumStages; }
+
+    void setSampleRate(double rate){ mSampleRate = rate; }
+    double sampleRate() const { return mSampleRate; }
+
+    /// Design a filter for one lane, as BiQuad::set()
+
+    /// @param[in] stage    stage to set, or -1 for every stage of the lane
+    void set(int lane, BIQUADTYPE type, double freq, double bandwidth = 1.9, double dbGain = 0, int stage = -1);
+
+    /// Set coefficients of one stage of a lane
+
+    /// The transfer function is (b0 + b1 z^-1 + b2 z^-2) / (1 + a1 z^-1 + a2 z^-2).
+    void coefficients(int lane, int stage, double b0, double b1, double b2, double a1, double a2);
+
+    /// Let a lane, or one stage of it, pass its input unchanged
+    void bypass(int lane, int stage = -1);
+
+    /// Clear state of all lanes
+    void reset();
+
+    /// Clear state of one lane
+    void reset(int lane);
+
+    /// Number of floats of state per lane for getState() and setState()
+    int stateSize() const { return 2 * mNumStages; }
+
+    /// Copy out state of a lane, ex. to keep it with the object it filters
+    void getState(int lane, float * state) const;
+
+    /// Copy in state of a lane
+    void setState(int lane, const float * state);
+
+    /// Filter one block of every lane
+
+    /// @param[out] out         output buffers of the lanes, may equal in
+    /// @param[in]  in          input buffers of the lanes
+    /// @param[in]  numFrames   number of frames to filter
+    /// @param[in]  lanes       number of lanes to filter, from the first;
+    ///                         -1 for all. The state of the others is undefined.
+    void process(float * const * out, const float * const * in, int numFrames, int lanes = -1);
+
+    /// Filter one block of every lane in place
+    void process(float * const * buffers, int numFrames){ process(buffers, buffers, numFrames); }
+
+    /// Filter in place a block of channels stored one after another
+    void process(float * buffer, int numFrames);
+
+private:
+    enum{ CHUNK = 64 };         // frames interleaved at a time
+    int mNumLanes, mNumStages;
+    int mNumGroups;             // groups of LANES_PER_GROUP lanes
+    double mSampleRate;
+    std::vector<float> mCoefs;  // b0 b1 b2 a1 a2 per stage and group
+    std::vector<float> mState;  // s1 s2 per stage and group
+    std::vector<float> mFrames; // CHUNK frames of all lanes interleaved
+    std::vector<float *> mPtrs;
+
+    float * coef(int stage, int group){ return &mCoefs[(stage*mNumGroups + group) * 5 * LANES_PER_GROUP]; }
+    float * state(int stage, int group){ return &mState[(stage*mNumGroups + group) * 2 * LANES_PER_GROUP]; }
+    const float * state(int stage, int group) const { return &mState[(stage*mNumGroups + group) * 2 * LANES_PER_GROUP]; }
+};
+
 }
 
 #endif /* defined(__AL_BIQUAD__) */
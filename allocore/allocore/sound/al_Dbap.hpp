@@ -58,7 +58,18 @@ public:
 	/// @param[in] focus	Amplitude focus to nearby speakers
 	Dbap(const SpeakerLayout &sl, float focus = 1.f);
 
-	void compile(Listener& listener);
+	virtual void compile(Listener& listener) override;
+
+	virtual void renderSample(AudioIOData& io, const Pose& reldir, const float& sample, const int& frameIndex) override;
+	virtual void renderBuffer(AudioIOData& io, const Pose& reldir, const float *samples, const int& numFrames) override;
+
+	/// Render source, ramping from the source's gains in the last block
+	virtual void renderSourceBuffer(AudioIOData& io, const Pose& reldir, const float *samples, const int& numFrames, SoundSource& src) override;
+
+	virtual bool reentrant() const override { return true; }
+
+	/// Get number of values kept per source, the gains of each speaker
+	virtual unsigned sourceStateSize() const override { return mNumSpeakers; }
 
 	///Per Sample Processing
 	void perform(AudioIOData& io, SoundSource& src, Vec3d& relpos, const int& numFrames, int& frameIndex, float& sample);
@@ -72,14 +83,26 @@ public:
 	///A denser speaker layout my benefit from a high focus > 1, and a sparse layout may benefit from focus < 1
 	void setFocus(float focus) { mFocus = focus; }
 
-	void print();
+	virtual void print() override;
 
 private:
 	Listener * mListener;
-	Vec3f mSpeakerVecs[DBAP_MAX_NUM_SPEAKERS];
+	// Speaker positions are kept as separate coordinate arrays so that the
+	// gains of all speakers are computed in one vectorizable loop
+	float mSpeakerX[DBAP_MAX_NUM_SPEAKERS];
+	float mSpeakerY[DBAP_MAX_NUM_SPEAKERS];
+	float mSpeakerZ[DBAP_MAX_NUM_SPEAKERS];
 	int mDeviceChannels[DBAP_MAX_NUM_SPEAKERS];
 	int mNumSpeakers;
 	float mFocus;
+
+	void loadSpeakers();
+
+	/// Compute gains of all speakers for a position relative to the listener
+	void computeGains(const Vec3f& relpos, float * gains) const;
+
+	void renderBuffer(AudioIOData& io, const float * gains, const float *samples, int numFrames);
+	void renderSourceBuffer(AudioIOData& io, const float * gains, const float *samples, int numFrames, SoundSource& src);
 };
 
 
@@ -0,0 +1,183 @@
+#ifndef INCLUDE_AL_FDN_REVERB_HPP
+#define INCLUDE_AL_FDN_REVERB_HPP
+
+/*	Allocore --
+	Multimedia / virtual environment application class library
+
+	Copyright (C) 2009. AlloSphere Research Group, Media Arts & Technology, UCSB.
+	Copyright (C) 2012. The Regents of the University of California.
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+		Redistributions of source code must retain the above copyright notice,
+		this list of conditions and the following disclaimer.
+
+		Redistributions in binary form must reproduce the above copyright
+		notice, this list of conditions and the following disclaimer in the
+		documentation and/or other materials provided with the distribution.
+
+		Neither the name of the University of California nor the names of its
+		contributors may be used to endorse or promote products derived from
+		this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+
+
+	File description:
+	Multichannel feedback delay network reverberator
+
+	File author(s):
+	AlloSystem contributors
+*/
+
+
+#include <vector>
+
+#include "allocore/io/al_AudioIO.hpp"
+#include "allocore/sound/al_Biquad.hpp"
+#include "allocore/sound/al_Speaker.hpp"
+
+namespace al{
+
+/// Feedback matrix of FDNReverb
+enum FDNMatrix{
+	FDN_HADAMARD=0,		/**< Normalized Hadamard matrix, applied in O(N log N); mixes every line into every other */
+	FDN_HOUSEHOLDER		/**< Householder reflection, applied in O(N); cheaper, with sparser early echoes */
+};
+
+
+/// Multichannel feedback delay network reverberator
+
+/// The reverberator feeds a mono input into a network of delay lines of
+/// mutually prime lengths, whose outputs are mixed by a lossless feedback
+/// matrix and fed back into the lines. Each line attenuates its output by a
+/// low shelf, a high shelf and a broadband gain so that low, middle and high
+/// frequencies decay to -60 dB after their own reverberation times.
+///
+/// Each output is taken from its own line, so the outputs are mutually
+/// decorrelated and a diffuse tail can be played from every speaker of a
+/// large array. The number of lines is the number of outputs rounded up to a
+/// power of two, and at least 8, so the cost grows about linearly with the
+/// number of outputs.
+///
+/// Signals are processed a block at a time, one block per line, up to the
+/// length of the shortest line. The feedback matrix and the filters then
+/// run over whole blocks and are vectorized by the compiler. The tail
+/// starts after the shortest line, about 30 ms at size 1.
+///
+/// @ingroup allocore
+class FDNReverb{
+public:
+
+	/// @param[in] numOutputs	number of decorrelated outputs, written to
+	///							device channels 0 to numOutputs-1
+	/// @param[in] sampleRate	sample rate
+	/// @param[in] size			scale of delay line lengths; 1 gives lines
+	///							of about 30 to 90 ms
+	FDNReverb(int numOutputs=8, double sampleRate=44100, float size=1);
+
+	/// @param[in] sl			speakers to write one output each to
+	/// @param[in] sampleRate	sample rate
+	/// @param[in] size			scale of delay line lengths
+	FDNReverb(const SpeakerLayout& sl, double sampleRate=44100, float size=1);
+
+
+	/// Set reverberation time, in seconds, of all frequencies
+	FDNReverb& decay(float rt60){ return decay(rt60, rt60, rt60); }
+
+	/// Set reverberation times, in seconds, below, between and above the crossovers
+	FDNReverb& decay(float low, float mid, float high);
+
+	/// Set crossover frequencies of the decay filters, in Hz
+	FDNReverb& crossover(float low, float high);
+
+	/// Set feedback matrix
+	FDNReverb& matrix(FDNMatrix v){ mMatrix=v; return *this; }
+
+	/// Set gain of outputs
+	FDNReverb& gain(float v){ mGain=v; return *this; }
+
+	/// Set scale of delay line lengths
+
+	/// This reallocates and clears the delay lines, so it must not be called
+	/// while rendering.
+	FDNReverb& size(float v);
+
+	/// Set device channel of an output
+	FDNReverb& channel(int output, int deviceChannel){ mChannels[output]=deviceChannel; return *this; }
+
+
+	float decayLow() const { return mDecay[0]; }
+	float decayMid() const { return mDecay[1]; }
+	float decayHigh() const { return mDecay[2]; }
+	float crossoverLow() const { return mCrossover[0]; }
+	float crossoverHigh() const { return mCrossover[1]; }
+	FDNMatrix matrix() const { return mMatrix; }
+	float gain() const { return mGain; }
+	float size() const { return mSize; }
+	double sampleRate() const { return mSampleRate; }
+
+	/// Get number of outputs
+	int numOutputs() const { return mChannels.size(); }
+
+	/// Get device channel of an output
+	int channel(int output) const { return mChannels[output]; }
+
+	/// Get number of delay lines
+	int numLines() const { return mLength.size(); }
+
+	/// Get length, in samples, of a delay line
+	int lineLength(int i) const { return mLength[i]; }
+
+
+	/// Process a block of input and write outputs to separate buffers
+
+	/// @param[out] outs		numOutputs() buffers that outputs are added to
+	/// @param[in]  in			mono input
+	/// @param[in]  numFrames	number of frames
+	void process(float * const * outs, const float * in, int numFrames);
+
+	/// Process a block of input and add outputs to device channels of io
+	void render(AudioIOData& io, const float * in, int numFrames);
+
+	/// Clear delay lines and filters
+	void zero();
+
+private:
+	enum{ CHUNK = 128 };		// largest block processed at once
+	std::vector<int> mChannels;
+	std::vector<int> mLength;	// of each line
+	std::vector<int> mPos;		// oldest sample of each line
+	std::vector<int> mOffset;	// of each line in mLines
+	std::vector<float> mLines;	// lines, one after another
+	std::vector<float> mLineGain;	// broadband gain of each line
+	std::vector<float> mTaps;	// CHUNK outputs of each line
+	std::vector<float> mMix;	// CHUNK mixed outputs of each line
+	std::vector<float *> mTapPtrs, mOutPtrs;
+	BiquadBank mFilters;		// shelves of each line
+	FDNMatrix mMatrix;
+	double mSampleRate;
+	float mSize, mGain;
+	float mDecay[3], mCrossover[2];
+
+	void init(int numOutputs);
+	void updateFilters();
+	float * line(int i){ return &mLines[mOffset[i]]; }
+};
+
+
+} // al::
+
+#endif
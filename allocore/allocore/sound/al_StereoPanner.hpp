@@ -79,6 +79,7 @@ public:
 		}
 	}
 
+	virtual bool reentrant() const override { return true; }
 
 private:
 	Listener* mListener;
@@ -103,6 +103,17 @@ public:
 	virtual void renderSample(AudioIOData& io, const Pose& reldir, const float& sample, const int& frameIndex) override;
 	virtual void renderBuffer(AudioIOData& io, const Pose& reldir, const float *samples, const int& numFrames) override;
 
+	/// Render source, starting the triplet search from the source's last triplet
+	virtual void renderSourceSample(AudioIOData& io, const Pose& reldir, const float& sample, const int& frameIndex, SoundSource& src) override;
+	/// Render source, starting the triplet search from the source's last
+	/// triplet and ramping from the source's gains in the last block
+	virtual void renderSourceBuffer(AudioIOData& io, const Pose& reldir, const float *samples, const int& numFrames, SoundSource& src) override;
+
+	virtual bool reentrant() const override { return true; }
+
+	/// Get number of values kept per source, the gains of each device channel
+	virtual unsigned sourceStateSize() const override { return 2 * numDeviceChannels(); }
+
 	virtual void print() override;
 
 	/// Manually add a triple from indeces to speakers
@@ -112,9 +123,27 @@ public:
 	//Returns vector of triplets
 	std::vector<SpeakerTriple> triplets() const;
 
+	/// Find the triplet containing a direction
+
+	/// The hint is tried first, then the triplets that overlap the direction's
+	/// cell in a lookup grid built with the triplets. All triplets are
+	/// searched only if neither contains the direction.
+	///
+	/// @param[in] dir		direction, in the coordinates of Speaker::vec()
+	/// @param[out] gains	unnormalized gains of the triplet's speakers
+	/// @param[in] hint		index of triplet to try first, ex. the last one
+	///						found for a source; ignored if out of range
+	/// @return index of triplet or -1 if no triplet contains the direction
+	int findTriplet(const Vec3d& dir, Vec3d& gains, int hint = -1);
+
+	/// Find the triplet containing a direction by searching all triplets
+	int findTripletLinear(const Vec3d& dir, Vec3d& gains);
+
 private:
 	std::vector<SpeakerTriple> mTriplets;
 	std::map<int, std::vector<int> > mPhantomChannels;
+	std::vector<int> mCellStart;	// index of first candidate of each grid cell
+	std::vector<int> mCellTriplets;	// candidate triplets, grouped by grid cell
 	Listener* mListener;
 	bool mIs3D;
 
@@ -133,6 +162,22 @@ private:
 	/// Manually add triplet of speakers, in case not set automatically
 	void addTriple(const SpeakerTriple& st);
 
+	bool contains(const Vec3d& gains) const {
+		return (gains[0] >= 0) && (gains[1] >= 0) && (!mIs3D || (gains[2] >= 0));
+	}
+
+	/// Build grid of candidate triplets over the sphere (3D) or circle (2D)
+	void buildLookupGrid();
+	int numCells() const;
+	int cellIndex(const Vec3d& dir) const;
+
+	/// Add gains of a triplet to gains of output channels, distributing
+	/// gains of phantom channels
+	void channelGains(const SpeakerTriple& triple, const Vec3d& gains, float * chanGains, int numChannels) const;
+
+	void renderBuffer(AudioIOData& io, const Pose& reldir, const float *samples, const int& numFrames, int& tripletIndex);
+	void renderSample(AudioIOData& io, const Pose& reldir, const float& sample, const int& frameIndex, int& tripletIndex);
+
 };
 
 } // al::
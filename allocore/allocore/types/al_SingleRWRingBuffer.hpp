@@ -42,6 +42,7 @@
 	Graham Wakefield, 2010, grrrwaaa@gmail.com
 */
 
+#include <atomic>
 #include <cstdint>
 #include <cstring> // memcpy
 
@@ -89,17 +90,30 @@ public:
 	*/
 	size_t peek(char * dst, size_t sz);
 
+    /** Get the data available for reading without copying it.
+        The data is returned as up to two contiguous regions, the second
+        one starting at the beginning of the buffer when the data wraps.
+        Returns the total bytes in both regions, at most sz.
+	*/
+	size_t readRegions(const char ** first, size_t * firstSize,
+	                   const char ** second, size_t * secondSize, size_t sz) const;
+
+    /** Advance the read pointer, as after reading sz bytes
+		from readRegions()
+	*/
+	void readAdvance(size_t sz);
+
     /** Clear any data in the ringbuffer
 	*/
     void clear()
     {
-        mRead = mWrite;
+        mRead.store(mWrite.load(std::memory_order_acquire), std::memory_order_release);
     }
 
 protected:
 
 	size_t mSize, mWrap;
-	size_t mRead, mWrite;
+	std::atomic<size_t> mRead, mWrite;	// each is stored by one side only
 	char * mData;
 };
 
@@ -182,6 +196,26 @@ inline size_t SingleRWRingBuffer :: read(char * dst, size_t sz) {
 	return sz;
 }
 
+inline size_t SingleRWRingBuffer :: readRegions(const char ** first, size_t * firstSize,
+                                               const char ** second, size_t * secondSize, size_t sz) const {
+	size_t space = readSpace();
+	sz = sz > space ? space : sz;
+
+	size_t r = mRead;
+	size_t split = mSize-r;
+	*first = mData+r;
+	*second = mData;
+	*firstSize = sz < split ? sz : split;
+	*secondSize = sz - *firstSize;
+	return sz;
+}
+
+inline void SingleRWRingBuffer :: readAdvance(size_t sz) {
+	size_t space = readSpace();
+	sz = sz > space ? space : sz;
+	mRead = (mRead + sz) & mWrap;
+}
+
 inline size_t SingleRWRingBuffer :: peek(char * dst, size_t sz) {
 	size_t space = readSpace();
 	sz = sz > space ? space : sz;
@@ -0,0 +1,124 @@
+#ifndef INCLUDE_AL_TRIPLE_BUFFER_HPP
+#define INCLUDE_AL_TRIPLE_BUFFER_HPP
+
+/*	Allocore --
+	Multimedia / virtual environment application class library
+
+	Copyright (C) 2009. AlloSphere Research Group, Media Arts & Technology, UCSB.
+	Copyright (C) 2012. The Regents of the University of California.
+	All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+		Redistributions of source code must retain the above copyright notice,
+		this list of conditions and the following disclaimer.
+
+		Redistributions in binary form must reproduce the above copyright
+		notice, this list of conditions and the following disclaimer in the
+		documentation and/or other materials provided with the distribution.
+
+		Neither the name of the University of California nor the names of its
+		contributors may be used to endorse or promote products derived from
+		this software without specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+
+
+	File description:
+	Passing the latest value of a variable between a pair of threads without locking
+
+	File author(s):
+	AlloSystem contributors
+*/
+
+
+#include <atomic>
+#include <vector>
+
+namespace al {
+
+/// Lock free single-writer-single-reader snapshot of an array
+
+/// The writer fills the back buffer and publishes it; the reader picks up
+/// the most recently published buffer. Unlike a ring buffer, the writer
+/// never waits for or overruns the reader: snapshots the reader does not
+/// pick up in time are replaced by newer ones. This suits values that are
+/// only interesting when current, such as meter levels passed from an
+/// audio thread to a GUI or network thread.
+///
+/// @ingroup allocore
+template <class T>
+class TripleBuffer {
+public:
+
+	/// @param[in] size		number of elements of each snapshot
+	TripleBuffer(int size=0): mState(FRONT_MIDDLE_BACK){ resize(size); }
+
+	/// Set number of elements of each snapshot; not thread safe
+	void resize(int size){
+		for(int i=0; i<3; ++i) mBuffers[i].assign(size, T());
+	}
+
+	/// Get number of elements of each snapshot
+	int size() const { return mBuffers[0].size(); }
+
+
+	/// Writer: get buffer to fill with the next snapshot
+	T * back(){ return mBuffers[backIndex(mState.load(std::memory_order_relaxed))].data(); }
+
+	/// Writer: publish the back buffer as the latest snapshot
+	void publish(){
+		// Swap back and middle buffers, and mark the middle one as fresh
+		int s = mState.load(std::memory_order_relaxed);
+		int n;
+		do{
+			n = swapBack(s) | FRESH;
+		} while(!mState.compare_exchange_weak(s, n, std::memory_order_acq_rel));
+	}
+
+
+	/// Reader: pick up the latest snapshot, if any was published since the last
+
+	/// @return whether front() now holds a new snapshot
+	bool update(){
+		int s = mState.load(std::memory_order_relaxed);
+		int n;
+		do{
+			if(!(s & FRESH)) return false;
+			n = swapFront(s);
+		} while(!mState.compare_exchange_weak(s, n, std::memory_order_acq_rel));
+		return true;
+	}
+
+	/// Reader: get the snapshot picked up by the last update()
+	const T * front() const { return mBuffers[frontIndex(mState.load(std::memory_order_acquire))].data(); }
+
+private:
+	// The state packs the buffer indices of the front (bits 4-5), middle
+	// (bits 2-3) and back (bits 0-1) buffers, plus a flag (bit 6) set when
+	// the middle buffer holds a snapshot the reader has not picked up.
+	enum{ FRONT_MIDDLE_BACK = (0<<4) | (1<<2) | 2, FRESH = 1<<6 };
+	static int frontIndex(int s){ return (s>>4) & 3; }
+	static int middleIndex(int s){ return (s>>2) & 3; }
+	static int backIndex(int s){ return s & 3; }
+	static int swapBack(int s){ return (frontIndex(s)<<4) | (backIndex(s)<<2) | middleIndex(s); }
+	static int swapFront(int s){ return (middleIndex(s)<<4) | (frontIndex(s)<<2) | backIndex(s); }
+
+	std::vector<T> mBuffers[3];
+	std::atomic<int> mState;
+};
+
+} // al::
+
+#endif
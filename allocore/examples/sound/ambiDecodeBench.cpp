@@ -0,0 +1,74 @@
+/*
+Allocore Example: Ambisonic decode benchmark
+
+Description:
+This measures the time taken to decode a block of 3D Ambisonic domain frames
+for orders 1 to 5 and 8 to 128 speakers. AmbiDecode::decode() is compared
+to a direct loop over speakers, channels and frames that computes the weights
+as it goes.
+
+Author:
+AlloSystem contributors
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "allocore/sound/al_Ambisonics.hpp"
+#include "allocore/system/al_Time.h"
+using namespace al;
+
+// Decode as AmbiDecode did before precomputing its decode matrix
+void decodeDirect(const AmbiDecode& dec, const Speakers& spkrs, float * out, const float * ambi, int numFrames){
+	for(int s=0; s<dec.numSpeakers(); ++s){
+		float * o = out + spkrs[s].deviceChannel * numFrames;
+		for(int c=0; c<dec.channels(); ++c){
+			const float * in = ambi + c * numFrames;
+			float w = dec.decodeWeight(s, c);
+			for(int i=0; i<numFrames; ++i) o[i] += in[i] * w;
+		}
+	}
+}
+
+int main(){
+	const int numFrames = 64;
+	const int numBlocks = 100;
+	const int numTrials = 30;
+	const int speakerCounts[] = {8, 16, 32, 54, 64, 128};
+
+	printf("%5s %8s %9s %12s %12s\n", "order", "speakers", "channels", "direct ns", "decode ns");
+	for(int order=1; order<=5; ++order){
+		for(int numSpeakers : speakerCounts){
+
+			// Speakers spread evenly over the sphere
+			SpeakerLayout layout;
+			for(int s=0; s<numSpeakers; ++s){
+				float el = asin(2.f * (s + 0.5f) / numSpeakers - 1.f) * 57.29578f;
+				float az = fmod(s * 137.50776f, 360.f);
+				layout.addSpeaker(Speaker(s, az, el));
+			}
+			AmbiDecode dec(3, order, numSpeakers);
+			dec.setSpeakers(layout.speakers());
+
+			std::vector<float> ambi(dec.channels() * numFrames);
+			for(auto& v : ambi) v = float(rand()) / RAND_MAX - 0.5f;
+			std::vector<float> out(numSpeakers * numFrames, 0.f);
+
+			// Keep the fastest of several trials to reduce scheduling noise
+			double ns[2] = {1e30, 1e30};
+			for(int t=0; t<numTrials; ++t){
+				for(int method=0; method<2; ++method){
+					al_nsec t0 = al_steady_time_nsec();
+					for(int b=0; b<numBlocks; ++b){
+						if(method == 0) decodeDirect(dec, layout.speakers(), &out[0], &ambi[0], numFrames);
+						else            dec.decode(&out[0], &ambi[0], numFrames);
+					}
+					double dt = double(al_steady_time_nsec() - t0) / numBlocks;
+					if(dt < ns[method]) ns[method] = dt;
+				}
+			}
+			printf("%5d %8d %9d %12.0f %12.0f\n", order, numSpeakers, dec.channels(), ns[0], ns[1]);
+		}
+	}
+}
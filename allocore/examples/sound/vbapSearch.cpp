@@ -0,0 +1,61 @@
+/*
+Allocore Example: VBAP triplet search benchmark
+
+Description:
+This compares the time taken by VBAP to find the speaker triplet for a moving
+source using a linear search of all triplets, the lookup grid and the lookup
+grid starting from the source's last triplet. The AlloSphere layout is used.
+
+Author:
+AlloSystem contributors
+*/
+
+#include <stdio.h>
+#include <vector>
+#include "allocore/sound/al_Vbap.hpp"
+#include "allocore/system/al_Time.h"
+#include "alloutil/al_AlloSphereSpeakerLayout.hpp"
+using namespace al;
+
+int main(){
+	AlloSphereSpeakerLayout layout;
+	Vbap panner(layout, true);
+	printf("%d speakers, %d triplets\n", layout.numSpeakers(), (int)panner.triplets().size());
+
+	// Directions of sources moving slowly around the sphere, as in one block
+	// per direction
+	const int numSources = 64;
+	const int numBlocks = 2000;
+	std::vector<Vec3d> dirs(numSources * numBlocks);
+	for(int b=0; b<numBlocks; ++b){
+		for(int s=0; s<numSources; ++s){
+			double az = 0.002 * b * (s+1) + s;
+			double el = 0.8 * sin(0.001 * b * (s+3) + s);
+			dirs[b*numSources + s].set(sin(az)*cos(el), cos(az)*cos(el), sin(el));
+		}
+	}
+
+	std::vector<int> hints(numSources, -1);
+	Vec3d gains;
+	int found = 0;
+
+	for(int method=0; method<3; ++method){
+		al_nsec t0 = al_steady_time_nsec();
+		for(int b=0; b<numBlocks; ++b){
+			for(int s=0; s<numSources; ++s){
+				const Vec3d& dir = dirs[b*numSources + s];
+				switch(method){
+				case 0: found += panner.findTripletLinear(dir, gains) >= 0; break;
+				case 1: found += panner.findTriplet(dir, gains) >= 0; break;
+				default:
+					hints[s] = panner.findTriplet(dir, gains, hints[s]);
+					found += hints[s] >= 0;
+				}
+			}
+		}
+		double ns = double(al_steady_time_nsec() - t0) / dirs.size();
+		const char * names[] = {"linear", "grid", "grid + cached triplet"};
+		printf("%-24s %8.1f ns/search\n", names[method], ns);
+	}
+	printf("(%d directions found)\n", found);
+}
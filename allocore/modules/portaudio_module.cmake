@@ -3,10 +3,14 @@ find_package(Portaudio QUIET)
 
 set(PORTAUDIO_HEADERS
     allocore/io/al_AudioIO.hpp
+    allocore/io/al_AudioFileBackend.hpp
+    allocore/io/al_AudioProfiler.hpp
     allocore/sound/al_Ambisonics.hpp
     allocore/sound/al_AudioScene.hpp
+    allocore/sound/al_Binaural.hpp
     allocore/sound/al_Crossover.hpp
     allocore/sound/al_Dbap.hpp
+    allocore/sound/al_FDNReverb.hpp
     allocore/sound/al_Reverb.hpp
     allocore/sound/al_Speaker.hpp
     allocore/sound/al_Vbap.hpp
@@ -37,9 +41,13 @@ endif()
 
 list(APPEND ALLOCORE_SRC
     src/io/al_AudioIO.cpp
+    src/io/al_AudioFileBackend.cpp
+    src/io/al_AudioProfiler.cpp
     src/sound/al_AudioScene.cpp
     src/sound/al_Ambisonics.cpp
+    src/sound/al_Binaural.cpp
     src/sound/al_Dbap.cpp
+    src/sound/al_FDNReverb.cpp
     src/sound/al_Vbap.cpp
     src/sound/al_Biquad.cpp
 )
@@ -0,0 +1,368 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+#include "allocore/io/al_AudioFileBackend.hpp"
+
+namespace al{
+
+static void put16le(unsigned char * p, uint32_t v){ p[0]=v; p[1]=v>>8; }
+static void put32le(unsigned char * p, uint32_t v){ put16le(p, v); put16le(p+2, v>>16); }
+static void put64le(unsigned char * p, uint64_t v){ put32le(p, v); put32le(p+4, v>>32); }
+static void put32be(unsigned char * p, uint32_t v){ p[0]=v>>24; p[1]=v>>16; p[2]=v>>8; p[3]=v; }
+static uint32_t get16le(const unsigned char * p){ return p[0] | (p[1]<<8); }
+static uint32_t get32le(const unsigned char * p){ return get16le(p) | (get16le(p+2)<<16); }
+static uint64_t get64le(const unsigned char * p){ return get32le(p) | (uint64_t(get32le(p+4))<<32); }
+static uint32_t get32be(const unsigned char * p){ return (p[0]<<24) | (p[1]<<16) | (p[2]<<8) | p[3]; }
+
+// Sizes of the WAV header: the JUNK chunk is replaced by a ds64 chunk when
+// the file turns out larger than 4 GB
+enum{
+	WAV_JUNK_OFFSET = 12,
+	WAV_FMT_OFFSET = WAV_JUNK_OFFSET + 8 + 28,
+	WAV_DATA_OFFSET = WAV_FMT_OFFSET + 8 + 40,
+	WAV_HEADER_SIZE = WAV_DATA_OFFSET + 8,
+	AU_HEADER_SIZE = 24
+};
+
+AudioFileBackend::AudioFileBackend(const std::string& outputPath, double secs)
+:	mOutputPath(outputPath), mSeconds(secs), mSeed(-1),
+	mNumIn(0), mNumOut(2), mFPS(44100), mFramesPerBuffer(0), mIO(NULL),
+	mOutFile(NULL), mOutAU(false), mInFile(NULL), mInChans(0), mInBytes(0),
+	mInFloat(false), mInBigEndian(false), mInFrames(0),
+	mRendering(false), mFrames(0), mProcessTime(0)
+{
+	size_t dot = outputPath.find_last_of('.');
+	if(dot != std::string::npos){
+		std::string ext = outputPath.substr(dot);
+		mOutAU = ext == ".au" || ext == ".snd";
+	}
+}
+
+AudioFileBackend::~AudioFileBackend(){
+	close();
+}
+
+AudioFileBackend& AudioFileBackend::inputPath(const std::string& v){ mInputPath = v; return *this; }
+AudioFileBackend& AudioFileBackend::seconds(double v){ mSeconds = v; return *this; }
+AudioFileBackend& AudioFileBackend::seed(long v){ mSeed = v; return *this; }
+
+bool AudioFileBackend::isOpen() const { return mOpen; }
+bool AudioFileBackend::isRunning() const { return mRendering; }
+bool AudioFileBackend::error() const { return !mError.empty(); }
+
+void AudioFileBackend::printError(const char * text) const {
+	if(error()) fprintf(stderr, "%s: %s\n", text, mError.c_str());
+}
+
+void AudioFileBackend::printInfo() const {
+	printf("Rendering to file %s", mOutputPath.c_str());
+	if(!mInputPath.empty()) printf(" from file %s", mInputPath.c_str());
+	printf("\n");
+}
+
+bool AudioFileBackend::supportsFPS(double fps){ return true; }
+void AudioFileBackend::inDevice(int index){}
+void AudioFileBackend::outDevice(int index){}
+
+void AudioFileBackend::channels(int num, bool forOutput){
+	forOutput ? setOutDeviceChans(num) : setInDeviceChans(num);
+}
+
+int AudioFileBackend::inDeviceChans(){ return mNumIn; }
+int AudioFileBackend::outDeviceChans(){ return mNumOut; }
+void AudioFileBackend::setInDeviceChans(int num){ if(num >= 0) mNumIn = num; }
+void AudioFileBackend::setOutDeviceChans(int num){ if(num >= 0) mNumOut = num; }
+
+double AudioFileBackend::time(){ return mFrames / mFPS; }
+
+double AudioFileBackend::cpu(){
+	double rendered = mFrames / mFPS;
+	return rendered > 0 ? mProcessTime / rendered : 0;
+}
+
+double AudioFileBackend::speed() const {
+	double t = mProcessTime;
+	return t > 0 ? (mFrames / mFPS) / t : 0;
+}
+
+bool AudioFileBackend::open(int framesPerSecond, int framesPerBuffer, void * userdata){
+	if(mOpen) return true;
+	mError.clear();
+	mFPS = framesPerSecond;
+	mFramesPerBuffer = framesPerBuffer;
+	mIO = static_cast<AudioIO *>(userdata);
+	mFrames = 0;
+	mProcessTime = 0;
+
+	if(!mInputPath.empty() && !openInput()){
+		if(mInFile){ fclose(mInFile); mInFile = NULL; }
+		return false;
+	}
+
+	mOutFile = fopen(mOutputPath.c_str(), "wb");
+	if(!mOutFile){
+		mError = "could not open " + mOutputPath + " for writing";
+		if(mInFile){ fclose(mInFile); mInFile = NULL; }
+		return false;
+	}
+	setvbuf(mOutFile, NULL, _IOFBF, 1<<20);
+	writeHeader(0);
+	mOutBuffer.resize(mNumOut * mFramesPerBuffer);
+	mOpen = true;
+	return true;
+}
+
+bool AudioFileBackend::close(){
+	if(!mOpen) return true;
+	stop();
+	writeHeader(mFrames * mNumOut * sizeof(float));
+	fclose(mOutFile);
+	mOutFile = NULL;
+	if(mInFile){ fclose(mInFile); mInFile = NULL; }
+	mOpen = false;
+	return true;
+}
+
+bool AudioFileBackend::start(int framesPerSecond, int framesPerBuffer, void * userdata){
+	if(mRendering) return true;
+	if(!mOpen && !open(framesPerSecond, framesPerBuffer, userdata)) return false;
+	wait(); // join a render that finished by itself
+	mRendering = true;
+	mThread = std::thread([this](){ run(); });
+	return true;
+}
+
+bool AudioFileBackend::stop(){
+	mRendering = false;
+	wait();
+	return true;
+}
+
+void AudioFileBackend::wait(){
+	if(mThread.joinable()) mThread.join();
+}
+
+bool AudioFileBackend::render(AudioIO& io){
+	if(io.backend().get() != this){
+		mError = "render() called with an AudioIO using another backend";
+		return false;
+	}
+	if(mSeconds <= 0 && mInputPath.empty()){
+		mError = "render() needs a duration or an input file to end";
+		return false;
+	}
+	if(mRendering || !io.open()) return false;
+	mRendering = true;
+	run();
+	return !error();
+}
+
+void AudioFileBackend::run(){
+	if(mSeed >= 0) srand(mSeed);
+
+	uint64_t total = std::numeric_limits<uint64_t>::max();
+	if(mSeconds > 0) total = uint64_t(mSeconds * mFPS + 0.5);
+	else if(mInFile) total = mFrames + mInFrames;
+
+	auto start = std::chrono::steady_clock::now();
+	const double processTime0 = mProcessTime;
+	AudioIO& io = *mIO;
+
+	while(mRendering && mFrames < total){
+		readInput(io);
+		io.processAudio();
+		uint64_t left = total - mFrames;
+		int n = left < uint64_t(mFramesPerBuffer) ? int(left) : mFramesPerBuffer;
+		writeOutput(io, n);
+		mFrames += n;
+		mProcessTime = processTime0 + std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if(ferror(mOutFile)){
+			mError = "could not write to " + mOutputPath;
+			break;
+		}
+	}
+	// Leave a valid file behind, ready to be appended to by another start()
+	writeHeader(mFrames * mNumOut * sizeof(float));
+	fseek(mOutFile, 0, SEEK_END);
+	fflush(mOutFile);
+	mRendering = false;
+}
+
+void AudioFileBackend::writeOutput(AudioIO& io, int numFrames){
+	const int numChans = mNumOut;
+	float * buf = &mOutBuffer[0];
+	for(int c=0; c<numChans; ++c){
+		const float * out = io.outBuffer(c);
+		for(int i=0; i<numFrames; ++i) buf[i*numChans + c] = out[i];
+	}
+	if(mOutAU){ // big endian
+		for(int i=0; i<numFrames*numChans; ++i){
+			uint32_t v;
+			memcpy(&v, buf + i, 4);
+			put32be(reinterpret_cast<unsigned char *>(buf + i), v);
+		}
+	}
+	fwrite(buf, sizeof(float), numFrames * numChans, mOutFile);
+}
+
+void AudioFileBackend::writeHeader(uint64_t dataBytes){
+	// Written at the start, and again over the first one when closing
+	fseek(mOutFile, 0, SEEK_SET);
+
+	if(mOutAU){
+		// magic, data offset, data size, sample type (6=float), sample rate, channels
+		unsigned char hdr[AU_HEADER_SIZE] = {'.','s','n','d'};
+		put32be(hdr + 4, AU_HEADER_SIZE);
+		put32be(hdr + 8, dataBytes > 0xffffffffULL || 0 == dataBytes ? 0xffffffff : uint32_t(dataBytes));
+		put32be(hdr + 12, 6);
+		put32be(hdr + 16, uint32_t(mFPS));
+		put32be(hdr + 20, mNumOut);
+		fwrite(hdr, 1, sizeof(hdr), mOutFile);
+	}
+	else{
+		unsigned char hdr[WAV_HEADER_SIZE] = {0};
+		const uint64_t riffBytes = WAV_HEADER_SIZE - 8 + dataBytes;
+		const bool rf64 = riffBytes > 0xffffffffULL;
+		memcpy(hdr, rf64 ? "RF64" : "RIFF", 4);
+		put32le(hdr + 4, rf64 ? 0xffffffff : uint32_t(riffBytes));
+		memcpy(hdr + 8, "WAVE", 4);
+
+		unsigned char * ds = hdr + WAV_JUNK_OFFSET;
+		memcpy(ds, rf64 ? "ds64" : "JUNK", 4);
+		put32le(ds + 4, 28);
+		if(rf64){
+			put64le(ds + 8, riffBytes);
+			put64le(ds + 16, dataBytes);
+			put64le(ds + 24, dataBytes / (mNumOut * sizeof(float)));
+		}
+
+		// WAVE_FORMAT_EXTENSIBLE with 32 bit float samples
+		static const unsigned char floatFormat[16] =
+			{3,0,0,0, 0,0,0x10,0, 0x80,0,0,0xaa, 0,0x38,0x9b,0x71};
+		unsigned char * fmt = hdr + WAV_FMT_OFFSET;
+		memcpy(fmt, "fmt ", 4);
+		put32le(fmt + 4, 40);
+		put16le(fmt + 8, 0xfffe);
+		put16le(fmt + 10, mNumOut);
+		put32le(fmt + 12, uint32_t(mFPS));
+		put32le(fmt + 16, uint32_t(mFPS) * mNumOut * 4);
+		put16le(fmt + 20, mNumOut * 4);
+		put16le(fmt + 22, 32);
+		put16le(fmt + 24, 22);
+		put16le(fmt + 26, 32);
+		memcpy(fmt + 32, floatFormat, 16);
+
+		unsigned char * data = hdr + WAV_DATA_OFFSET;
+		memcpy(data, "data", 4);
+		put32le(data + 4, rf64 ? 0xffffffff : uint32_t(dataBytes));
+		fwrite(hdr, 1, sizeof(hdr), mOutFile);
+	}
+}
+
+bool AudioFileBackend::openInput(){
+	mInFile = fopen(mInputPath.c_str(), "rb");
+	if(!mInFile){
+		mError = "could not open " + mInputPath;
+		return false;
+	}
+	unsigned char hdr[12];
+	if(fread(hdr, 1, 12, mInFile) != 12){
+		mError = mInputPath + " is not a sound file";
+		return false;
+	}
+
+	int bits = 0;
+	uint64_t dataBytes = 0;
+	bool found = false;
+
+	if(!memcmp(hdr, ".snd", 4)){
+		unsigned char au[12];
+		if(fread(au, 1, 12, mInFile) == 12){
+			uint32_t offset = get32be(hdr + 4);
+			uint32_t size = get32be(hdr + 8);
+			uint32_t encoding = get32be(au);
+			mInChans = get32be(au + 8);
+			mInBigEndian = true;
+			mInFloat = 6 == encoding;
+			bits = encoding >= 3 && encoding <= 5 ? (encoding - 1) * 8 : (mInFloat ? 32 : 0);
+			fseek(mInFile, 0, SEEK_END);
+			long end = ftell(mInFile);
+			dataBytes = size != 0xffffffff ? size : end - offset;
+			found = 0 == fseek(mInFile, offset, SEEK_SET);
+		}
+	}
+	else if((!memcmp(hdr, "RIFF", 4) || !memcmp(hdr, "RF64", 4)) && !memcmp(hdr + 8, "WAVE", 4)){
+		uint64_t ds64DataBytes = 0;
+		int format = 0;
+		unsigned char chunk[8];
+		while(fread(chunk, 1, 8, mInFile) == 8){
+			uint32_t size = get32le(chunk + 4);
+			if(!memcmp(chunk, "data", 4)){
+				dataBytes = size == 0xffffffff ? ds64DataBytes : size;
+				found = true;
+				break;
+			}
+			std::vector<unsigned char> body(size);
+			if(size && fread(&body[0], 1, size, mInFile) != size) break;
+			if(size & 1) fseek(mInFile, 1, SEEK_CUR);
+			if(!memcmp(chunk, "ds64", 4) && size >= 16){
+				ds64DataBytes = get64le(&body[8]);
+			}
+			else if(!memcmp(chunk, "fmt ", 4) && size >= 16){
+				format = get16le(&body[0]);
+				mInChans = get16le(&body[2]);
+				bits = get16le(&body[14]);
+				if(0xfffe == format && size >= 26) format = get16le(&body[24]);
+			}
+		}
+		mInFloat = 3 == format;
+		mInBigEndian = false;
+		if(1 != format && 3 != format) bits = 0;
+	}
+
+	mInBytes = bits / 8;
+	if(!found || mInChans <= 0 || !(16 == bits || 24 == bits || 32 == bits) || (mInFloat && 32 != bits)){
+		mError = mInputPath + " is not a 16, 24 or 32 bit integer or 32 bit float WAV or Sun/NeXT file";
+		return false;
+	}
+	mInFrames = dataBytes / (mInChans * mInBytes);
+	return true;
+}
+
+void AudioFileBackend::readInput(AudioIO& io){
+	const int numChans = io.channelsIn();
+	for(int c=0; c<numChans; ++c){
+		float * in = const_cast<float *>(io.inBuffer(c));
+		for(int i=0; i<mFramesPerBuffer; ++i) in[i] = 0.f;
+	}
+	if(!mInFile || 0 == mInFrames) return;
+
+	int numFrames = mInFrames < uint64_t(mFramesPerBuffer) ? int(mInFrames) : mFramesPerBuffer;
+	const int frameBytes = mInChans * mInBytes;
+	mInBuffer.resize(mFramesPerBuffer * frameBytes);
+	numFrames = fread(&mInBuffer[0], frameBytes, numFrames, mInFile);
+	mInFrames = numFrames ? mInFrames - numFrames : 0;
+
+	const int chans = numChans < mInChans ? numChans : mInChans;
+	const float scale = 1.f / 2147483648.f; // full scale of a 32 bit integer
+	for(int c=0; c<chans; ++c){
+		float * in = const_cast<float *>(io.inBuffer(c));
+		for(int i=0; i<numFrames; ++i){
+			const unsigned char * p = &mInBuffer[i*frameBytes + c*mInBytes];
+			uint32_t v = 0;
+			if(mInBigEndian) for(int b=0; b<mInBytes; ++b) v = (v<<8) | p[b];
+			else for(int b=mInBytes-1; b>=0; --b) v = (v<<8) | p[b];
+			if(mInFloat){
+				memcpy(in + i, &v, 4);
+			}
+			else{
+				v <<= 32 - 8*mInBytes; // to most significant bytes
+				in[i] = int32_t(v) * scale;
+			}
+		}
+	}
+}
+
+} // al::
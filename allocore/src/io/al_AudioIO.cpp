@@ -1165,6 +1165,7 @@ void AudioIO::channelsBus(int num) {
 
 	resizeBuf(mBufB, num * mFramesPerBuffer);
 	mNumB = num;
+	mBlocksReady = false;
 }
 
 void AudioIO::channels(int num, bool forOutput) {
@@ -1206,6 +1207,15 @@ bool AudioIO::close() {
 	return mBackend->close();
 }
 
+void AudioIO::backend(std::shared_ptr<AudioBackend> v) {
+	close();
+	mBackend = v ? v : std::make_shared<AudioBackend>();
+	mBackend->inDevice(mInDevice.id());
+	mBackend->outDevice(mOutDevice.id());
+	mBackend->channels(mNumI, false);
+	mBackend->channels(mNumO, true);
+}
+
 void AudioIO::reopen() {
 	if (mBackend->isRunning()) {
 		close();
@@ -1224,6 +1234,8 @@ bool AudioIO::start() {
 			return false;
 		}
 	}
+	mProfiler.resume();
+	if(usingBlocks()) resetBlocks();
 	return mBackend->start(mFramesPerSecond, mFramesPerBuffer, this);
 }
 
@@ -1243,6 +1255,7 @@ void AudioIO::resizeBuffer(bool forOutput) {
 	} else {
 		deleteBuf(buffer);
 	}
+	mBlocksReady = false;
 }
 
 void AudioIO::framesPerSecond(double v) {  // printf("AudioIO::fps(%f)\n", v);
@@ -1268,6 +1281,16 @@ void AudioIO::framesPerBuffer(int n) {
 	}
 }
 
+void AudioIO::framesPerBlock(int n) {
+	if (mBackend->isOpen()) {
+		AL_WARN("the number of frames/block cannnot be set with the stream open");
+		return;
+	}
+
+	mFramesPerBlock = n > 0 ? n : 0;
+	mBlocksReady = false;
+}
+
 bool AudioIO::supportsFPS(double fps) { return mBackend->supportsFPS(fps); }
 
 void AudioIO::print() const {
@@ -1288,20 +1311,17 @@ void AudioIO::print() const {
 
 	mBackend->printInfo();
 	printf("Frames/Buf:  %d\n", mFramesPerBuffer);
+	if(usingBlocks()){
+		printf("Frames/Blk:  %d (%d frames latency)\n", mFramesPerBlock, blockLatency());
+	}
 }
 
 
 void AudioIO::processAudio() {
-	if(autoZeroOut()) zeroOut();
-
-	// Call user callbacks
-	frame(0);
-	if(callback != nullptr) callback(*this);
+	mProfiler.beginBlock();
 
-	for(auto * cb : mAudioCallbacks){
-		frame(0);
-		cb->onAudioCB(*this);
-	}
+	if(usingBlocks()) processBlocks();
+	else processBlock();
 
 	// Apply smoothly-ramped gain to all output channels
 	if(usingGain()){
@@ -1337,13 +1357,107 @@ void AudioIO::processAudio() {
 		}
 	}
 
+	mProfiler.endBlock(mFramesPerBuffer / mFramesPerSecond);
+}
+
+void AudioIO::processBlock() {
+	if(autoZeroOut()) zeroOut();
+
+	// Call user callbacks
+	frame(0);
+	if(callback != nullptr) callback(*this);
+
+	for(auto * cb : mAudioCallbacks){
+		frame(0);
+		cb->onAudioCB(*this);
+	}
+}
+
+void AudioIO::processBlocks() {
+	if(!mBlocksReady) resetBlocks();
+
+	const int N = mFramesPerBuffer;
+	const int B = mFramesPerBlock;
+	const int cap = N + B;
+
+	// Device input goes to the end of the input FIFO
+	for(int c=0; c<mNumI; ++c){
+		std::copy(mBufI + c*N, mBufI + (c+1)*N, &mFIFOIn[c*cap + mFramesInFIFO]);
+	}
+	mFramesInFIFO += N;
+
+	// Callbacks see the block buffers while processing whole blocks
+	float * devI = mBufI, * devO = mBufO, * devB = mBufB, * devT = mBufT;
+	mBufI = mBlockIn.data();
+	mBufO = mBlockOut.data();
+	mBufB = mBlockBus.data();
+	mBufT = mBlockTemp.data();
+	mFramesPerBuffer = B;
+
+	int pos = 0;
+	for(; mFramesInFIFO - pos >= B; pos += B){
+		for(int c=0; c<mNumI; ++c){
+			const float * src = &mFIFOIn[c*cap + pos];
+			std::copy(src, src + B, mBufI + c*B);
+		}
+		processBlock();
+		for(int c=0; c<mNumO; ++c){
+			std::copy(mBufO + c*B, mBufO + (c+1)*B, &mFIFOOut[c*cap + mFramesOutFIFO]);
+		}
+		mFramesOutFIFO += B;
+	}
+
+	mBufI = devI;
+	mBufO = devO;
+	mBufB = devB;
+	mBufT = devT;
+	mFramesPerBuffer = N;
+
+	// Keep the input of the next block, and take a device buffer of output.
+	// The output FIFO never runs short since it starts with blockLatency()
+	// frames of silence.
+	mFramesInFIFO -= pos;
+	for(int c=0; c<mNumI; ++c){
+		float * fifo = &mFIFOIn[c*cap];
+		std::copy(fifo + pos, fifo + pos + mFramesInFIFO, fifo);
+	}
+	mFramesOutFIFO -= N;
+	for(int c=0; c<mNumO; ++c){
+		float * fifo = &mFIFOOut[c*cap];
+		std::copy(fifo, fifo + N, mBufO + c*N);
+		std::copy(fifo + N, fifo + N + mFramesOutFIFO, fifo);
+	}
+}
+
+void AudioIO::resetBlocks() {
+	const int N = mFramesPerBuffer;
+	const int B = mFramesPerBlock;
+	mFIFOIn.assign(mNumI * (N + B), 0.f);
+	mFIFOOut.assign(mNumO * (N + B), 0.f);
+	mBlockIn.assign(mNumI * B, 0.f);
+	mBlockOut.assign(mNumO * B, 0.f);
+	mBlockBus.assign(mNumB * B, 0.f);
+	mBlockTemp.assign(B, 0.f);
+	mFramesInFIFO = 0;
+	mFramesOutFIFO = blockLatency();
+	mBlocksReady = true;
+}
+
+int AudioIO::blockLatency() const {
+	if(!usingBlocks()) return 0;
+	int a = mFramesPerBuffer, b = mFramesPerBlock;
+	while(b){ int t = a % b; a = b; b = t; }
+	return mFramesPerBlock - a;
 }
 
 int AudioIO::channels(bool forOutput) const {
 	return forOutput ? channelsOut() : channelsIn();
 }
 
-double AudioIO::cpu() const { return mBackend->cpu(); }
+double AudioIO::cpu() const {
+	double c = mBackend->cpu();
+	return c > 0. ? c : mProfiler.load();
+}
 bool AudioIO::zeroNANs() const { return mZeroNANs; }
 
 double AudioIO::time() const {
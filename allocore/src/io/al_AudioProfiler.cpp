@@ -0,0 +1,96 @@
+#include <cmath>
+#include <cstdio>
+
+#include "allocore/io/al_AudioProfiler.hpp"
+#include "allocore/protocol/al_OSC.hpp"
+#include "allocore/system/al_Time.h"
+
+namespace al{
+
+AudioProfiler::AudioProfiler()
+:	mEnabled(true), mBegin(-1), mEnd(-1)
+{
+	reset();
+}
+
+void AudioProfiler::beginBlock(){
+	mBegin = mEnabled ? al_steady_time_nsec() : -1;
+	if(mBegin < 0) mEnd = -1;
+}
+
+void AudioProfiler::endBlock(double period){
+	if(mBegin < 0 || period <= 0.) return;
+	int64_t end = al_steady_time_nsec();
+
+	double load = (end - mBegin) * 1e-9 / period;
+	if(load > 1.) inc(mOverruns);
+	if(mEnd >= 0 && (mBegin - mEnd) * 1e-9 > 1.5 * period) inc(mLate);
+	mEnd = end;
+
+	int bin = load * BINS_PER_PERIOD;
+	if(bin >= NUM_BINS) bin = NUM_BINS-1;
+	inc(mBins[bin]);
+
+	double smooth = mBlocks.load(std::memory_order_relaxed) ? mLoad.load(std::memory_order_relaxed) : load;
+	mLoad.store(smooth + 0.05 * (load - smooth), std::memory_order_relaxed);
+	if(load > mMaxLoad.load(std::memory_order_relaxed)) mMaxLoad.store(load, std::memory_order_relaxed);
+	mLoadSum.store(mLoadSum.load(std::memory_order_relaxed) + load, std::memory_order_relaxed);
+	inc(mBlocks);
+}
+
+void AudioProfiler::reset(){
+	mBlocks = 0;
+	mOverruns = 0;
+	mLate = 0;
+	mLoad = 0.;
+	mMaxLoad = 0.;
+	mLoadSum = 0.;
+	for(auto& b : mBins) b = 0;
+}
+
+double AudioProfiler::meanLoad() const {
+	uint64_t n = blocks();
+	return n ? mLoadSum.load(std::memory_order_relaxed) / n : 0.;
+}
+
+double AudioProfiler::percentile(double p) const {
+	uint64_t total = 0;
+	for(int i=0; i<NUM_BINS; ++i) total += histogram(i);
+	if(!total) return 0.;
+
+	// Blocks below the percentile, counting the one at it
+	uint64_t count = std::ceil(p * total);
+	if(count < 1) count = 1;
+
+	uint64_t sum = 0;
+	for(int i=0; i<NUM_BINS-1; ++i){
+		sum += histogram(i);
+		if(sum >= count){
+			double edge = double(i+1) / BINS_PER_PERIOD;
+			return edge < maxLoad() ? edge : maxLoad();
+		}
+	}
+	return maxLoad();
+}
+
+void AudioProfiler::print() const {
+	printf("Blocks:      %llu (%llu overruns, %llu late)\n",
+		(unsigned long long)blocks(), (unsigned long long)overruns(), (unsigned long long)late());
+	printf("Load:        %.3f (mean %.3f, p99 %.3f, p99.9 %.3f, max %.3f)\n",
+		load(), meanLoad(), percentile(0.99), percentile(0.999), maxLoad());
+}
+
+int AudioProfiler::send(osc::Send& s, const std::string& prefix) const {
+	s.beginBundle();
+	s.addMessage(prefix + "/blocks", int(blocks()));
+	s.addMessage(prefix + "/overruns", int(overruns()));
+	s.addMessage(prefix + "/late", int(late()));
+	s.beginMessage(prefix + "/load");
+	s << float(load()) << float(meanLoad()) << float(percentile(0.99))
+	  << float(percentile(0.999)) << float(maxLoad());
+	s.endMessage();
+	s.endBundle();
+	return s.send();
+}
+
+} // al::
@@ -1,5 +1,6 @@
 #include <string.h>
 #include "allocore/sound/al_Ambisonics.hpp"
+#include "allocore/system/al_Printing.hpp"
 
 #ifdef USE_GAMMA
 	#include "scl.h"
@@ -63,50 +64,21 @@ int AmbiBase::channelsToUniformOrder(int channels){
 }
 
 
-void AmbiBase::encodeWeightsFuMa(float * ws, int dim, int order, float x, float y, float z){
-	*ws++ = c1_sqrt2;								// W = 1/sqrt(2)
-
-	if(order > 0){
-		float x2 = x * x;
-		float y2 = y * y;
-
-		*ws++ = x;									// X = cos(A)cos(E)
-		*ws++ = y;									// Y = sin(A)cos(E)
-
-		if(order > 1){
-			x2 = x*x;
-			y2 = y*y;
-
-			*ws++ = x2 - y2;						// U = cos(2A)cos2(E) = xx-yy
-			*ws++ = 2.f * x * y;					// V = sin(2A)cos2(E) = 2xy
-
-			if(order > 2){
-				*ws++ = x * (x2 - 3.f * y2);		// P = cos(3A)cos3(E) = X(X2-3Y2)
-				*ws++ = y * (y2 - 3.f * x2);		// Q = sin(3A)cos3(E) = Y(3X2-Y2)
-			}
-		}
-
-		if(dim == 3){
-			*ws++ = z;								// Z = sin(E)
-
-			if(order > 1){
-				float z2 = z*z;
-
-				*ws++ = 2.f * z * x;				// S = cos(A)sin(2E) = 2zx
-				*ws++ = 2.f * z * y;				// T = sin(A)sin(2E) = 2yz
-				*ws++ = (1.5f * z2) - 0.5f;			// R = 1.5sin2(E)-0.5 = 1.5zz-0.5
-
-				if(order > 2){
-					float pre = c40_11 * z2 - c8_11;
+template <int Order>
+static void encodeWeightsDim(float * ws, int dim, float x, float y, float z){
+	if(dim == 3)	AmbiEncoder<Order, 3>::encodeWeights(ws, x,y,z);
+	else			AmbiEncoder<Order, 2>::encodeWeights(ws, x,y,z);
+}
 
-					*ws++ = z * (x2-y2) * 0.5f;		// N = cos(2A)sin(E)cos2(E) = Z(X2-Y2)/2
-					*ws++ = x * y * z;				// O = sin(2A)sin(E)cos2(E) = XYZ
-					*ws++ = pre * x;				// L = 8cos(A)cos(E)(5sin2(E) - 1)/11 = 8X(5Z2-1)/11
-					*ws++ = pre * y;				// M = 8sin(A)cos(E)(5sin2(E) - 1)/11 = 8Y(5Z2-1)/11
-					*ws   = z * (2.5f * z2 - 1.5f);	// K = sin(E)(5sin2(E) - 3)/2 = Z(5Z2-3)/2
-				}
-			}
-		}
+void AmbiBase::encodeWeightsFuMa(float * ws, int dim, int order, float x, float y, float z){
+	switch(order){
+	case 0: *ws = c1_sqrt2; break;					// W = 1/sqrt(2)
+	case 1: encodeWeightsDim<1>(ws, dim, x,y,z); break;
+	case 2: encodeWeightsDim<2>(ws, dim, x,y,z); break;
+	case 3: encodeWeightsDim<3>(ws, dim, x,y,z); break;
+	case 4: encodeWeightsDim<4>(ws, dim, x,y,z); break;
+	case 5: encodeWeightsDim<5>(ws, dim, x,y,z); break;
+	default:;
 	}
 }
 
@@ -138,7 +110,7 @@ void AmbiBase::encodeWeightsFuMa16(float * ws, float x, float y, float z){
 	ws[ 7] = 2.f * z * y;				// T = sin(A)sin(2E) = 2yz
 	ws[ 8] = 1.5f * z2 - 0.5f;			// R = 1.5sin2(E)-0.5 = 1.5zz-0.5
 	ws[ 9] = x * (x2 - 3.f * y2);		// P = cos(3A)cos3(E) = X(X2-3Y2)
-	ws[10] = y * (y2 - 3.f * x2);		// Q = sin(3A)cos3(E) = Y(3X2-Y2)
+	ws[10] = y * (3.f * x2 - y2);		// Q = sin(3A)cos3(E) = Y(3X2-Y2)
 	ws[11] = z * (x2 - y2) * 0.5f;		// N = cos(2A)sin(E)cos2(E) = Z(X2-Y2)/2
 	ws[12] = x * y * z;					// O = sin(2A)sin(E)cos2(E) = XYZ
 	ws[13] = pre * x;					// L = 8cos(A)cos(E)(5sin2(E) - 1)/11 = 8X(5Z2-1)/11
@@ -162,31 +134,35 @@ void AmbiBase::encodeWeightsFuMa16(float * ws, float az, float el){
 
 // AmbiDecode
 
-float AmbiDecode::flavorWeights[4][5][5] = {
+float AmbiDecode::flavorWeights[4][6][6] = {
 	{	// none:
-		{1,		1,		1,		1,		1    }, // n = 0, M = 0, 1, 2, 3, 4
-		{0,		1,		1,		1,		1    }, // n = 1, M = 0, 1, 2, 3, 4
-		{0,		0,		1,		1,		1    }, // n = 2, M = 0, 1, 2, 3, 4
-		{0,		0,		0,		1,		1    }, // n = 3, M = 0, 1, 2, 3, 4
-		{0,		0,		0,		0,		1    }  // n = 4, M = 0, 1, 2, 3, 4
+		{1,		1,		1,		1,		1,		1    }, // n = 0, M = 0, 1, 2, 3, 4, 5
+		{0,		1,		1,		1,		1,		1    }, // n = 1, M = 0, 1, 2, 3, 4, 5
+		{0,		0,		1,		1,		1,		1    }, // n = 2, M = 0, 1, 2, 3, 4, 5
+		{0,		0,		0,		1,		1,		1    }, // n = 3, M = 0, 1, 2, 3, 4, 5
+		{0,		0,		0,		0,		1,		1    }, // n = 4, M = 0, 1, 2, 3, 4, 5
+		{0,		0,		0,		0,		0,		1    }  // n = 5, M = 0, 1, 2, 3, 4, 5
 	},{	// default:
-		{1,		0.707,	0.707,	0.707,	0.707},	// n = 0, M = 0, 1, 2, 3, 4
-		{0,		1    ,	0.75 ,	0.75 ,	0.75 },	// n = 1, M = 0, 1, 2, 3, 4
-		{0,		0    ,	0.5  ,	0.5  ,	0.5  },	// n = 2, M = 0, 1, 2, 3, 4
-		{0,		0    ,	0    ,	0.3  ,	0.3  },	// n = 3, M = 0, 1, 2, 3, 4
-		{0,		0    ,	0    ,	0    ,	0.1  } 	// n = 4, M = 0, 1, 2, 3, 4
+		{1,		0.707,	0.707,	0.707,	0.707,	0.707},	// n = 0, M = 0, 1, 2, 3, 4, 5
+		{0,		1    ,	0.75 ,	0.75 ,	0.75 ,	0.75 },	// n = 1, M = 0, 1, 2, 3, 4, 5
+		{0,		0    ,	0.5  ,	0.5  ,	0.5  ,	0.5  },	// n = 2, M = 0, 1, 2, 3, 4, 5
+		{0,		0    ,	0    ,	0.3  ,	0.3  ,	0.3  },	// n = 3, M = 0, 1, 2, 3, 4, 5
+		{0,		0    ,	0    ,	0    ,	0.1  ,	0.1  },	// n = 4, M = 0, 1, 2, 3, 4, 5
+		{0,		0    ,	0    ,	0    ,	0    ,	0.05 } 	// n = 5, M = 0, 1, 2, 3, 4, 5
 	},{	// in phase
-		{1,		1,		1,		1,		1    },	// n = 0, M = 0, 1, 2, 3, 4
-		{0,		0.333,	0.5,	0.6,	0.667},	// n = 1, M = 0, 1, 2, 3, 4
-		{0,		0,		0.1,	0.2,	0.286},	// n = 2, M = 0, 1, 2, 3, 4
-		{0,		0,		0,		0.029,	0.071},	// n = 3, M = 0, 1, 2, 3, 4
-		{0,		0,		0,		0,		0.008}	// n = 4, M = 0, 1, 2, 3, 4
+		{1,		1,		1,		1,		1,		1    },	// n = 0, M = 0, 1, 2, 3, 4, 5
+		{0,		0.333,	0.5,	0.6,	0.667,	0.714},	// n = 1, M = 0, 1, 2, 3, 4, 5
+		{0,		0,		0.1,	0.2,	0.286,	0.357},	// n = 2, M = 0, 1, 2, 3, 4, 5
+		{0,		0,		0,		0.029,	0.071,	0.119},	// n = 3, M = 0, 1, 2, 3, 4, 5
+		{0,		0,		0,		0,		0.008,	0.024},	// n = 4, M = 0, 1, 2, 3, 4, 5
+		{0,		0,		0,		0,		0,		0.002}	// n = 5, M = 0, 1, 2, 3, 4, 5
 	},{	// max-rE
-		{1,		1,		1,		1,		1    },	// n = 0, M = 0, 1, 2, 3, 4
-		{0,		0.577,	0.775,	0.861,	0.906},	// n = 1, M = 0, 1, 2, 3, 4
-		{0,		0,		0.4,	0.612,	0.732},	// n = 2, M = 0, 1, 2, 3, 4
-		{0,		0,		0,		0.305,	0.501},	// n = 3, M = 0, 1, 2, 3, 4
-		{0,		0,		0,		0,		0.246}	// n = 4, M = 0, 1, 2, 3, 4
+		{1,		1,		1,		1,		1,		1    },	// n = 0, M = 0, 1, 2, 3, 4, 5
+		{0,		0.577,	0.775,	0.861,	0.906,	0.932},	// n = 1, M = 0, 1, 2, 3, 4, 5
+		{0,		0,		0.4,	0.612,	0.732,	0.804},	// n = 2, M = 0, 1, 2, 3, 4, 5
+		{0,		0,		0,		0.305,	0.501,	0.629},	// n = 3, M = 0, 1, 2, 3, 4, 5
+		{0,		0,		0,		0,		0.246,	0.428},	// n = 4, M = 0, 1, 2, 3, 4, 5
+		{0,		0,		0,		0,		0,		0.226}	// n = 5, M = 0, 1, 2, 3, 4, 5
 	}
 };
 
@@ -203,50 +179,117 @@ AmbiDecode::~AmbiDecode(){
 	//delete[] mSpeakers; // listener now owns speakers and will delete them
 }
 
+// Number of frames decoded at a time. The block of Ambisonic domain frames
+// stays in cache while it is decoded to every speaker.
+static const int DECODE_BLOCK_FRAMES = 64;
+
+// Add one speaker's decode of n <= DECODE_BLOCK_FRAMES frames to out. The
+// channels are summed four at a time into a local block, which the compiler
+// knows is not aliased by the inputs, so that the loops vectorize.
+static inline void decodeBlock(
+	float * out, const float * in, int inStride, const float * w, int numChannels, int n
+){
+	float sum[DECODE_BLOCK_FRAMES];
+	int c = 0;
+	if(numChannels >= 4){
+		const float * in0 = in;
+		const float * in1 = in0 + inStride;
+		const float * in2 = in1 + inStride;
+		const float * in3 = in2 + inStride;
+		const float w0 = w[0], w1 = w[1], w2 = w[2], w3 = w[3];
+		for(int i=0; i<n; ++i){
+			sum[i] = in0[i] * w0 + in1[i] * w1 + in2[i] * w2 + in3[i] * w3;
+		}
+		c = 4;
+	}
+	else{
+		for(int i=0; i<n; ++i) sum[i] = 0.f;
+	}
+
+	for(; c+4<=numChannels; c+=4){
+		const float * in0 = in + c * inStride;
+		const float * in1 = in0 + inStride;
+		const float * in2 = in1 + inStride;
+		const float * in3 = in2 + inStride;
+		const float w0 = w[c], w1 = w[c+1], w2 = w[c+2], w3 = w[c+3];
+		for(int i=0; i<n; ++i){
+			sum[i] += in0[i] * w0 + in1[i] * w1 + in2[i] * w2 + in3[i] * w3;
+		}
+	}
+	for(; c<numChannels; ++c){
+		const float * in0 = in + c * inStride;
+		const float w0 = w[c];
+		for(int i=0; i<n; ++i){
+			sum[i] += in0[i] * w0;
+		}
+	}
+
+	for(int i=0; i<n; ++i) out[i] += sum[i];
+}
+
 void AmbiDecode::decode(float * dec, const float * ambi, int numDecFrames) const {
+	const int numChannels = channels();
 
-	// iterate speakers
-	for(int s=0; s<numSpeakers(); ++s){
-		// skip zero-amp speakers:
-		if ((*mSpeakers)[s].gain != 0.) {
-			float * out = dec + (*mSpeakers)[s].deviceChannel * numDecFrames;
+	for(int i0=0; i0<numDecFrames; i0+=DECODE_BLOCK_FRAMES){
+		const int n = numDecFrames - i0;
 
-			// iterate ambi channels
-			for(int c=0; c<channels(); ++c){
-				const float * in = ambi + c * numDecFrames;
-				float w = decodeWeight(s, c) + mConfig.weightOffset;
-				if (mConfig.discardNegativeWeights && w < 0.0f) {
-					w = 0.0f;
-				}
- 				for(int i=0; i<numDecFrames; ++i) {
-					out[i] += in[i] * w;
-				}
+		// iterate speakers
+		for(int s=0; s<numSpeakers(); ++s){
+			// skip zero-amp speakers:
+			if ((*mSpeakers)[s].gain == 0.f) continue;
+
+			float * out = dec + (*mSpeakers)[s].deviceChannel * numDecFrames + i0;
+			const float * w = &mDecodeGains[s * numChannels];
+
+			// a constant frame count lets full blocks be unrolled
+			if(n >= DECODE_BLOCK_FRAMES){
+				decodeBlock(out, ambi + i0, numDecFrames, w, numChannels, DECODE_BLOCK_FRAMES);
+			}
+			else{
+				decodeBlock(out, ambi + i0, numDecFrames, w, numChannels, n);
 			}
 		}
 	}
 }
 
 void AmbiDecode::decode(float *dec, const float * ambi, int numDecFrames, int timeIndex) const {
+	const int numChannels = channels();
 
 	// iterate speakers
 	for(int s=0; s<numSpeakers(); ++s){
 		// skip zero-amp speakers:
 		if ((*mSpeakers)[s].gain != 0.f) {
 			float * out = dec + (*mSpeakers)[s].deviceChannel * numDecFrames;
+			const float * w = &mDecodeGains[s * numChannels];
 
 			// iterate ambi channels
-			for(int c=0; c<channels(); ++c){
-				const float * in = ambi + c * numDecFrames;
-				float w = decodeWeight(s, c) + mConfig.weightOffset;
-				if (mConfig.discardNegativeWeights && w < 0.0f) {
-					w = 0.0f;
-				}
-				out[timeIndex] += in[timeIndex] * w;
+			for(int c=0; c<numChannels; ++c){
+				out[timeIndex] += ambi[c * numDecFrames + timeIndex] * w[c];
 			}
 		}
 	}
 }
 
+void AmbiDecode::updateDecodeGains(){
+	mDecodeGains.resize(numSpeakers() * channels());
+	for(int s=0; s<numSpeakers(); ++s) updateDecodeGains(s);
+}
+
+void AmbiDecode::updateDecodeGains(int speaker){
+	if(speaker >= numSpeakers()) return;
+	if(mDecodeGains.size() != unsigned(numSpeakers() * channels())){
+		updateDecodeGains();
+		return;
+	}
+	for(int c=0; c<channels(); ++c){
+		float w = decodeWeight(speaker, c) + mConfig.weightOffset;
+		if (mConfig.discardNegativeWeights && w < 0.0f) {
+			w = 0.0f;
+		}
+		mDecodeGains[speaker * channels() + c] = w;
+	}
+}
+
 
 void AmbiDecode::flavor(int type){
 	if(type < 4){
@@ -278,6 +321,7 @@ void AmbiDecode::setSpeakerRadians(int index, int deviceChannel, float az, float
 	for (int i=0; i<channels(); i++) {
 		mDecodeMatrix[index * channels() + i] *= amp;
 	}
+	updateDecodeGains(index);
 }
 
 void AmbiDecode::setSpeaker(int index, int deviceChannel, float az, float el, float amp){
@@ -296,32 +340,16 @@ void AmbiDecode::updateChanWeights(){
 	float * wc = mWeights;
 	*wc++ = mWOrder[0];
 
-	if(mOrder > 0){
-		*wc++ = mWOrder[1];				// X
-		*wc++ = mWOrder[1];				// Y
-		if (mOrder > 1) {
-			*wc++ = mWOrder[2];			// U
-			*wc++ = mWOrder[2];			// V
-			if (mOrder > 2) {
-				*wc++ = mWOrder[3];		// P
-				*wc++ = mWOrder[3];		// Q
-			}
-		}
+	// horizontal pairs, in the channel order of encodeWeightsFuMa
+	for(int l=1; l<=mOrder; ++l){
+		*wc++ = mWOrder[l];
+		*wc++ = mWOrder[l];
+	}
 
-		if(3 == mDim){
-			*wc++ = mWOrder[1];			// Z
-			if (mOrder > 1) {
-				*wc++ = mWOrder[2];		// S
-				*wc++ = mWOrder[2];		// T
-				*wc++ = mWOrder[2];		// R
-				if (mOrder > 2) {
-					*wc++ = mWOrder[3];	// N
-					*wc++ = mWOrder[3];	// O
-					*wc++ = mWOrder[3];	// L
-					*wc++ = mWOrder[3];	// M
-					*wc   = mWOrder[3];	// K
-				}
-			}
+	// 2l-1 vertical channels for each degree l
+	if(3 == mDim){
+		for(int l=1; l<=mOrder; ++l){
+			for(int i=0; i<2*l-1; ++i) *wc++ = mWOrder[l];
 		}
 	}
 }
@@ -351,6 +379,7 @@ void AmbiDecode::resizeArrays(int numChannels, int numSpeakers){
 	}
 
 	mChannels = numChannels;
+	updateDecodeGains();
 }
 
 void AmbiDecode::onChannelsChange(){
@@ -362,12 +391,251 @@ void AmbiDecode::print(FILE * fp, const char * append) const {
 //	fprintf(fp, "s:%3d%s", mNumSpeakers, append);
 }
 
+// AmbiRotate
+
+AmbiRotate::AmbiRotate(int dim, int order, int maxFrames)
+:	AmbiBase(dim, order), mMaxFrames(maxFrames), mHasRotation(false)
+{
+	onChannelsChange();
+}
+
+void AmbiRotate::maxFrames(int v){
+	mMaxFrames = v;
+	mBuffer.resize(channels() * mMaxFrames);
+}
+
+// Channel of the spherical harmonic of degree l and index m in the order of
+// encodeWeightsFuMa(), or -1 if it is not encoded. Index m is negative for
+// the sin(|m|A) harmonics, as in Ivanic and Ruedenberg.
+static int channelIndex(int dim, int order, int l, int m){
+	if(l == 0) return 0;
+	if(m == l) return 2*l - 1;
+	if(m == -l) return 2*l;
+	if(dim != 3) return -1;
+	int base = 2*order + 1 + (l-1)*(l-1);
+	if(m == 0) return base + 2*(l-1);
+	return base + 2*(l-1-abs(m)) + (m < 0 ? 1 : 0);
+}
+
+// Real spherical harmonic with Schmidt semi-normalization (SN3D)
+static double harmonicSN3D(int l, int m, double x, double y, double z){
+	int am = abs(m);
+
+	// associated Legendre polynomial, without the factor cos^|m|(E)
+	double pmm = 1;
+	for(int k=1; k<=am; ++k) pmm *= 2*k - 1;
+	double p = pmm;
+	if(l > am){
+		double p0 = pmm;
+		p = (2*am+1) * z * pmm;
+		for(int k=am+2; k<=l; ++k){
+			double p1 = ((2*k-1) * z * p - (k+am-1) * p0) / (k-am);
+			p0 = p; p = p1;
+		}
+	}
+
+	// cos(|m|A)cos^|m|(E) or sin(|m|A)cos^|m|(E)
+	double c = 1, s = 0;
+	for(int k=0; k<am; ++k){
+		double c1 = x*c - y*s;
+		s = x*s + y*c; c = c1;
+	}
+
+	double norm = m == 0 ? 1 : 2;
+	for(int k=l-am+1; k<=l+am; ++k) norm /= k;
+	return sqrt(norm) * p * (m < 0 ? s : c);
+}
+
+void AmbiRotate::onChannelsChange(){
+	const int N = channels();
+	mMatrix.assign(N*N, 0.f);
+	for(int c=0; c<N; ++c) mMatrix[c*N + c] = 1.f;
+	mPrevMatrix = mMatrix;
+	mHasRotation = false;
+	mBuffer.resize(N * mMaxFrames);
+
+	mDegreeStart.clear();
+	mDegreeChans.clear();
+	for(int l=0; l<=mOrder; ++l){
+		mDegreeStart.push_back(mDegreeChans.size());
+		for(int m=-l; m<=l; ++m){
+			int c = channelIndex(mDim, mOrder, l, m);
+			if(c >= 0) mDegreeChans.push_back(c);
+		}
+	}
+	mDegreeStart.push_back(mDegreeChans.size());
+
+	// Measure the scale of each channel relative to SN3D, where the SN3D
+	// harmonic is largest among a few directions
+	static const float dirs[][3] = {
+		{1,0,0}, {0,1,0}, {0,0,1}, {0.6f,0.8f,0}, {0.48f,0.36f,0.8f}, {0.36f,0.48f,-0.8f}, {0.8f,-0.36f,0.48f}
+	};
+	mScales.assign(N, 1.f);
+	std::vector<float> ws(N);
+	for(int l=1; l<=mOrder; ++l){
+		for(int m=-l; m<=l; ++m){
+			int c = channelIndex(mDim, mOrder, l, m);
+			if(c < 0) continue;
+			double best = 0;
+			for(auto& d : dirs){
+				double ref = harmonicSN3D(l, m, d[0], d[1], d[2]);
+				if(fabs(ref) > fabs(best)){
+					encodeWeightsFuMa(&ws[0], mDim, mOrder, d[0], d[1], d[2]);
+					best = ref;
+					mScales[c] = ws[c] / ref;
+				}
+			}
+		}
+	}
+}
+
+// Functions of the recursion of Ivanic and Ruedenberg, with the corrections
+// of their erratum. R1 is the rotation of degree 1 and Rl1 that of degree
+// l-1, indexed from -1 and -(l-1).
+static double rotP(int i, int l, int a, int b, const double R1[3][3], const double * Rl1){
+	const int n = 2*l - 1;
+	#define RL1(a,b) Rl1[((a)+l-1)*n + (b)+l-1]
+	double ri1 = R1[i+1][2], rim1 = R1[i+1][0], ri0 = R1[i+1][1];
+	if(b == -l)		return ri1 * RL1(a, -l+1) + rim1 * RL1(a, l-1);
+	else if(b == l)	return ri1 * RL1(a, l-1) - rim1 * RL1(a, -l+1);
+	else			return ri0 * RL1(a, b);
+	#undef RL1
+}
+
+static double rotU(int l, int m, int n, const double R1[3][3], const double * Rl1){
+	return rotP(0, l, m, n, R1, Rl1);
+}
+
+static double rotV(int l, int m, int n, const double R1[3][3], const double * Rl1){
+	if(m == 0){
+		return rotP(1, l, 1, n, R1, Rl1) + rotP(-1, l, -1, n, R1, Rl1);
+	}
+	else if(m > 0){
+		double d = m == 1 ? 1 : 0;
+		return rotP(1, l, m-1, n, R1, Rl1) * sqrt(1+d) - rotP(-1, l, -m+1, n, R1, Rl1) * (1-d);
+	}
+	else{
+		double d = m == -1 ? 1 : 0;
+		return rotP(1, l, m+1, n, R1, Rl1) * (1-d) + rotP(-1, l, -m-1, n, R1, Rl1) * sqrt(1+d);
+	}
+}
+
+static double rotW(int l, int m, int n, const double R1[3][3], const double * Rl1){
+	if(m > 0)	return rotP(1, l, m+1, n, R1, Rl1) + rotP(-1, l, -m-1, n, R1, Rl1);
+	else		return rotP(1, l, m-1, n, R1, Rl1) - rotP(-1, l, -m+1, n, R1, Rl1);
+}
+
+void AmbiRotate::rotation(const Mat3d& rot){
+	const int N = channels();
+
+	// Degree 1 harmonics are in the order y, z, x
+	static const int axes[3] = {1, 2, 0};
+	double R1[3][3];
+	for(int i=0; i<3; ++i){
+		for(int j=0; j<3; ++j) R1[i][j] = rot(axes[i], axes[j]);
+	}
+
+	double Rl1[11*11], Rl[11*11];
+	for(int i=0; i<9; ++i) Rl[i] = R1[i/3][i%3];
+
+	for(int l=1; l<=mOrder; ++l){
+		const int n = 2*l + 1;
+		if(l > 1){
+			for(int m=-l; m<=l; ++m){
+				for(int k=-l; k<=l; ++k){
+					double d = m == 0 ? 1 : 0;
+					double denom = abs(k) == l ? (2*l)*(2*l-1) : (l+k)*(l-k);
+					double u = sqrt((l+m)*(l-m) / denom);
+					double v = 0.5 * sqrt((1+d)*(l+abs(m)-1)*(l+abs(m)) / denom) * (1-2*d);
+					double w = -0.5 * sqrt((l-abs(m)-1)*(l-abs(m)) / denom) * (1-d);
+					double r = 0;
+					if(u != 0) r += u * rotU(l, m, k, R1, Rl1);
+					if(v != 0) r += v * rotV(l, m, k, R1, Rl1);
+					if(w != 0) r += w * rotW(l, m, k, R1, Rl1);
+					Rl[(m+l)*n + k+l] = r;
+				}
+			}
+		}
+
+		for(int m=-l; m<=l; ++m){
+			int o = channelIndex(mDim, mOrder, l, m);
+			if(o < 0) continue;
+			for(int k=-l; k<=l; ++k){
+				int i = channelIndex(mDim, mOrder, l, k);
+				if(i < 0) continue;
+				mMatrix[o*N + i] = mScales[o] * Rl[(m+l)*n + k+l] / mScales[i];
+			}
+		}
+
+		for(int i=0; i<n*n; ++i) Rl1[i] = Rl[i];
+	}
+
+	if(!mHasRotation){
+		mPrevMatrix = mMatrix;
+		mHasRotation = true;
+	}
+}
+
+void AmbiRotate::orientation(const Quatd& q){
+	// Inverse of listener rotation, in the Ambisonic coordinate frame
+	// (x, -z, y) that sources are encoded in
+	Quatd inv = q.recip();
+	Mat3d rot;
+	for(int j=0; j<3; ++j){
+		Vec3d axis(0,0,0);
+		axis[j] = 1;
+		Vec3d v = inv.rotate(Vec3d(axis.x, axis.z, -axis.y));
+		rot(0,j) = v.x;
+		rot(1,j) = -v.z;
+		rot(2,j) = v.y;
+	}
+	rotation(rot);
+}
+
+void AmbiRotate::rotate(float * ambiChans, int numFrames){
+	const int N = channels();
+	if(numFrames > mMaxFrames){
+		AL_WARN_ONCE("AmbiRotate::rotate() given %d frames, more than maxFrames() of %d", numFrames, mMaxFrames);
+		return;
+	}
+	memcpy(&mBuffer[0], ambiChans, N * numFrames * sizeof(float));
+
+	const bool ramp = mPrevMatrix != mMatrix;
+
+	for(int l=0; l<=mOrder; ++l){
+		const int * chans = &mDegreeChans[mDegreeStart[l]];
+		const int numChans = mDegreeStart[l+1] - mDegreeStart[l];
+
+		for(int a=0; a<numChans; ++a){
+			const int o = chans[a];
+			float * out = ambiChans + o * numFrames;
+			for(int i=0; i<numFrames; ++i) out[i] = 0.f;
+
+			for(int b=0; b<numChans; ++b){
+				const int c = chans[b];
+				const float * in = &mBuffer[c * numFrames];
+				const float to = mMatrix[o*N + c];
+				if(ramp){
+					const float from = mPrevMatrix[o*N + c];
+					const float inc = (to - from) / numFrames;
+					for(int i=0; i<numFrames; ++i) out[i] += in[i] * (from + inc * (i+1));
+				}
+				else if(to != 0.f){
+					for(int i=0; i<numFrames; ++i) out[i] += in[i] * to;
+				}
+			}
+		}
+	}
+
+	if(ramp) mPrevMatrix = mMatrix;
+}
+
 
 AmbisonicsSpatializer::AmbisonicsSpatializer(
 	SpeakerLayout &sl, int dim, int order, int flavor
 )
 	:	Spatializer(sl), mDecoder(dim, order, sl.numSpeakers(), flavor), mEncoder(dim,order),
-	  mListener(NULL),  mNumFrames(0)
+	  mRotator(dim, order), mListener(NULL),  mNumFrames(0), mRotateAmbi(false)
 {
 	setSpeakerLayout(sl);
 };
@@ -385,6 +653,7 @@ void AmbisonicsSpatializer::numFrames(int v){
 	if(mAmbiDomainChannels.size() != (unsigned long)(mDecoder.channels() * v)){
 		mAmbiDomainChannels.resize(mDecoder.channels() * v);
 	}
+	mRotator.maxFrames(v);
 	mNumFrames = v;
 }
 
@@ -434,11 +703,7 @@ void AmbisonicsSpatializer::renderBuffer(AudioIOData& io,
 //		l.mQuatHistory[i].toVectorZ(axis);
 //		double rf = urel.dot(axis);
 //		//*/
-	Vec3d vec = listeningPose.vec();
-
-	//Rotate vector according to listener-rotation
-	Quatd srcRot = listeningPose.quat();
-	vec = srcRot.rotate(vec);
+	Vec3d vec = sourceDirection(listeningPose);
 
 //	vec = Vec4d(vec.x, -vec.z, vec.y);
 
@@ -453,8 +718,36 @@ void AmbisonicsSpatializer::renderBuffer(AudioIOData& io,
 ////		//mEncoder.direction(-rf, -rr, ru);
 //		mEncoder.encode(ambiChans(), numFrames, i, samples[i]);
 //	}
-	float *outs = &io.out(0,0);//io.outBuffer();
-	mDecoder.decode(outs, ambiChans(), mNumFrames);
+}
+
+void AmbisonicsSpatializer::renderSourceBuffer(AudioIOData& io,
+                          const Pose& listeningPose,
+                          const float *samples,
+                          const int& numFrames,
+                          SoundSource& src
+                          )
+{
+	Vec3d vec = sourceDirection(listeningPose);
+
+	mEncoder.direction(vec.x, -vec.z, vec.y);
+
+	// Ramp from the encoding weights of the source's last block
+	const int numChannels = mEncoder.channels();
+	const float * weights = mEncoder.weights();
+	bool fresh;
+	float * prevWeights = src.spatializerState(this, numChannels, fresh);
+	if(!prevWeights){
+		for(int c=0; c<numChannels; ++c){
+			addRamped(ambiChans(c), samples, numFrames, weights[c], weights[c]);
+		}
+		return;
+	}
+	if(fresh) std::copy(weights, weights + numChannels, prevWeights);
+
+	for(int c=0; c<numChannels; ++c){
+		addRamped(ambiChans(c), samples, numFrames, prevWeights[c], weights[c]);
+		prevWeights[c] = weights[c];
+	}
 }
 
 
@@ -476,11 +769,7 @@ void AmbisonicsSpatializer::renderSample(AudioIOData& io, const Pose& listeningP
 
 //    // cheaper:
 //    Vec3d direction = mListener->quatHistory()[frameIndex].rotateTransposed(urel);
-	Vec3d direction = listeningPose.vec();
-
-	//Rotate vector according to listener-rotation
-	Quatd srcRot = listeningPose.quat();
-	direction = srcRot.rotate(direction);
+	Vec3d direction = sourceDirection(listeningPose);
 	direction = Vec4d(direction.x, direction.z, direction.y);
 
     //mEncoder.direction(azimuth, elevation);
@@ -488,15 +777,34 @@ void AmbisonicsSpatializer::renderSample(AudioIOData& io, const Pose& listeningP
 //    mEncoder.direction(-direction[2], -direction[0], direction[1]);
 	mEncoder.direction(direction[0], direction[1], direction[2]);
     mEncoder.encode(ambiChans(), io.framesPerBuffer(), frameIndex, sample);
+}
+
+Vec3d AmbisonicsSpatializer::sourceDirection(const Pose& listeningPose) const {
+	Vec3d vec = listeningPose.vec();
+
+	//Rotate vector according to listener-rotation, unless the Ambisonic
+	//domain is rotated in finalize()
+	if(!mRotateAmbi){
+		Quatd srcRot = listeningPose.quat();
+		vec = srcRot.rotate(vec);
+	}
+
+	// The encoder expects a unit vector
+	double mag = vec.mag();
+	if(mag > 0) vec /= mag;
+	return vec;
+}
+
+void AmbisonicsSpatializer::finalize(AudioIOData& io){
+	if(mRotateAmbi && mListener){
+		mRotator.orientation(mListener->pose().quat());
+		mRotator.rotate(ambiChans(), mNumFrames);
+	}
 
 	float *outs = &io.out(0,0);//io.outBuffer();
 	mDecoder.decode(outs, ambiChans(), mNumFrames);
 }
 
-//void AmbisonicsSpatializer::finalize(AudioIOData& io){
-//	//previously done in render method of audioscene
-//}
-
 } // al::
 
 #undef WRAP
@@ -1,8 +1,15 @@
 #include "allocore/sound/al_AudioScene.hpp"
 #include "allocore/math/al_Constants.hpp"
+#include "allocore/system/al_Printing.hpp"
+#include "allocore/system/al_Thread.hpp"
+#include "allocore/system/al_Time.h"
 
-
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <iostream>
+#include <mutex>
 
 namespace al{
 
@@ -24,7 +31,8 @@ void AudioSceneObject::updateHistory(){
 
 
 Listener::Listener(int numFrames_, Spatializer *spatializer)
-	:	mSpatializer(spatializer), mIsCompiled(false)
+	:	mSpatializer(spatializer), mIsCompiled(false),
+		mPosition(-1), mPrevPosition(-1), mFirstAtPosition(true)
 {
 	numFrames(numFrames_);
 }
@@ -56,30 +64,562 @@ SoundSource::SoundSource(double nearClip, double farClip,
                          double sampleRate, double farBias, int delaySize
                          )
     :	DistAtten<double>(nearClip, farClip, law, farBias),
-      mSound(delaySize), mUseAtten(true), mDopplerType(dopplerType), mUsePerSampleProcessing(false),
-      mCachedIndex(0), mSampleRate(sampleRate), mSpeedOfSound(340), mFrameCounter(0)
+      mSound(delaySize), mUseAtten(true), mDopplerType(dopplerType), mInterpolation(INTERP_CUBIC),
+      mUsePerSampleProcessing(false),
+      mCachedIndex(0), mSampleRate(sampleRate), mSpeedOfSound(340), mFrameCounter(0),
+      mFramesInBlock(1), mPrevDelay(-1), mPrevGain(0),
+      mActive(true), mPriority(1), mRenderGain(1), mRenderGainPrev(1),
+      mReverbSend(0), mReverbSendPrev(0)
 {
 	// initialize the position history to be VERY FAR AWAY so that we don't deafen ourselves...
 	for(int i=0; i<mPosHistory.size(); ++i){
 		mPosHistory(Vec3d(1000, 0, 0));
 	}
-
-	presenceFilter.set(2700);
 }
 
 int SoundSource::bufferSize(double samplerate, double speedOfSound, double distance){
 	return (int)ceil(samplerate * distance / speedOfSound);
 }
 
+float * SoundSource::spatializerState(const Spatializer * s, unsigned size, bool& fresh){
+	for(unsigned i=0; i<mSpatializerStates.size(); ++i){
+		SpatializerState& state = mSpatializerStates[i];
+		if(state.spatializer == s){
+			if(!size || state.values.size() < size) return NULL;
+			fresh = state.fresh;
+			state.fresh = false;
+			return &state.values[0];
+		}
+	}
+	return NULL;
+}
+
+void SoundSource::reserveSpatializerState(const Spatializer& s){
+	SpatializerState * state = NULL;
+	for(unsigned i=0; i<mSpatializerStates.size(); ++i){
+		if(mSpatializerStates[i].spatializer == &s) state = &mSpatializerStates[i];
+	}
+	if(!state){
+		mSpatializerStates.push_back(SpatializerState());
+		state = &mSpatializerStates.back();
+		state->spatializer = &s;
+	}
+	state->values.assign(s.sourceStateSize(), 0.f);
+	state->fresh = true;
+}
+
+void SoundSource::swapSpatializerStates(SpatializerStates& states){
+	for(unsigned i=0; i<states.size(); ++i){
+		SpatializerState& state = states[i];
+		for(unsigned j=0; j<mSpatializerStates.size(); ++j){
+			const SpatializerState& prev = mSpatializerStates[j];
+			if(prev.spatializer == state.spatializer && prev.values.size() == state.values.size()){
+				std::copy(prev.values.begin(), prev.values.end(), state.values.begin());
+				state.fresh = prev.fresh;
+			}
+		}
+	}
+	mSpatializerStates.swap(states);
+}
+
+namespace{
+
+const ipl::SincTable<8>& sincTable8(){ static ipl::SincTable<8> t; return t; }
+const ipl::SincTable<16>& sincTable16(){ static ipl::SincTable<16> t; return t; }
+const ipl::SincTable<32>& sincTable32(){ static ipl::SincTable<32> t; return t; }
+
+// Interpolators between p[0], a delay line sample, and p[-1], one older
+struct LinearTaps{
+	float operator()(const float * p, float frac) const { return p[0] + (p[-1] - p[0]) * frac; }
+};
+
+struct CubicTaps{
+	float operator()(const float * p, float frac) const { return ipl::cubic(frac, p[1], p[0], p[-1], p[-2]); }
+};
+
+template <class Table>
+struct SincTaps{
+	const Table& table;
+	float operator()(const float * p, float frac) const { return table(p - 1, 1.f - frac); }
+};
+
+template <class Table>
+SincTaps<Table> sincTaps(const Table& t){ return SincTaps<Table>{t}; }
+
+// Read block with a ramped index and gain from delay line that does not wrap
+template <class Interp>
+void readRamped(const Interp& interp, const float * x, float * buffer, int size,
+	double idxFirst, double idxInc, float g, float gainInc
+){
+	for(int i=0; i<size; ++i){
+		double idx = idxFirst + idxInc * i;
+		int idx0 = int(idx);
+		buffer[i] = interp(x - idx0, float(idx - idx0)) * g;
+		g += gainInc;
+	}
+}
+
+} // anon::
+
+void SoundSource::interpolation(DelayInterpolation v){
+	// Build coefficient table here rather than on the audio thread
+	switch(v){
+	case INTERP_SINC8:	sincTable8(); break;
+	case INTERP_SINC16:	sincTable16(); break;
+	case INTERP_SINC32:	sincTable32(); break;
+	default:;
+	}
+	mInterpolation = v;
+}
+
+int SoundSource::interpolationTaps() const {
+	switch(mInterpolation){
+	case INTERP_LINEAR:	return 2;
+	case INTERP_SINC8:	return 8;
+	case INTERP_SINC16:	return 16;
+	case INTERP_SINC32:	return 32;
+	default:			return 4;
+	}
+}
+
+float SoundSource::interpolate(const float * p, float frac) const {
+	switch(mInterpolation){
+	case INTERP_LINEAR:	return LinearTaps()(p, frac);
+	case INTERP_SINC8:	return sincTaps(sincTable8())(p, frac);
+	case INTERP_SINC16:	return sincTaps(sincTable16())(p, frac);
+	case INTERP_SINC32:	return sincTaps(sincTable32())(p, frac);
+	default:			return CubicTaps()(p, frac);
+	}
+}
+
+float SoundSource::readSample(double index) const {
+	const int taps = interpolationTaps();
+	int index0 = int(index);
+
+	// Gather taps so that x[taps/2] is the sample index0 ago
+	float x[32];
+	for(int j=0; j<taps; ++j) x[j] = mSound.read(index0 + taps/2 - j);
+	return interpolate(x + taps/2, index - index0);
+}
+
+void SoundSource::resetRenderState(){
+	mPrevDelay = -1;
+	for(unsigned i=0; i<mPositionStates.size(); ++i){
+		mPositionStates[i].first = -1;
+	}
+	for(unsigned i=0; i<mSpatializerStates.size(); ++i){
+		SpatializerState& state = mSpatializerStates[i];
+		std::fill(state.values.begin(), state.values.end(), 0.f);
+		state.fresh = true;
+	}
+	for(unsigned i=0; i<mAirStates.size(); ++i){
+		mAirStates[i] = 0.f;
+	}
+}
+
+void SoundSource::reserveListeners(int n){
+	if((int)mPositionStates.size() < n-1){
+		mPositionStates.resize(n-1, std::make_pair(-1., 0.));
+	}
+	if((int)mAirStates.size() < 3*n){
+		mAirStates.resize(3*n, 0.f);
+	}
+}
+
+void SoundSource::copyRenderState(int from, int to){
+	std::pair<double, double> state = from ? mPositionStates[from-1] : std::make_pair(mPrevDelay, mPrevGain);
+	if(to){
+		mPositionStates[to-1] = state;
+	}
+	else{
+		mPrevDelay = state.first;
+		mPrevGain = state.second;
+	}
+	std::copy(&mAirStates[3*from], &mAirStates[3*from] + 3, &mAirStates[3*to]);
+}
+
+float SoundSource::level(double delay, int numFrames) const {
+	int begin = int(delay);
+	int end = std::min(begin + numFrames, maxIndex() + 1);
+	float sum = 0.f;
+	for(int i=begin; i<end; ++i){
+		float v = mSound.read(i);
+		sum += v*v;
+	}
+	return numFrames > 0 ? sqrt(sum / numFrames) : 0.f;
+}
+
+void SoundSource::getBuffer(const Pose& listeningPose, float * buffer, const int size){
+	getBuffer(listeningPose, buffer, size, 0);
+}
+
+void SoundSource::getBuffer(const Pose& listeningPose, float * buffer, const int size, int position){
+
+	if(dopplerType() == DOPPLER_PHYSICAL){
+		frame(0, size);
+		for(int i=0; i<size; ++i){
+			buffer[i] = getNextSample(listeningPose);
+		}
+		return;
+	}
+
+	double dist = listeningPose.vec().mag();
+	double delay = 0;
+	if(dopplerType() == DOPPLER_SYMMETRICAL){
+		delay = dist * mSampleRate / mSpeedOfSound;
+	}
+	delay = std::max(delay, double(minIndex()));
+	double gain = attenuation(dist);
+
+	double * prevDelay = &mPrevDelay;
+	double * prevGain = &mPrevGain;
+	if(position == 0){
+		updateHistory();
+	}
+	else{
+		// Sized by AudioScene on the control thread
+		assert((int)mPositionStates.size() >= position);
+		prevDelay = &mPositionStates[position-1].first;
+		prevGain = &mPositionStates[position-1].second;
+	}
+
+	// Nothing to ramp from on the first block
+	if(*prevDelay < 0){
+		*prevDelay = delay;
+		*prevGain = gain;
+	}
+
+	// Frame i reads size-1-i samples behind the newest sample plus the
+	// propagation delay, which reaches the new delay on the last frame.
+	const double delayInc = (delay - *prevDelay) / size;
+	const double idxInc = delayInc - 1.;
+	const double idxFirst = *prevDelay + delayInc + (size-1);
+	const double idxLast = delay;
+	const float gainInc = (gain - *prevGain) / size;
+	float g = *prevGain + gainInc;
+	*prevDelay = delay;
+	*prevGain = gain;
+
+	if(idxFirst > maxIndex() || idxLast > maxIndex()){
+		AL_WARN_ONCE("Delay line exceeded in SoundSource");
+		for(int i=0; i<size; ++i) buffer[i] = 0.f;
+		return;
+	}
+
+	// The read index decreases monotonically unless the source recedes
+	// faster than the speed of sound, so the tap range is spanned by the
+	// first and last frames.
+	const int taps = interpolationTaps();
+	const int N = mSound.size();
+	const int pos = mSound.pos();
+	const int tapBeg = pos - int(std::max(idxFirst, idxLast)) - taps/2;
+	const int tapEnd = pos - int(std::min(idxFirst, idxLast)) + taps/2 - 1;
+
+	if(tapBeg >= 0 && tapEnd < N){
+		// Taps do not wrap: read straight from the delay line
+		const float * x = &mSound[0] + pos;
+		switch(mInterpolation){
+		case INTERP_LINEAR:
+			readRamped(LinearTaps(), x, buffer, size, idxFirst, idxInc, g, gainInc); break;
+		case INTERP_SINC8:
+			readRamped(sincTaps(sincTable8()), x, buffer, size, idxFirst, idxInc, g, gainInc); break;
+		case INTERP_SINC16:
+			readRamped(sincTaps(sincTable16()), x, buffer, size, idxFirst, idxInc, g, gainInc); break;
+		case INTERP_SINC32:
+			readRamped(sincTaps(sincTable32()), x, buffer, size, idxFirst, idxInc, g, gainInc); break;
+		default:
+			readRamped(CubicTaps(), x, buffer, size, idxFirst, idxInc, g, gainInc);
+		}
+	}
+	else{
+		for(int i=0; i<size; ++i){
+			buffer[i] = readSample(idxFirst + idxInc * i) * g;
+			g += gainInc;
+		}
+	}
+}
+
+
+
+
+/// Output buses owned by a render partition
+class PartitionBus : public AudioIOData {
+public:
+	PartitionBus(): AudioIOData(nullptr){}
+
+	void resize(int numFrames, int numChannels){
+		if(numFrames != mFramesPerBuffer || numChannels != mNumO){
+			mFramesPerBuffer = numFrames;
+			mNumO = numChannels;
+			resizeBuf(mBufO, numFrames * numChannels);
+			resizeBuf(mBufT, numFrames);
+		}
+	}
+
+	void rate(double framesPerSecond){ mFramesPerSecond = framesPerSecond; }
+};
+
+
+
+class AudioScene::ParallelRenderer {
+public:
+
+	struct Partition {
+		PartitionBus bus;
+		BiquadBank air{AIR_LANES};			// air absorption of the sources
+		int begin = 0, end = 0;				// range of sources
+		std::atomic<unsigned> claimed{0};	// dispatch index this partition was claimed for
+		std::atomic<unsigned> done{0};		// dispatch index this partition was finished for
+		std::atomic<double> seconds{0.};	// render time of last block
+		double accum = 0.;					// render time accumulated over listeners
+	};
+
+	ParallelRenderer(AudioScene& scene, int numPartitions, int priority)
+	:	mScene(scene), mPartitions(numPartitions)
+	{
+		for(auto& p : mPartitions) p = new Partition;
+
+		// A worker below the priority of the audio thread could be preempted
+		// while the audio thread waits for it, so none is started instead.
+		// The audio thread then renders its partition.
+		for(int i=1; i<numPartitions; ++i){
+			Thread * t = new Thread;
+			t->priority(priority);
+			if(!t->start([this, i](){ workerLoop(i); })){
+				AL_WARN("AudioScene: could not start render thread %d with priority %d; "
+					"its partition is rendered by the audio thread", i, priority);
+				delete t;
+				continue;
+			}
+			mThreads.push_back(t);
+		}
+	}
+
+	~ParallelRenderer(){
+		mQuit = true;
+		mWake.notify_all();
+		for(auto * t : mThreads){
+			t->join();
+			delete t;
+		}
+		for(auto * p : mPartitions) delete p;
+	}
+
+	int size() const { return mPartitions.size(); }
+
+	Partition& partition(int i){ return *mPartitions[i]; }
+	const Partition& partition(int i) const { return *mPartitions[i]; }
+
+	/// Compute signals of rendered sources
+
+	/// With a single listener, the sources are also spatialized for it.
+	///
+	void renderSources(AudioIOData& io, Listener * single){
+		int numSources = mScene.mRendered.size();
+
+		mJob = SOURCES;
+		mListener = single;
+		mReentrant = single && single->mSpatializer->reentrant();
+
+		for(int i=0; i<size(); ++i){
+			Partition& p = partition(i);
+			p.begin = (numSources * i) / size();
+			p.end = (numSources * (i+1)) / size();
+			if(mReentrant) p.bus.rate(io.framesPerSecond());
+		}
+
+		dispatch();
+
+		if(mReentrant){
+			sumBuses(io);
+		}
+		else if(single){
+			for(int s=0; s<numSources; ++s){
+				mScene.spatializeSource(*single, *mScene.mRendered[s], mScene.sourceBuffer(s, 0), io);
+			}
+		}
+	}
+
+	/// Render listeners concurrently from the source signals
+
+	/// Each listener is rendered by one thread into the bus of a partition.
+	///
+	void renderListeners(AudioIOData& io){
+		mJob = LISTENERS;
+		for(int i=0; i<size(); ++i) partition(i).bus.rate(io.framesPerSecond());
+		dispatch();
+		sumBuses(io);
+	}
+
+	/// Size the output buses of the partitions; not while rendering
+	void resizeBuses(int numFrames, int numChannels){
+		for(auto * p : mPartitions) p->bus.resize(numFrames, numChannels);
+	}
+
+	/// Whether the buses hold all channels written by the listeners
+	bool busesFit(const Listeners& listeners) const {
+		for(unsigned il=0; il<listeners.size(); ++il){
+			if(listeners[il]->mSpatializer->numDeviceChannels() > partition(0).bus.channelsOut()) return false;
+		}
+		return true;
+	}
+
+	void beginBlock(){
+		for(auto * p : mPartitions) p->accum = 0.;
+	}
+
+	void endBlock(){
+		for(auto * p : mPartitions) p->seconds.store(p->accum);
+	}
+
+private:
+	AudioScene& mScene;
+	std::vector<Partition *> mPartitions;
+	std::vector<Thread *> mThreads;
+	enum Job{ SOURCES, LISTENERS };
+	Job mJob = SOURCES;
+	Listener * mListener = nullptr;	// single listener to spatialize sources for
+	bool mReentrant = false;
+
+	std::atomic<unsigned> mDispatch{0};
+	std::atomic<bool> mQuit{false};
+	std::mutex mWakeLock;
+	std::condition_variable mWake;
+	std::atomic<bool> mWaiting{false};	// audio thread sleeps on mDone
+	std::mutex mDoneLock;
+	std::condition_variable mDone;
+
+	void sumBuses(AudioIOData& io){
+		int numChannels = std::min(partition(0).bus.channelsOut(), io.channelsOut());
+		int numSamples = mScene.mNumFrames * numChannels;
+		float * out = io.outBuffer();
+		for(int i=0; i<size(); ++i){
+			const float * bus = partition(i).bus.outBuffer();
+			for(int k=0; k<numSamples; ++k) out[k] += bus[k];
+		}
+	}
+
+	// Publish the job and render partitions until all are done
+	void dispatch(){
+		// Everything written before is visible to any thread that observes
+		// the new dispatch index.
+		unsigned dispatch = mDispatch.load(std::memory_order_relaxed) + 1;
+		mDispatch.store(dispatch, std::memory_order_release);
+		mWake.notify_all();
+
+		for(int i=0; i<size(); ++i){
+			renderPartition(i, dispatch);
+		}
+
+		for(int i=0; i<size(); ++i){
+			waitDone(partition(i), dispatch);
+		}
+	}
+
+	// Wait for a worker to finish a claimed partition. The wait spins only
+	// briefly, then sleeps, so that a preempted worker gets to run.
+	void waitDone(Partition& p, unsigned dispatch){
+		const al_nsec spinEnd = al_steady_time_nsec() + 20000;
+		while(p.done.load(std::memory_order_acquire) != dispatch){
+			if(al_steady_time_nsec() < spinEnd) continue;
+			std::unique_lock<std::mutex> lk(mDoneLock);
+			mWaiting.store(true);
+			while(p.done.load() != dispatch){
+				mDone.wait_for(lk, std::chrono::milliseconds(1));
+			}
+			mWaiting.store(false);
+		}
+	}
+
+	// Claim and render a partition. Returns false if another thread claimed it.
+	bool renderPartition(int i, unsigned dispatch){
+		Partition& p = partition(i);
+		unsigned prev = p.claimed.load(std::memory_order_acquire);
+		if(prev == dispatch || !p.claimed.compare_exchange_strong(prev, dispatch)){
+			return false;
+		}
+
+		al_nsec t0 = al_steady_time_nsec();
+
+		if(mJob == SOURCES){
+			if(mReentrant) p.bus.zeroOut();
+			for(int s=p.begin; s<p.end; ++s){
+				mScene.getSourceBuffers(s);
+			}
+			if(mScene.mAirAmount > 0.f){
+				mScene.absorbSources(p.begin, p.end, p.air);
+			}
+			if(mReentrant){
+				for(int s=p.begin; s<p.end; ++s){
+					mScene.spatializeSource(*mListener, *mScene.mRendered[s], mScene.sourceBuffer(s, 0), p.bus);
+				}
+			}
+		}
+		else{
+			p.bus.zeroOut();
+			for(unsigned il=i; il<mScene.mListeners.size(); il+=size()){
+				mScene.renderListener(*mScene.mListeners[il], p.bus);
+			}
+		}
+
+		p.accum += (al_steady_time_nsec() - t0) * al_time_ns2s;
+		p.done.store(dispatch);
+		if(mWaiting.load()){
+			std::lock_guard<std::mutex> lk(mDoneLock);
+			mDone.notify_all();
+		}
+		return true;
+	}
+
+	void workerLoop(int index){
+		unsigned last = 0;
+		while(true){
+			{
+				// A missed notification only delays the worker; the audio
+				// thread renders any partition left unclaimed.
+				std::unique_lock<std::mutex> lk(mWakeLock);
+				mWake.wait_for(lk, std::chrono::milliseconds(10), [&]{
+					return mQuit.load() || mDispatch.load(std::memory_order_acquire) != last;
+				});
+			}
+			if(mQuit.load()) return;
+
+			unsigned dispatch = mDispatch.load(std::memory_order_acquire);
+			if(dispatch == last) continue;
+			last = dispatch;
+
+			// Start with own partition, then help with the others
+			for(int k=0; k<size(); ++k){
+				renderPartition((index + k) % size(), dispatch);
+			}
+		}
+	}
+};
+
 
 
 AudioScene::AudioScene(int numFrames_)
-	:   mNumFrames(0), mPerSampleProcessing(false)
+	:   mNumFrames(0), mPerSampleProcessing(false), mParallel(NULL),
+	    mMaxSources(0), mCullThreshold(0), mCullFar(false),
+	    mAirAbsorption(0), mAirAmount(0), mAir(AIR_LANES), mReverb(NULL),
+	    mChanges(1024 * sizeof(Change)), mGarbage((GARBAGE_SLOTS + 1) * sizeof(Change)),
+	    mGrowsInFlight(0),
+	    mSourceCapacity(64), mNumListeners(0), mListenerCapacity(4),
+	    mNumSent(0), mNumApplied(0)
 {
+	mSources.reserve(mSourceCapacity);
+	mRendered.reserve(mSourceCapacity);
+	mRanked.reserve(mSourceCapacity);
+	mListeners.reserve(mListenerCapacity);
 	numFrames(numFrames_);
 }
 
 AudioScene::~AudioScene(){
+	// Apply everything still queued, so that queued listeners are deleted
+	while(pendingChanges()) applyChanges();
+	flushChanges();
+
+	delete mParallel;
 	for(
 		Listeners::iterator it = mListeners.begin();
 		it != mListeners.end();
@@ -89,16 +629,170 @@ AudioScene::~AudioScene(){
 	}
 }
 
+AudioScene::SourceStorage * AudioScene::newSourceStorage(int capacity){
+	SourceStorage * st = new SourceStorage;
+	st->sources.reserve(capacity);
+	st->rendered.reserve(capacity);
+	st->ranked.reserve(capacity);
+	st->buffers.resize(capacity * mListenerCapacity * mNumFrames);
+	return st;
+}
+
+SoundSource::SpatializerStates AudioScene::newSpatializerStates() const {
+	SoundSource::SpatializerStates states(mSpatializers.size());
+	for(unsigned i=0; i<mSpatializers.size(); ++i){
+		states[i].spatializer = mSpatializers[i];
+		states[i].values.resize(mSpatializers[i]->sourceStateSize(), 0.f);
+		states[i].fresh = true;
+	}
+	return states;
+}
+
+void AudioScene::swapSourceStates(SourceStorage& st){
+	// Carry the state of sources over to their new storage
+	for(unsigned i=0; i<st.positionStates.size(); ++i){
+		SoundSource& src = *st.positionStates[i].first;
+		std::vector<std::pair<double, double> >& states = st.positionStates[i].second;
+		if(states.size() > src.mPositionStates.size()){
+			std::copy(src.mPositionStates.begin(), src.mPositionStates.end(), states.begin());
+			src.mPositionStates.swap(states);
+		}
+	}
+	for(unsigned i=0; i<st.airStates.size(); ++i){
+		SoundSource& src = *st.airStates[i].first;
+		std::vector<float>& states = st.airStates[i].second;
+		if(states.size() > src.mAirStates.size()){
+			std::copy(src.mAirStates.begin(), src.mAirStates.end(), states.begin());
+			src.mAirStates.swap(states);
+		}
+	}
+	for(unsigned i=0; i<st.spatializerStates.size(); ++i){
+		st.spatializerStates[i].first->swapSpatializerStates(st.spatializerStates[i].second);
+	}
+}
+
+bool AudioScene::queueChange(const Change& c){
+	if(mChanges.writeSpace() < sizeof(Change)) return false;
+	if(c.sources || c.listeners){
+		// The audio thread must be able to return the storage it replaces
+		if(mGrowsInFlight == GARBAGE_SLOTS) return false;
+		++mGrowsInFlight;
+	}
+	mChanges.write((const char *)&c, sizeof(Change));
+	return true;
+}
+
+void AudioScene::sendChange(const Change& c){
+	flushChanges();
+	if(!mOverflow.empty() || !queueChange(c)){
+		mOverflow.push_back(c);
+	}
+	++mNumSent;
+}
+
+void AudioScene::flushChanges(){
+	Change c;
+	while(mGarbage.readSpace() >= sizeof(Change)){
+		mGarbage.read((char *)&c, sizeof(Change));
+		delete c.sources;
+		delete c.listeners;
+		--mGrowsInFlight;
+	}
+
+	unsigned i = 0;
+	while(i<mOverflow.size() && queueChange(mOverflow[i])) ++i;
+	mOverflow.erase(mOverflow.begin(), mOverflow.begin() + i);
+}
+
+void AudioScene::applyChanges(){
+	unsigned numApplied = 0;
+	Change c;
+	while(mChanges.readSpace() >= sizeof(Change)){
+		mChanges.read((char *)&c, sizeof(Change));
+		switch(c.type){
+		case Change::ADD_SOURCE:
+			mSources.push_back(c.source);
+			break;
+		case Change::REMOVE_SOURCE:
+			mSources.erase(std::remove(mSources.begin(), mSources.end(), c.source), mSources.end());
+			break;
+		case Change::ADD_LISTENER:
+			mListeners.push_back(c.listener);
+			break;
+		case Change::GROW_SOURCES:
+			// Fill within reserved capacity and swap buffers, so nothing is allocated
+			c.sources->sources.assign(mSources.begin(), mSources.end());
+			mSources.swap(c.sources->sources);
+			mRendered.swap(c.sources->rendered);
+			mRanked.swap(c.sources->ranked);
+			mSourceBuffers.swap(c.sources->buffers);
+			swapSourceStates(*c.sources);
+			break;
+		case Change::GROW_LISTENERS:
+			c.listeners->assign(mListeners.begin(), mListeners.end());
+			mListeners.swap(*c.listeners);
+			break;
+		case Change::SOURCE_STATES:
+			swapSourceStates(*c.sources);
+			break;
+		}
+
+		if(c.sources || c.listeners){
+			// There is room, as the control thread keeps at most
+			// GARBAGE_SLOTS of these queued or unfreed
+			mGarbage.write((const char *)&c, sizeof(Change));
+		}
+		++numApplied;
+	}
+	if(numApplied) mNumApplied.fetch_add(numApplied, std::memory_order_release);
+}
+
+unsigned AudioScene::pendingChanges(){
+	flushChanges();
+	return mNumSent - mNumApplied.load(std::memory_order_acquire);
+}
+
 void AudioScene::addSource(SoundSource& src){
-	mSources.push_back(&src);
+	Change c = Change();
+	if((int)mRegistered.size() == mSourceCapacity){
+		mSourceCapacity *= 2;
+		c.type = Change::GROW_SOURCES;
+		c.sources = newSourceStorage(mSourceCapacity);
+		sendChange(c);
+		c = Change();
+	}
+	// Not yet rendered, so its state can be allocated in place
+	src.reserveListeners(mListenerCapacity);
+	src.mSpatializerStates = newSpatializerStates();
+	mRegistered.push_back(&src);
+	c.type = Change::ADD_SOURCE;
+	c.source = &src;
+	sendChange(c);
 }
 
 void AudioScene::removeSource(SoundSource& src){
-	mSources.remove(&src);
+	mRegistered.erase(std::remove(mRegistered.begin(), mRegistered.end(), &src), mRegistered.end());
+	Change c = Change();
+	c.type = Change::REMOVE_SOURCE;
+	c.source = &src;
+	sendChange(c);
+}
+
+void AudioScene::updateSourceStates(){
+	if(mRegistered.empty()) return;
+	Change c = Change();
+	c.type = Change::SOURCE_STATES;
+	c.sources = new SourceStorage;
+	for(unsigned i=0; i<mRegistered.size(); ++i){
+		c.sources->spatializerStates.push_back(std::make_pair(mRegistered[i], newSpatializerStates()));
+	}
+	sendChange(c);
 }
 
 void AudioScene::numFrames(int v){
 	if(mNumFrames != v){
+		// Not rendering, so changes can be applied here
+		while(pendingChanges()) applyChanges();
 
 		Listeners::iterator it = mListeners.begin();
 		while(it != mListeners.end()){
@@ -107,13 +801,50 @@ void AudioScene::numFrames(int v){
 		}
 		mNumFrames = v;
 		mBuffer.resize(mNumFrames);
+		mReverbBus.resize(mNumFrames);
+		mSourceBuffers.resize(mSourceCapacity * mListenerCapacity * mNumFrames);
+		// Spatializer state may depend on the number of frames
+		updateSourceStates();
+		while(pendingChanges()) applyChanges();
+		if(mParallel) resizeParallelBuses();
 	}
 }
 
 Listener * AudioScene::createListener(Spatializer* spatializer){
 	Listener * l = new Listener(mNumFrames, spatializer);
 	l->compile();
-	mListeners.push_back(l);
+
+	Change c = Change();
+	if(mNumListeners == mListenerCapacity){
+		mListenerCapacity *= 2;
+		c.type = Change::GROW_LISTENERS;
+		c.listeners = new Listeners;
+		c.listeners->reserve(mListenerCapacity);
+		sendChange(c);
+
+		// Source signals and state are kept per listener position
+		c = Change();
+		c.type = Change::GROW_SOURCES;
+		c.sources = newSourceStorage(mSourceCapacity);
+		for(unsigned i=0; i<mRegistered.size(); ++i){
+			c.sources->positionStates.push_back(std::make_pair(mRegistered[i],
+				std::vector<std::pair<double, double> >(mListenerCapacity-1, std::make_pair(-1., 0.))));
+			c.sources->airStates.push_back(std::make_pair(mRegistered[i],
+				std::vector<float>(3*mListenerCapacity, 0.f)));
+		}
+		sendChange(c);
+		c = Change();
+	}
+	// The spatializer's state of each source is in place before the
+	// listener is rendered
+	if(std::find(mSpatializers.begin(), mSpatializers.end(), spatializer) == mSpatializers.end()){
+		mSpatializers.push_back(spatializer);
+		updateSourceStates();
+	}
+	++mNumListeners;
+	c.type = Change::ADD_LISTENER;
+	c.listener = l;
+	sendChange(c);
 	return l;
 }
 
@@ -125,44 +856,331 @@ Listener * AudioScene::createListener(Spatializer* spatializer){
 	The head-size sets the effective doppler near-clip.
 */
 
+void AudioScene::numThreads(int n, int priority){
+	delete mParallel;
+	mParallel = NULL;
+	if(n > 1){
+		mParallel = new ParallelRenderer(*this, n, priority);
+		resizeParallelBuses();
+	}
+}
+
+void AudioScene::resizeParallelBuses(){
+	// Not rendering, so changes can be applied here
+	while(pendingChanges()) applyChanges();
+
+	int numChannels = 0;
+	for(unsigned il=0; il<mListeners.size(); ++il){
+		numChannels = std::max(numChannels, mListeners[il]->mSpatializer->numDeviceChannels());
+	}
+	mParallel->resizeBuses(mNumFrames, numChannels);
+}
+
+int AudioScene::numThreads() const {
+	return mParallel ? mParallel->size() : 1;
+}
+
+double AudioScene::threadTime(int i) const {
+	if(!mParallel || i < 0 || i >= mParallel->size()) return 0.;
+	return mParallel->partition(i).seconds.load();
+}
+
+void AudioScene::getSourceBuffer(Listener& l, SoundSource& src, float * buffer){
+	Pose relpos(src.pose().pos() - l.pose().pos(), src.pose().quat() /l.pose().quat());
+	if(mPerSampleProcessing) { //audioscene per sample processing
+		src.frame(0, mNumFrames);
+		for(int i=0; i < mNumFrames; ++i){
+			buffer[i] = src.getNextSample(relpos);
+		}
+	} else { //more efficient, per buffer processing for audioscene
+		src.getBuffer(relpos, buffer, mNumFrames, l.mPosition);
+	}
+
+	if(mAirAmount > 0.f){
+		// Sized on the control thread
+		src.mAirStates[3 * l.mPosition + 2] = relpos.vec().mag();
+	}
+
+	// Fade when entering or leaving the rendered set
+	float gain = src.mRenderGainPrev;
+	if(gain != 1.f || src.mRenderGain != 1.f){
+		float inc = (src.mRenderGain - gain) / mNumFrames;
+		for(int i=0; i < mNumFrames; ++i){
+			gain += inc;
+			buffer[i] *= gain;
+		}
+	}
+}
+
+void AudioScene::spatializeSource(Listener& l, SoundSource& src, const float * buffer, AudioIOData& io){
+	Spatializer* spatializer = l.mSpatializer;
+	Pose relpos(src.pose().pos() - l.pose().pos(), src.pose().quat() /l.pose().quat());
+	if(mPerSampleProcessing) {
+		for(int i=0; i < mNumFrames; ++i){
+			spatializer->renderSourceSample(io, relpos, buffer[i], i, src);
+		}
+	} else {
+		spatializer->renderSourceBuffer(io, relpos, buffer, mNumFrames, src);
+	}
+}
+
+void AudioScene::cullSources(){
+	const bool needLevel = mCullThreshold > 0.f || mMaxSources > 0;
+	mRanked.clear();
+
+	for(unsigned is=0; is<mSources.size(); ++is){
+		SoundSource& src = *mSources[is];
+		src.mRenderGainPrev = src.mRenderGain;
+		bool audible = src.active() && !mListeners.empty();
+
+		if(audible){
+			double dist = (src.pos() - mListeners[0]->pos()).mag();
+			for(unsigned il=1; il<mListeners.size(); ++il){
+				dist = std::min(dist, (src.pos() - mListeners[il]->pos()).mag());
+			}
+
+			double delay = 0;
+			if(src.dopplerType() != DOPPLER_NONE){
+				delay = dist * src.mSampleRate / src.mSpeedOfSound;
+			}
+
+			if(delay + mNumFrames > src.maxIndex()){
+				// Would only read past the delay line, so there is nothing to fade
+				audible = false;
+				src.mRenderGainPrev = 0.f;
+			}
+			else if(mCullFar && dist > src.farClip()){
+				audible = false;
+			}
+			else if(needLevel){
+				float amp = src.attenuation(dist) * src.level(delay, mNumFrames);
+				if(amp < mCullThreshold){
+					audible = false;
+				}
+				else{
+					float rank = amp * src.priority();
+					if(src.mRenderGainPrev > 0.f) rank *= 1.26f;
+					mRanked.push_back(std::make_pair(rank, &src));
+				}
+			}
+		}
+
+		src.mRenderGain = audible ? 1.f : 0.f;
+	}
+
+	// Fade out the quietest sources over budget
+	if(mMaxSources > 0 && (int)mRanked.size() > mMaxSources){
+		std::nth_element(
+			mRanked.begin(), mRanked.begin() + mMaxSources, mRanked.end(),
+			[](const std::pair<float, SoundSource *>& a, const std::pair<float, SoundSource *>& b){
+				return a.first > b.first;
+			}
+		);
+		for(unsigned i=mMaxSources; i<mRanked.size(); ++i){
+			mRanked[i].second->mRenderGain = 0.f;
+		}
+	}
+
+	mRendered.clear();
+	for(unsigned is=0; is<mSources.size(); ++is){
+		SoundSource& src = *mSources[is];
+		if(src.mRenderGainPrev > 0.f || src.mRenderGain > 0.f){
+			if(src.mRenderGainPrev == 0.f) src.resetRenderState();
+			mRendered.push_back(&src);
+		}
+	}
+}
+
+void AudioScene::groupListeners(){
+	// Listeners are only ever appended, so indices stay the same from block
+	// to block and so does the state of each position. Listeners share a
+	// position only once they were together for a whole block, so that one
+	// arriving ramps to the shared position on its own state first.
+	for(unsigned il=0; il<mListeners.size(); ++il){
+		Listener& l = *mListeners[il];
+		if(l.mPosition < 0) l.mPrevPos = l.pos();
+		l.mPrevPosition = l.mPosition;
+		l.mPosition = il;
+		l.mFirstAtPosition = true;
+		for(unsigned k=0; k<il; ++k){
+			const Listener& other = *mListeners[k];
+			if(other.pos() == l.pos() && other.mPrevPos == l.mPrevPos){
+				l.mPosition = other.mPosition;
+				l.mFirstAtPosition = false;
+				break;
+			}
+		}
+	}
+	for(unsigned il=0; il<mListeners.size(); ++il){
+		mListeners[il]->mPrevPos = mListeners[il]->pos();
+	}
+}
+
+void AudioScene::getSourceBuffers(int s){
+	SoundSource& src = *mRendered[s];
+
+	// A listener leaving a shared position ramps from the shared state, which
+	// is where it was at the end of the last block
+	for(unsigned il=0; il<mListeners.size(); ++il){
+		Listener& l = *mListeners[il];
+		if(l.mFirstAtPosition && l.mPrevPosition >= 0 && l.mPrevPosition != l.mPosition){
+			src.copyRenderState(l.mPrevPosition, l.mPosition);
+		}
+	}
+
+	for(unsigned il=0; il<mListeners.size(); ++il){
+		Listener& l = *mListeners[il];
+		if(l.mFirstAtPosition){
+			getSourceBuffer(l, src, sourceBuffer(s, l.mPosition));
+		}
+	}
+}
+
+// Air at 20 C and 50% relative humidity absorbs about 0.1 dB per meter at
+// 8 kHz, growing roughly with the square of frequency. The cutoff is where the
+// absorption over the distance reaches 3 dB.
+static double airCutoff(double distance){
+	return 8000. * sqrt(30. / std::max(distance, 1e-3));
+}
+
+void AudioScene::absorbSources(int begin, int end, BiquadBank& bank){
+	float * buffers[AIR_LANES];
+	float * states[AIR_LANES];
+	int n = 0;
+
+	for(int s=begin; s<end; ++s){
+		SoundSource& src = *mRendered[s];
+		bank.setSampleRate(src.mSampleRate);
+		for(unsigned il=0; il<mListeners.size(); ++il){
+			if(!mListeners[il]->mFirstAtPosition) continue;
+			float * state = &src.mAirStates[3 * il];
+			bank.setState(n, state);
+			bank.set(n, BIQUAD_LPF, airCutoff(state[2] * mAirAmount));
+			buffers[n] = sourceBuffer(s, il);
+			states[n] = state;
+
+			if(++n == AIR_LANES){
+				bank.process(buffers, buffers, mNumFrames, n);
+				for(int k=0; k<n; ++k) bank.getState(k, states[k]);
+				n = 0;
+			}
+		}
+	}
+	if(n){
+		bank.process(buffers, buffers, mNumFrames, n);
+		for(int k=0; k<n; ++k) bank.getState(k, states[k]);
+	}
+}
+
+void AudioScene::sendSources(){
+	std::fill(mReverbBus.begin(), mReverbBus.end(), 0.f);
+	for(unsigned is=0; is<mRendered.size(); ++is){
+		SoundSource& src = *mRendered[is];
+		float send = src.mReverbSendPrev;
+		float inc = (src.mReverbSend - send) / mNumFrames;
+		src.mReverbSendPrev = src.mReverbSend;
+		if(send == 0.f && inc == 0.f) continue;
+
+		const float * buffer = sourceBuffer(is, 0);
+		for(int i=0; i<mNumFrames; ++i){
+			send += inc;
+			mReverbBus[i] += buffer[i] * send;
+		}
+	}
+}
+
+void AudioScene::renderListener(Listener& l, AudioIOData& io){
+	Spatializer* spatializer = l.mSpatializer;
+	spatializer->prepare();
+
+	// update listener history data:
+	l.updateHistory(mNumFrames);
+
+	for(unsigned is=0; is<mRendered.size(); ++is){
+		spatializeSource(l, *mRendered[is], sourceBuffer(is, l.mPosition), io);
+	}
+
+	spatializer->finalize(io);
+}
+
 void AudioScene::render(AudioIOData& io) {
 	assert(io.framesPerBuffer() == mNumFrames);
 
 	// double sampleRate = io.framesPerSecond();
 	io.zeroOut();
 
-	// iterate through all listeners adding contribution from all sources
-	for(unsigned il=0; il<mListeners.size(); ++il){
-		Listener& l = *mListeners[il];
+	applyChanges();
+	cullSources();
+	groupListeners();
+	mAirAmount = mAirAbsorption;
+	FDNReverb * reverb = mReverb;
+
+	// The buses were sized for the listeners known when numThreads() was called
+	ParallelRenderer * parallel = mParallel;
+	if(parallel && !parallel->busesFit(mListeners)){
+		AL_WARN_ONCE("AudioScene: a listener writes more channels than the render buses hold; "
+			"call numThreads() after creating it. Rendering serially.");
+		parallel = NULL;
+	}
+	if(parallel) parallel->beginBlock();
 
+	if(mListeners.size() == 1){
+		Listener& l = *mListeners[0];
 		Spatializer* spatializer = l.mSpatializer;
 		spatializer->prepare();
 
 		// update listener history data:
 		l.updateHistory(mNumFrames);
 
-		// iterate through all sound sources
-		for(Sources::iterator it = mSources.begin(); it != mSources.end(); ++it){
-			SoundSource& src = *(*it);
-			if(mPerSampleProcessing) { //audioscene per sample processing
-				src.frame(0);
-                for(int i=0; i < mNumFrames; ++i){
-                    Pose relpos(src.pose().pos() - l.pose().pos(), src.pose().quat() /l.pose().quat());
-					spatializer->renderSample(io, relpos, src.getNextSample(l), i);
-				}
-			} else { //more efficient, per buffer processing for audioscene (does not work well with doppler)
-				Pose relpos(src.pose().pos() - l.pose().pos(), src.pose().quat() /l.pose().quat());
-				src.getBuffer(relpos, mBuffer.data(), mNumFrames);
-//				std::cout << l.pose().x() << "," << l.pose().z() << " ---- ";
-//				std::cout << src.pos().x << "," << src.pos().z << " ----- ";
-//				std::cout << relpos.x << "," << relpos.z << std::endl;
-				spatializer->renderBuffer(io, relpos, mBuffer.data(), mNumFrames);
+		if(parallel){
+			parallel->renderSources(io, &l);
+		}
+		else if(mAirAmount > 0.f || reverb){
+			// Keep all source signals, to filter them together before
+			// spatializing them and to send them to the reverb
+			for(unsigned is=0; is<mRendered.size(); ++is){
+				getSourceBuffers(is);
+			}
+			if(mAirAmount > 0.f) absorbSources(0, mRendered.size(), mAir);
+			for(unsigned is=0; is<mRendered.size(); ++is){
+				spatializeSource(l, *mRendered[is], sourceBuffer(is, 0), io);
+			}
+		}
+		else{
+			// iterate through all sound sources
+			for(unsigned is=0; is<mRendered.size(); ++is){
+				SoundSource& src = *mRendered[is];
+				getSourceBuffer(l, src, mBuffer.data());
+				spatializeSource(l, src, mBuffer.data(), io);
 			}
-		} //end for each source
+		}
 
 		spatializer->finalize(io);
+	}
+	else if(mListeners.size() > 1){
+		// Compute each source signal once per listener position, then render
+		// the listeners from them
+		if(parallel){
+			parallel->renderSources(io, NULL);
+			parallel->renderListeners(io);
+		}
+		else{
+			for(unsigned is=0; is<mRendered.size(); ++is){
+				getSourceBuffers(is);
+			}
+			if(mAirAmount > 0.f) absorbSources(0, mRendered.size(), mAir);
+			for(unsigned il=0; il<mListeners.size(); ++il){
+				renderListener(*mListeners[il], io);
+			}
+		}
+	}
+
+	if(reverb && !mListeners.empty()){
+		sendSources();
+		reverb->render(io, &mReverbBus[0], mNumFrames);
+	}
 
-	} // end for each listener
+	if(parallel) parallel->endBlock();
 }
 
 } // al::
@@ -0,0 +1,610 @@
+#include "allocore/sound/al_Binaural.hpp"
+#include "allocore/sound/al_Ambisonics.hpp"
+#include "allocore/system/al_Printing.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+namespace al{
+
+// HRIRSet
+
+HRIRSet::HRIRSet(int length, double sampleRate)
+:	mLength(length), mSampleRate(sampleRate)
+{}
+
+void HRIRSet::clear(int length, double sampleRate){
+	mLength = length;
+	mSampleRate = sampleRate;
+	mAzimuths.clear();
+	mElevations.clear();
+	mDirections.clear();
+	mSamples.clear();
+}
+
+void HRIRSet::add(float azimuth, float elevation, const float * left, const float * right){
+	mAzimuths.push_back(azimuth);
+	mElevations.push_back(elevation);
+	mDirections.push_back(Vec3f(Speaker(0, azimuth, elevation).vec().normalized()));
+	mSamples.insert(mSamples.end(), left, left + mLength);
+	mSamples.insert(mSamples.end(), right, right + mLength);
+}
+
+bool HRIRSet::load(const std::string& path){
+	std::ifstream file(path.c_str());
+	if(!file){
+		AL_WARN("Could not open HRIR file %s", path.c_str());
+		clear(0, mSampleRate);
+		return false;
+	}
+
+	// Strip comments
+	std::stringstream numbers;
+	std::string line;
+	while(std::getline(file, line)){
+		numbers << line.substr(0, line.find('#')) << '\n';
+	}
+
+	double sampleRate;
+	int length;
+	if(!(numbers >> sampleRate >> length) || sampleRate <= 0 || length <= 0){
+		AL_WARN("HRIR file %s does not start with a sample rate and length", path.c_str());
+		clear(0, mSampleRate);
+		return false;
+	}
+
+	clear(length, sampleRate);
+	std::vector<float> irs(2 * length);
+	float az, el;
+	while(numbers >> az >> el){
+		for(int i=0; i<2*length; ++i){
+			if(!(numbers >> irs[i])){
+				AL_WARN("HRIR file %s ends inside measurement %d", path.c_str(), size());
+				clear(0, sampleRate);
+				return false;
+			}
+		}
+		add(az, el, &irs[0], &irs[length]);
+	}
+	if(!numbers.eof()){
+		AL_WARN("HRIR file %s has a non-numeric value after measurement %d", path.c_str(), size());
+		clear(0, sampleRate);
+		return false;
+	}
+	return true;
+}
+
+
+
+// BinauralSpatializer
+
+// Layout of the state kept in each source
+enum{
+	STATE_MODE = 0,		// BinauralMode the state was made for
+	STATE_BLOCK,		// block last rendered, modulo 2^24
+	STATE_HRIR,			// measurement of last block, or -1
+	STATE_SLOT,			// slot of last input spectrum
+	STATE_HEADER		// followed by the input window and spectra, or by
+						// the Ambisonic weights of the last block
+};
+
+static const unsigned BLOCK_MASK = 0xffffff;	// exact as a float
+static const int MAX_AMBI_ORDER = 5;
+
+// Position of source in the coordinates of Speaker::vec(), as for VBAP
+static Vec3f speakerCoords(const Pose& reldir){
+	Vec3d vec = reldir.quat().rotate(reldir.vec());
+	return Vec3f(vec.x, vec.z, vec.y);
+}
+
+BinauralSpatializer::BinauralSpatializer(const SpeakerLayout& sl)
+:	Spatializer(sl)
+{
+	init();
+}
+
+BinauralSpatializer::BinauralSpatializer(const HRIRSet& hrirs, const SpeakerLayout& sl)
+:	Spatializer(sl)
+{
+	init();
+	this->hrirs(hrirs);
+}
+
+void BinauralSpatializer::init(){
+	mMode = BINAURAL_DIRECT;
+	mAmbiOrder = 3;
+	mNumFrames = 0;
+	mPartSize = mFFTSize = mNumBins = 0;
+	mNumParts = 1;
+	mAmbiSlot = mAmbiTail = 0;
+	mBlock = 0;
+	mRendered = mFaded = false;
+	if(mSpeakers.size() < 2){
+		AL_WARN("BinauralSpatializer needs two speakers, for the left and right ears");
+	}
+}
+
+void BinauralSpatializer::hrirs(const HRIRSet& v){
+	mHRIRs = v;
+	rebuild();
+}
+
+bool BinauralSpatializer::load(const std::string& path){
+	bool loaded = mHRIRs.load(path);
+	rebuild();
+	return loaded;
+}
+
+void BinauralSpatializer::mode(BinauralMode v){
+	mMode = v;
+	rebuild();
+}
+
+void BinauralSpatializer::ambisonicOrder(int v){
+	mAmbiOrder = std::max(1, std::min(v, MAX_AMBI_ORDER));
+	rebuild();
+}
+
+void BinauralSpatializer::numFrames(int v){
+	mNumFrames = v;
+	mPartSize = v;
+	rebuild();
+}
+
+void BinauralSpatializer::rebuild(){
+	// Sources must not continue from state made for the old filters
+	mBlock += 2;
+
+	if(mPartSize <= 0) return;
+
+	const int B = mPartSize;
+	mFFTSize = 4;
+	while(mFFTSize < 2*B) mFFTSize <<= 1;
+	const int N = mFFTSize;
+	const int M = N/2;
+	mNumBins = M + 1;
+	const int S = spectrumSize();
+
+	mBitReverse.resize(M);
+	int bits = 0;
+	while((1<<bits) < M) ++bits;
+	for(int i=0; i<M; ++i){
+		int r = 0;
+		for(int b=0; b<bits; ++b) if(i & (1<<b)) r |= 1 << (bits-1-b);
+		mBitReverse[i] = r;
+	}
+	mFFTTwiddles.resize(M);
+	for(int k=0; k<M/2; ++k){
+		mFFTTwiddles[2*k  ] = cos(2*M_PI*k/M);
+		mFFTTwiddles[2*k+1] =-sin(2*M_PI*k/M);
+	}
+	mRealTwiddles.resize(2*(M+1));
+	for(int k=0; k<=M; ++k){
+		mRealTwiddles[2*k  ] = cos(2*M_PI*k/N);
+		mRealTwiddles[2*k+1] =-sin(2*M_PI*k/N);
+	}
+	mWork.assign(N, 0.f);
+	mSum.assign(4*S, 0.f);
+
+	// Partition and transform impulse responses. The inverse FFT leaves its
+	// output scaled by N/2, which is undone here.
+	const int numHRIRs = mHRIRs.size();
+	const int L = mHRIRs.length();
+	mNumParts = std::max(1, (L + B - 1) / B);
+	const int P = mNumParts;
+	mFilters.assign(numHRIRs * 2 * P * S, 0.f);
+	std::vector<float> part(N);
+	for(int m=0; m<numHRIRs; ++m){
+		for(int e=0; e<2; ++e){
+			const float * ir = mHRIRs.ir(m, e);
+			for(int p=0; p<P; ++p){
+				std::fill(part.begin(), part.end(), 0.f);
+				for(int i=p*B; i<std::min(L, (p+1)*B); ++i) part[i - p*B] = ir[i] / M;
+				forwardFFT(filter(m, e, p), &part[0]);
+			}
+		}
+	}
+
+	// Neighbors to walk through when searching for the nearest measurement
+	const int numNeighbors = std::min(8, numHRIRs - 1);
+	mNeighbors.resize(numHRIRs * numNeighbors);
+	std::vector<std::pair<float, int> > dists(numHRIRs);
+	for(int m=0; m<numHRIRs; ++m){
+		for(int j=0; j<numHRIRs; ++j){
+			dists[j] = std::make_pair(-mHRIRs.direction(m).dot(mHRIRs.direction(j)), j);
+		}
+		dists[m].first = 2;	// not a neighbor of itself
+		std::partial_sort(dists.begin(), dists.begin() + numNeighbors, dists.end());
+		for(int k=0; k<numNeighbors; ++k) mNeighbors[m*numNeighbors + k] = dists[k].second;
+	}
+
+	// Virtual speakers at the measurements nearest to a spherical Fibonacci
+	// set. Their Ambisonic decode and HRIRs combine into one filter per
+	// channel and ear.
+	const int C = AmbiBase::orderToChannels(3, mAmbiOrder);
+	mVirtualSpeakers.clear();
+	if(numHRIRs){
+		const int numPoints = 2 * (mAmbiOrder+1) * (mAmbiOrder+1);
+		for(int i=0; i<numPoints; ++i){
+			float z = 1.f - 2.f * (i + 0.5f) / numPoints;
+			float r = sqrt(1.f - z*z);
+			float phi = i * 2.3999632f;
+			int m = findHRIR(Vec3f(r*cos(phi), r*sin(phi), z));
+			if(std::find(mVirtualSpeakers.begin(), mVirtualSpeakers.end(), m) == mVirtualSpeakers.end()){
+				mVirtualSpeakers.push_back(m);
+			}
+		}
+	}
+	const int V = mVirtualSpeakers.size();
+	std::vector<float> decode(V * C);
+	for(int v=0; v<V; ++v){
+		const Vec3f& d = mHRIRs.direction(mVirtualSpeakers[v]);
+		AmbiBase::encodeWeightsFuMa(&decode[v*C], 3, mAmbiOrder, d.x, d.y, d.z);
+	}
+
+	// Normalize to unit energy across virtual speakers, on average over
+	// sources in their directions
+	double energy = 0;
+	for(int u=0; u<V; ++u){
+		for(int v=0; v<V; ++v){
+			double g = 0;
+			for(int c=0; c<C; ++c) g += decode[v*C + c] * decode[u*C + c];
+			energy += g*g;
+		}
+	}
+	const float norm = V ? 1. / sqrt(energy / V) : 0.;
+
+	mAmbiFilters.assign(C * 2 * P * S, 0.f);
+	for(int c=0; c<C; ++c){
+		for(int e=0; e<2; ++e){
+			float * dst = &mAmbiFilters[(c*2 + e) * P * S];
+			for(int v=0; v<V; ++v){
+				const float g = decode[v*C + c] * norm;
+				const float * src = filter(mVirtualSpeakers[v], e, 0);
+				for(int i=0; i<P*S; ++i) dst[i] += src[i] * g;
+			}
+		}
+	}
+	mAmbiBus.assign(C * B, 0.f);
+	mAmbiInput.assign(C * N, 0.f);
+	mAmbiSpectra.assign(C * P * S, 0.f);
+	mAmbiSlot = 0;
+	mAmbiTail = 0;
+}
+
+int BinauralSpatializer::findHRIR(const Vec3f& dir, int hint) const {
+	const int numHRIRs = mHRIRs.size();
+	if(!numHRIRs) return -1;
+
+	if(hint < 0 || hint >= numHRIRs){
+		hint = 0;
+		float best = dir.dot(mHRIRs.direction(0));
+		for(int m=1; m<numHRIRs; ++m){
+			float d = dir.dot(mHRIRs.direction(m));
+			if(d > best){ best = d; hint = m; }
+		}
+		return hint;
+	}
+
+	// Walk to the nearest neighbor until none is nearer
+	const int numNeighbors = mNeighbors.size() / numHRIRs;
+	int m = hint;
+	float best = dir.dot(mHRIRs.direction(m));
+	for(;;){
+		int next = m;
+		for(int k=0; k<numNeighbors; ++k){
+			int j = mNeighbors[m*numNeighbors + k];
+			float d = dir.dot(mHRIRs.direction(j));
+			if(d > best){ best = d; next = j; }
+		}
+		if(next == m) return m;
+		m = next;
+	}
+}
+
+// Complex FFT of mFFTSize/2 interleaved points, in place. The inverse is not
+// scaled.
+void BinauralSpatializer::complexFFT(float * z, bool inverse) const {
+	const int M = mFFTSize/2;
+	for(int i=0; i<M; ++i){
+		int j = mBitReverse[i];
+		if(j > i){
+			std::swap(z[2*i], z[2*j]);
+			std::swap(z[2*i+1], z[2*j+1]);
+		}
+	}
+	const float sign = inverse ? -1.f : 1.f;
+	for(int len=2; len<=M; len<<=1){
+		const int half = len/2;
+		const int step = M/len;
+		for(int i=0; i<M; i+=len){
+			float * a = z + 2*i;
+			float * b = a + 2*half;
+			for(int k=0; k<half; ++k){
+				const float wr = mFFTTwiddles[2*k*step];
+				const float wi = mFFTTwiddles[2*k*step + 1] * sign;
+				const float tr = b[2*k] * wr - b[2*k+1] * wi;
+				const float ti = b[2*k] * wi + b[2*k+1] * wr;
+				b[2*k  ] = a[2*k  ] - tr;
+				b[2*k+1] = a[2*k+1] - ti;
+				a[2*k  ] += tr;
+				a[2*k+1] += ti;
+			}
+		}
+	}
+}
+
+// Real FFT of mFFTSize points, through a complex FFT of the even and odd
+// samples as real and imaginary parts
+void BinauralSpatializer::forwardFFT(float * spectrum, const float * input){
+	const int M = mFFTSize/2;
+	const int K = mNumBins;
+	float * z = &mWork[0];
+	std::copy(input, input + mFFTSize, z);
+	complexFFT(z, false);
+
+	float * re = spectrum;
+	float * im = spectrum + K;
+	for(int k=0; k<=M; ++k){
+		const int k1 = k % M;
+		const int k2 = (M - k) % M;
+		const float er = 0.5f * (z[2*k1] + z[2*k2]);
+		const float ei = 0.5f * (z[2*k1+1] - z[2*k2+1]);
+		const float or_= 0.5f * (z[2*k1+1] + z[2*k2+1]);
+		const float oi =-0.5f * (z[2*k1] - z[2*k2]);
+		const float wr = mRealTwiddles[2*k], wi = mRealTwiddles[2*k+1];
+		re[k] = er + or_*wr - oi*wi;
+		im[k] = ei + or_*wi + oi*wr;
+	}
+}
+
+// Inverse of forwardFFT(), scaled by mFFTSize/2
+void BinauralSpatializer::inverseFFT(float * output, const float * spectrum) const {
+	const int M = mFFTSize/2;
+	const int K = mNumBins;
+	const float * re = spectrum;
+	const float * im = spectrum + K;
+	for(int k=0; k<M; ++k){
+		const float er = 0.5f * (re[k] + re[M-k]);
+		const float ei = 0.5f * (im[k] - im[M-k]);
+		const float dr = 0.5f * (re[k] - re[M-k]);
+		const float di = 0.5f * (im[k] + im[M-k]);
+		// Odd part is the difference rotated back by the twiddle
+		const float wr = mRealTwiddles[2*k], wi = -mRealTwiddles[2*k+1];
+		const float or_= dr*wr - di*wi;
+		const float oi = dr*wi + di*wr;
+		output[2*k  ] = er - oi;
+		output[2*k+1] = ei + or_;
+	}
+	complexFFT(output, true);
+}
+
+// Add the products of the input spectra, newest at slot, with the spectra of
+// the partitions of a filter
+void BinauralSpatializer::convolve(float * out, const float * spectra, int slot, const float * filters, float gain) const {
+	const int K = mNumBins;
+	const int S = spectrumSize();
+	const int P = mNumParts;
+	float * yr = out;
+	float * yi = out + K;
+	for(int p=0; p<P; ++p){
+		const float * x = spectra + ((slot - p + P) % P) * S;
+		const float * h = filters + p * S;
+		const float * xr = x, * xi = x + K;
+		const float * hr = h, * hi = h + K;
+		for(int k=0; k<K; ++k){
+			yr[k] += (xr[k]*hr[k] - xi[k]*hi[k]) * gain;
+			yi[k] += (xr[k]*hi[k] + xi[k]*hr[k]) * gain;
+		}
+	}
+}
+
+void BinauralSpatializer::prepare(){
+	++mBlock;
+	std::fill(mSum.begin(), mSum.end(), 0.f);
+	std::fill(mAmbiBus.begin(), mAmbiBus.end(), 0.f);
+	mRendered = mFaded = false;
+}
+
+// Values used by the state of a source in a mode
+static unsigned stateSize(BinauralMode mode, int fftSize, int numParts, int spectrumSize, int ambiOrder){
+	return STATE_HEADER + (mode == BINAURAL_DIRECT
+		? fftSize + numParts * spectrumSize
+		: AmbiBase::orderToChannels(3, ambiOrder));
+}
+
+unsigned BinauralSpatializer::sourceStateSize() const {
+	// Room for either mode and any order, so that neither reallocates
+	return std::max(stateSize(BINAURAL_DIRECT, mFFTSize, mNumParts, spectrumSize(), MAX_AMBI_ORDER),
+		stateSize(BINAURAL_AMBISONIC, mFFTSize, mNumParts, spectrumSize(), MAX_AMBI_ORDER));
+}
+
+float * BinauralSpatializer::sourceState(SoundSource& src){
+	const unsigned size = stateSize(mMode, mFFTSize, mNumParts, spectrumSize(), mAmbiOrder);
+	bool fresh;
+	float * state = src.spatializerState(this, size, fresh);
+	if(!state) return NULL;
+	const float block = float(mBlock & BLOCK_MASK);
+	const bool valid = !fresh && state[STATE_MODE] == float(mMode);
+
+	// Already begun in this block, when rendering per sample
+	if(valid && state[STATE_BLOCK] == block) return state;
+
+	// Start over if the source was not rendered in the last block
+	if(!valid || state[STATE_BLOCK] != float((mBlock - 1) & BLOCK_MASK)){
+		std::fill(state, state + size, 0.f);
+		state[STATE_MODE] = mMode;
+		state[STATE_HRIR] = -1;
+	}
+	state[STATE_BLOCK] = block;
+
+	// Make room for the new block in the input window
+	if(mMode == BINAURAL_DIRECT){
+		float * window = state + STATE_HEADER;
+		std::copy(window + mPartSize, window + mFFTSize, window);
+	}
+	return state;
+}
+
+void BinauralSpatializer::convolveSource(float * state, const Pose& reldir){
+	if(!mHRIRs.size()) return;
+
+	const int prev = int(state[STATE_HRIR]);
+	Vec3f dir = speakerCoords(reldir);
+	int hrir = prev;
+	if(dir.magSqr() > 0 || prev < 0){
+		hrir = findHRIR(dir.magSqr() > 0 ? dir.normalized() : Vec3f(0,1,0), prev);
+	}
+
+	const int slot = (int(state[STATE_SLOT]) + 1) % mNumParts;
+	const float * window = state + STATE_HEADER;
+	float * spectra = state + STATE_HEADER + mFFTSize;
+	forwardFFT(spectra + slot * spectrumSize(), window);
+	state[STATE_SLOT] = slot;
+	state[STATE_HRIR] = hrir;
+
+	for(int e=0; e<2; ++e){
+		convolve(sum(e, 0), spectra, slot, filter(hrir, e, 0), 1.f);
+		if(prev >= 0 && prev != hrir){
+			convolve(sum(e, 1), spectra, slot, filter(prev, e, 0), 1.f);
+			convolve(sum(e, 1), spectra, slot, filter(hrir, e, 0), -1.f);
+		}
+	}
+	if(prev >= 0 && prev != hrir) mFaded = true;
+	mRendered = true;
+}
+
+void BinauralSpatializer::encode(const Pose& reldir){
+	Vec3f dir = speakerCoords(reldir);
+	if(dir.magSqr() > 0) dir.normalize();
+	AmbiBase::encodeWeightsFuMa(mAmbiWeights, 3, mAmbiOrder, dir.x, dir.y, dir.z);
+}
+
+void BinauralSpatializer::renderBuffer(AudioIOData& /*io*/, const Pose& reldir, const float *samples, const int& numFrames){
+	if(numFrames != mPartSize){
+		AL_WARN_ONCE("BinauralSpatializer renders blocks of %d frames, not %d", mPartSize, numFrames);
+		return;
+	}
+	encode(reldir);
+	const int C = AmbiBase::orderToChannels(3, mAmbiOrder);
+	for(int c=0; c<C; ++c){
+		float * bus = &mAmbiBus[c * mPartSize];
+		for(int i=0; i<numFrames; ++i) bus[i] += samples[i] * mAmbiWeights[c];
+	}
+	mAmbiTail = mNumParts + 1;
+}
+
+void BinauralSpatializer::renderSample(AudioIOData& /*io*/, const Pose& reldir, const float& sample, const int& frameIndex){
+	encode(reldir);
+	const int C = AmbiBase::orderToChannels(3, mAmbiOrder);
+	for(int c=0; c<C; ++c){
+		mAmbiBus[c * mPartSize + frameIndex] += sample * mAmbiWeights[c];
+	}
+	mAmbiTail = mNumParts + 1;
+}
+
+void BinauralSpatializer::renderSourceBuffer(AudioIOData& io, const Pose& reldir, const float *samples, const int& numFrames, SoundSource& src){
+	if(numFrames != mPartSize){
+		AL_WARN_ONCE("BinauralSpatializer renders blocks of %d frames, not %d", mPartSize, numFrames);
+		return;
+	}
+
+	float * state = sourceState(src);
+	if(!state){
+		renderBuffer(io, reldir, samples, numFrames);
+		return;
+	}
+	if(mMode == BINAURAL_DIRECT){
+		std::copy(samples, samples + numFrames, state + STATE_HEADER + mFFTSize - mPartSize);
+		convolveSource(state, reldir);
+	}
+	else{
+		encode(reldir);
+		const int C = AmbiBase::orderToChannels(3, mAmbiOrder);
+		float * prevWeights = state + STATE_HEADER;
+		if(state[STATE_HRIR] < 0){
+			std::copy(mAmbiWeights, mAmbiWeights + C, prevWeights);
+			state[STATE_HRIR] = 0;
+		}
+		for(int c=0; c<C; ++c){
+			addRamped(&mAmbiBus[c * mPartSize], samples, numFrames, prevWeights[c], mAmbiWeights[c]);
+			prevWeights[c] = mAmbiWeights[c];
+		}
+	}
+}
+
+void BinauralSpatializer::renderSourceSample(AudioIOData& io, const Pose& reldir, const float& sample, const int& frameIndex, SoundSource& src){
+	float * state = sourceState(src);
+	if(!state){
+		renderSample(io, reldir, sample, frameIndex);
+		return;
+	}
+	if(mMode == BINAURAL_DIRECT){
+		state[STATE_HEADER + mFFTSize - mPartSize + frameIndex] = sample;
+		if(frameIndex == mPartSize - 1) convolveSource(state, reldir);
+	}
+	else{
+		renderSample(io, reldir, sample, frameIndex);
+	}
+}
+
+void BinauralSpatializer::renderAmbi(){
+	const int B = mPartSize;
+	const int N = mFFTSize;
+	const int S = spectrumSize();
+	const int P = mNumParts;
+	const int C = AmbiBase::orderToChannels(3, mAmbiOrder);
+	const int slot = (mAmbiSlot + 1) % P;
+	for(int c=0; c<C; ++c){
+		float * window = &mAmbiInput[c * N];
+		std::copy(window + B, window + N, window);
+		std::copy(&mAmbiBus[c * B], &mAmbiBus[c * B] + B, window + N - B);
+
+		float * spectra = &mAmbiSpectra[c * P * S];
+		forwardFFT(spectra + slot * S, window);
+		for(int e=0; e<2; ++e){
+			convolve(sum(e, 0), spectra, slot, &mAmbiFilters[(c*2 + e) * P * S], 1.f);
+		}
+	}
+	mAmbiSlot = slot;
+	mRendered = true;
+}
+
+void BinauralSpatializer::finalize(AudioIOData& io){
+	if(!mHRIRs.size() || mSpeakers.size() < 2) return;
+
+	if(fabs(io.framesPerSecond() - mHRIRs.sampleRate()) > 1){
+		AL_WARN_ONCE("HRIRs are sampled at %g Hz, but audio at %g Hz",
+			mHRIRs.sampleRate(), io.framesPerSecond());
+	}
+
+	if(mMode == BINAURAL_AMBISONIC || mAmbiTail > 0){
+		renderAmbi();
+		if(mAmbiTail > 0) --mAmbiTail;
+	}
+	if(!mRendered) return;
+
+	// The last block of each inverse FFT is the output
+	const int B = mPartSize;
+	const float * y = &mWork[mFFTSize - B];
+	for(int e=0; e<2; ++e){
+		float * out = io.outBuffer(mSpeakers[e].deviceChannel);
+		inverseFFT(&mWork[0], sum(e, 0));
+		for(int i=0; i<B; ++i) out[i] += y[i];
+
+		// Fade out what changed filters would have rendered with the old ones
+		if(mFaded){
+			inverseFFT(&mWork[0], sum(e, 1));
+			const float inc = 1.f / B;
+			for(int i=0; i<B; ++i) out[i] += y[i] * (1.f - inc * (i+1));
+		}
+	}
+}
+
+void BinauralSpatializer::print(){
+	printf("Binaural spatializer with %d HRIRs of %d samples, in %d partitions of %d\n",
+		mHRIRs.size(), mHRIRs.length(), mNumParts, mPartSize);
+}
+
+} // al::
@@ -12,27 +12,12 @@
 
 using namespace al;
 
-BiQuad::BiQuad(BIQUADTYPE _type, double _sampleRate)
-:
-mType(_type),
-mSampleRate(_sampleRate),
-enabled(true)
-{
-    mBD.x1 = mBD.x2 = 0;
-    mBD.y1 = mBD.y2 = 0;
-    
-    set(10000, 1.9, 0);
-}
-
-BiQuad::~BiQuad()
-{
-    
-}
-
-void BiQuad::set(double freq, double bandwidth, double dbGain)
+// Compute normalized coefficients {b0, b1, b2, a1, a2} from the RBJ cookbook
+static bool designBiquad(double * c, BIQUADTYPE type, double freq, double bandwidth, double dbGain, double sampleRate)
 {
     //TODO all the way to fs/2, range
     if(freq > 20000) freq = 20000;
+    if(freq > 0.49 * sampleRate) freq = 0.49 * sampleRate;
     if(freq <= 20) freq = 20;
     
     double A, omega, sn, cs, alpha, beta;
@@ -40,13 +25,13 @@ void BiQuad::set(double freq, double bandwidth, double dbGain)
     
     // setup variables
     A = pow(10, dbGain /40);
-    omega = 2 * M_PI * freq / (1*mSampleRate); //1X or 2X oversampled
+    omega = 2 * M_PI * freq / (1*sampleRate); //1X or 2X oversampled
     sn = sin(omega);
     cs = cos(omega);
     alpha = sn * sinh(M_LN2 /2 * bandwidth * omega /sn);
     beta = sqrt(A + A);
     
-    switch (mType) {
+    switch (type) {
         case BIQUAD_LPF:
             b0 = (1 - cs) /2;
             b1 = 1 - cs;
@@ -104,14 +89,43 @@ void BiQuad::set(double freq, double bandwidth, double dbGain)
             a2 = (A + 1) - (A - 1) * cs - beta * sn;
             break;
         default:
-            return;
+            return false;
     }
     
-    mBD.a0 = b0 /a0;
-    mBD.a1 = b1 /a0;
-    mBD.a2 = b2 /a0;
-    mBD.a3 = a1 /a0;
-    mBD.a4 = a2 /a0;
+    c[0] = b0 /a0;
+    c[1] = b1 /a0;
+    c[2] = b2 /a0;
+    c[3] = a1 /a0;
+    c[4] = a2 /a0;
+    return true;
+}
+
+BiQuad::BiQuad(BIQUADTYPE _type, double _sampleRate)
+:
+mType(_type),
+mSampleRate(_sampleRate),
+enabled(true)
+{
+    mBD.x1 = mBD.x2 = 0;
+    mBD.y1 = mBD.y2 = 0;
+    
+    set(10000, 1.9, 0);
+}
+
+BiQuad::~BiQuad()
+{
+    
+}
+
+void BiQuad::set(double freq, double bandwidth, double dbGain)
+{
+    double c[5];
+    if(!designBiquad(c, mType, freq, bandwidth, dbGain, mSampleRate)) return;
+    mBD.a0 = c[0];
+    mBD.a1 = c[1];
+    mBD.a2 = c[2];
+    mBD.a3 = c[3];
+    mBD.a4 = c[4];
 }
 
 void BiQuad::processBuffer(float *buffer, int count)
@@ -204,3 +218,171 @@ void BiQuadNX::enable(bool on)
     for(int i = 0; i < numFilters; i++)
         mFilters[i].enable(on);
 }
+
+////////////////////////////////////////////////////////////////////////////
+
+// Added to the input of each stage to keep the state out of denormals. It is
+// far below the resolution of any signal it is added to.
+static const float kAntiDenormal = 1e-18f;
+
+BiquadBank::BiquadBank(int _numLanes, int _numStages, double _sampleRate)
+:
+mNumLanes(0),
+mNumStages(0),
+mNumGroups(0),
+mSampleRate(_sampleRate)
+{
+    resize(_numLanes, _numStages);
+}
+
+void BiquadBank::resize(int _numLanes, int _numStages)
+{
+    const int W = LANES_PER_GROUP;
+    mNumLanes = _numLanes > 0 ? _numLanes : 0;
+    mNumStages = _numStages > 0 ? _numStages : 1;
+    mNumGroups = (mNumLanes + W - 1) / W;
+
+    // Lanes padding the last group stay bypassed and silent
+    mCoefs.assign(mNumStages * mNumGroups * 5 * W, 0.f);
+    mState.assign(mNumStages * mNumGroups * 2 * W, 0.f);
+    mFrames.assign(CHUNK * mNumGroups * W, 0.f);
+    mPtrs.assign(mNumLanes, (float *)0);
+    for(int i = 0; i < mNumLanes; i++)
+        bypass(i);
+}
+
+void BiquadBank::set(int lane, BIQUADTYPE type, double freq, double bandwidth, double dbGain, int stage)
+{
+    double c[5];
+    if(!designBiquad(c, type, freq, bandwidth, dbGain, mSampleRate)) return;
+    if(stage >= 0){
+        coefficients(lane, stage, c[0], c[1], c[2], c[3], c[4]);
+    }
+    else{
+        for(int i = 0; i < mNumStages; i++)
+            coefficients(lane, i, c[0], c[1], c[2], c[3], c[4]);
+    }
+}
+
+void BiquadBank::coefficients(int lane, int stage, double b0, double b1, double b2, double a1, double a2)
+{
+    const int W = LANES_PER_GROUP;
+    float * c = coef(stage, lane / W) + lane % W;
+    c[0*W] = b0;
+    c[1*W] = b1;
+    c[2*W] = b2;
+    c[3*W] = a1;
+    c[4*W] = a2;
+}
+
+void BiquadBank::bypass(int lane, int stage)
+{
+    if(stage >= 0){
+        coefficients(lane, stage, 1, 0, 0, 0, 0);
+    }
+    else{
+        for(int i = 0; i < mNumStages; i++)
+            coefficients(lane, i, 1, 0, 0, 0, 0);
+    }
+}
+
+void BiquadBank::reset()
+{
+    for(unsigned i = 0; i < mState.size(); i++)
+        mState[i] = 0.f;
+}
+
+void BiquadBank::reset(int lane)
+{
+    const int W = LANES_PER_GROUP;
+    for(int i = 0; i < mNumStages; i++){
+        float * s = state(i, lane / W) + lane % W;
+        s[0] = s[W] = 0.f;
+    }
+}
+
+void BiquadBank::getState(int lane, float * st) const
+{
+    const int W = LANES_PER_GROUP;
+    for(int i = 0; i < mNumStages; i++){
+        const float * s = state(i, lane / W) + lane % W;
+        st[2*i  ] = s[0];
+        st[2*i+1] = s[W];
+    }
+}
+
+void BiquadBank::setState(int lane, const float * st)
+{
+    const int W = LANES_PER_GROUP;
+    for(int i = 0; i < mNumStages; i++){
+        float * s = state(i, lane / W) + lane % W;
+        s[0] = st[2*i  ];
+        s[W] = st[2*i+1];
+    }
+}
+
+void BiquadBank::process(float * const * out, const float * const * in, int numFrames, int lanes)
+{
+    const int W = LANES_PER_GROUP;
+    const int stride = mNumGroups * W;
+    if(lanes < 0 || lanes > mNumLanes) lanes = mNumLanes;
+    const int groups = (lanes + W - 1) / W;
+
+    for(int offset = 0; offset < numFrames; offset += CHUNK){
+        const int n = numFrames - offset < CHUNK ? numFrames - offset : CHUNK;
+
+        // Interleave lanes, so each frame holds all lanes side by side
+        for(int l = 0; l < lanes; l++){
+            const float * x = in[l] + offset;
+            float * f = &mFrames[l];
+            for(int i = 0; i < n; i++)
+                f[i*stride] = x[i];
+        }
+
+        for(int g = 0; g < groups; g++){
+            for(int st = 0; st < mNumStages; st++){
+                // Copy to locals so that the lane loops stay in registers
+                const float * c = coef(st, g);
+                float * s = state(st, g);
+                float b0[W], b1[W], b2[W], a1[W], a2[W], s1[W], s2[W];
+                for(int k = 0; k < W; k++){
+                    b0[k] = c[k]; b1[k] = c[W+k]; b2[k] = c[2*W+k];
+                    a1[k] = c[3*W+k]; a2[k] = c[4*W+k];
+                    s1[k] = s[k]; s2[k] = s[W+k];
+                }
+
+                float * f = &mFrames[g*W];
+                for(int i = 0; i < n; i++){
+                    for(int k = 0; k < W; k++){
+                        float x = f[k] + kAntiDenormal;
+                        float y = b0[k] * x + s1[k];
+                        s1[k] = b1[k] * x - a1[k] * y + s2[k];
+                        s2[k] = b2[k] * x - a2[k] * y;
+                        f[k] = y;
+                    }
+                    f += stride;
+                }
+
+                for(int k = 0; k < W; k++){
+                    s[k] = s1[k];
+                    s[W+k] = s2[k];
+                }
+            }
+        }
+
+        for(int l = 0; l < lanes; l++){
+            float * y = out[l] + offset;
+            const float * f = &mFrames[l];
+            for(int i = 0; i < n; i++)
+                y[i] = f[i*stride];
+        }
+    }
+}
+
+void BiquadBank::process(float * buffer, int numFrames)
+{
+    if(mNumLanes == 0) return;
+    for(int l = 0; l < mNumLanes; l++)
+        mPtrs[l] = buffer + l * numFrames;
+    process(&mPtrs[0], numFrames);
+}
@@ -1,56 +1,117 @@
 #include "allocore/sound/al_Dbap.hpp"
+#include "allocore/math/al_Functions.hpp"
+#include "allocore/system/al_Printing.hpp"
 
 namespace al{
 
 Dbap::Dbap(const SpeakerLayout &sl, float focus)
 	:	Spatializer(sl), mListener(NULL), mNumSpeakers(0), mFocus(focus)
-{}
+{
+	loadSpeakers();
+}
 
-void Dbap::compile(Listener& listener){
-	mListener = &listener;
+void Dbap::loadSpeakers(){
 	mNumSpeakers = mSpeakers.size();
-	printf("DBAP Compiled with %d speakers\n", mNumSpeakers);
+	if(mNumSpeakers > DBAP_MAX_NUM_SPEAKERS){
+		AL_WARN("DBAP supports at most %d speakers, ignoring the remaining %d",
+			DBAP_MAX_NUM_SPEAKERS, mNumSpeakers - DBAP_MAX_NUM_SPEAKERS);
+		mNumSpeakers = DBAP_MAX_NUM_SPEAKERS;
+	}
 
 	for(int i = 0; i < mNumSpeakers; i++)
 	{
-		mSpeakerVecs[i] = mSpeakers[i].vec();
+		Vec3d vec = mSpeakers[i].vec();
+		mSpeakerX[i] = vec.x;
+		mSpeakerY[i] = vec.y;
+		mSpeakerZ[i] = vec.z;
 		mDeviceChannels[i] = mSpeakers[i].deviceChannel;
 	}
 }
 
-void Dbap::perform(AudioIOData& io, SoundSource& src, Vec3d& relpos, const int& numFrames, float *samples){
-	for (int k = 0; k < mNumSpeakers; ++k)
-	{
-		float gain = 1.f;
-		if(mEnabled)
-		{
-			Vec3d vec = relpos - mSpeakerVecs[k];
-			float dist = vec.mag();
-			gain = 1.f / (1.f + dist);
-			gain = powf(gain, mFocus);
-		}
+void Dbap::compile(Listener& listener){
+	mListener = &listener;
+	loadSpeakers();
+	printf("DBAP Compiled with %d speakers\n", mNumSpeakers);
+}
+
+void Dbap::computeGains(const Vec3f& relpos, float * gains) const {
+	if(!mEnabled){
+		for(int k = 0; k < mNumSpeakers; ++k) gains[k] = 1.f;
+		return;
+	}
 
+	const float focus = mFocus;
+	for(int k = 0; k < mNumSpeakers; ++k){
+		float dx = relpos.x - mSpeakerX[k];
+		float dy = relpos.y - mSpeakerY[k];
+		float dz = relpos.z - mSpeakerZ[k];
+		float dist = sqrtf(dx*dx + dy*dy + dz*dz);
+		gains[k] = powFast(1.f / (1.f + dist), focus);
+	}
+}
+
+// Position of source in the coordinates of Speaker::vec(), as for VBAP
+static Vec3f speakerCoords(const Pose& reldir){
+	Vec3d vec = reldir.quat().rotate(reldir.vec());
+	return Vec3f(vec.x, vec.z, vec.y);
+}
+
+void Dbap::renderBuffer(AudioIOData& io, const float * gains, const float *samples, int numFrames){
+	for(int k = 0; k < mNumSpeakers; ++k){
+		const float gain = gains[k];
 		float * out = io.outBuffer(mDeviceChannels[k]);
-		for(int i = 0; i < numFrames; ++i){
-			out[i] += gain * samples[i];
-		}
+		for(int i = 0; i < numFrames; ++i) out[i] += samples[i] * gain;
 	}
 }
 
+void Dbap::renderSourceBuffer(AudioIOData& io, const float * gains, const float *samples, int numFrames, SoundSource& src){
+	// Ramp from the source's speaker gains in the last block
+	bool fresh;
+	float * prevGains = src.spatializerState(this, mNumSpeakers, fresh);
+	if(!prevGains){
+		renderBuffer(io, gains, samples, numFrames);
+		return;
+	}
+	if(fresh) std::copy(gains, gains + mNumSpeakers, prevGains);
+
+	for(int k = 0; k < mNumSpeakers; ++k){
+		addRamped(io.outBuffer(mDeviceChannels[k]), samples, numFrames, prevGains[k], gains[k]);
+		prevGains[k] = gains[k];
+	}
+}
+
+void Dbap::renderBuffer(AudioIOData& io, const Pose& reldir, const float *samples, const int& numFrames){
+	float gains[DBAP_MAX_NUM_SPEAKERS];
+	computeGains(speakerCoords(reldir), gains);
+	renderBuffer(io, gains, samples, numFrames);
+}
+
+void Dbap::renderSourceBuffer(AudioIOData& io, const Pose& reldir, const float *samples, const int& numFrames, SoundSource& src){
+	float gains[DBAP_MAX_NUM_SPEAKERS];
+	computeGains(speakerCoords(reldir), gains);
+	renderSourceBuffer(io, gains, samples, numFrames, src);
+}
+
+void Dbap::renderSample(AudioIOData& io, const Pose& reldir, const float& sample, const int& frameIndex){
+	float gains[DBAP_MAX_NUM_SPEAKERS];
+	computeGains(speakerCoords(reldir), gains);
+	for(int k = 0; k < mNumSpeakers; ++k){
+		io.out(mDeviceChannels[k], frameIndex) += gains[k] * sample;
+	}
+}
+
+void Dbap::perform(AudioIOData& io, SoundSource& src, Vec3d& relpos, const int& numFrames, float *samples){
+	float gains[DBAP_MAX_NUM_SPEAKERS];
+	computeGains(relpos, gains);
+	renderSourceBuffer(io, gains, samples, numFrames, src);
+}
+
 void Dbap::perform(AudioIOData& io, SoundSource& src, Vec3d& relpos, const int& numFrames, int& frameIndex, float& sample)
 {
-	for (int i = 0; i < mNumSpeakers; ++i)
-	{
-		float gain = 1.f;
-		if(mEnabled)
-		{
-			Vec3d vec = relpos - mSpeakerVecs[i];
-			float dist = vec.mag();
-			gain = 1.f / (1.f + dist);
-			gain = powf(gain, mFocus);
-		}
-
-		io.out(mDeviceChannels[i], frameIndex) += gain*sample;
+	float gains[DBAP_MAX_NUM_SPEAKERS];
+	computeGains(relpos, gains);
+	for(int k = 0; k < mNumSpeakers; ++k){
+		io.out(mDeviceChannels[k], frameIndex) += gains[k] * sample;
 	}
 }
 
@@ -0,0 +1,215 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "allocore/sound/al_FDNReverb.hpp"
+
+namespace al{
+
+namespace{
+
+bool isPrime(int n){
+	if(n < 2) return false;
+	for(int d=2; d*d<=n; ++d){
+		if(n % d == 0) return false;
+	}
+	return true;
+}
+
+// Shortest and longest delay lines at size 1, in seconds
+const float kMinDelay = 0.030f;
+const float kMaxDelay = 0.090f;
+
+} // anon::
+
+FDNReverb::FDNReverb(int numOutputs, double sampleRate, float size)
+:	mMatrix(FDN_HADAMARD), mSampleRate(sampleRate), mSize(size), mGain(1)
+{
+	init(numOutputs);
+}
+
+FDNReverb::FDNReverb(const SpeakerLayout& sl, double sampleRate, float size)
+:	mMatrix(FDN_HADAMARD), mSampleRate(sampleRate), mSize(size), mGain(1)
+{
+	init(sl.numSpeakers());
+	for(int i=0; i<sl.numSpeakers(); ++i){
+		mChannels[i] = sl.speakers()[i].deviceChannel;
+	}
+}
+
+void FDNReverb::init(int numOutputs){
+	if(numOutputs < 1) numOutputs = 1;
+	mChannels.resize(numOutputs);
+	for(int i=0; i<numOutputs; ++i) mChannels[i] = i;
+
+	int numLines = 8;
+	while(numLines < numOutputs) numLines *= 2;
+	mLength.resize(numLines);
+	mFilters.resize(numLines, 2);
+	mFilters.setSampleRate(mSampleRate);
+	mTaps.resize(numLines * CHUNK);
+	mMix.resize(numLines * CHUNK);
+	mTapPtrs.resize(numLines);
+	for(int i=0; i<numLines; ++i) mTapPtrs[i] = &mTaps[i * CHUNK];
+	mOutPtrs.resize(numOutputs);
+
+	mDecay[0] = 2.4f; mDecay[1] = 2.f; mDecay[2] = 1.f;
+	mCrossover[0] = 250.f; mCrossover[1] = 4000.f;
+	size(mSize);
+}
+
+FDNReverb& FDNReverb::size(float v){
+	mSize = v;
+	const int N = numLines();
+
+	// Spread lengths exponentially between the shortest and longest lines,
+	// rounded up to distinct primes so that echoes rarely coincide. An odd
+	// stride through them keeps neighbouring outputs from having similar
+	// lengths.
+	std::vector<int> lengths;
+	int total = 0;
+	for(int i=0; i<N; ++i){
+		double t = kMinDelay * pow(kMaxDelay / kMinDelay, double(i) / (N-1));
+		int len = std::max(int(t * mSize * mSampleRate), 2);
+		while(!isPrime(len) || std::find(lengths.begin(), lengths.end(), len) != lengths.end()) ++len;
+		lengths.push_back(len);
+	}
+	for(int i=0; i<N; ++i){
+		mLength[i] = lengths[(i * 5) % N];
+		total += mLength[i];
+	}
+
+	mOffset.resize(N);
+	mPos.assign(N, 0);
+	for(int i=0, off=0; i<N; ++i){
+		mOffset[i] = off;
+		off += mLength[i];
+	}
+	mLines.assign(total, 0.f);
+	mFilters.reset();
+	updateFilters();
+	return *this;
+}
+
+FDNReverb& FDNReverb::decay(float low, float mid, float high){
+	mDecay[0] = low; mDecay[1] = mid; mDecay[2] = high;
+	updateFilters();
+	return *this;
+}
+
+FDNReverb& FDNReverb::crossover(float low, float high){
+	mCrossover[0] = low; mCrossover[1] = high;
+	updateFilters();
+	return *this;
+}
+
+void FDNReverb::updateFilters(){
+	// A line of length L attenuates by 60 L / (sampleRate RT60) dB per pass
+	mLineGain.resize(numLines());
+	for(int i=0; i<numLines(); ++i){
+		double secs = mLength[i] / mSampleRate;
+		double dbLow = -60. * secs / mDecay[0];
+		double dbMid = -60. * secs / mDecay[1];
+		double dbHigh = -60. * secs / mDecay[2];
+		mLineGain[i] = pow(10., dbMid / 20.);
+		mFilters.set(i, BIQUAD_LSH, mCrossover[0], 1.9, dbLow - dbMid, 0);
+		mFilters.set(i, BIQUAD_HSH, mCrossover[1], 1.9, dbHigh - dbMid, 1);
+	}
+}
+
+void FDNReverb::zero(){
+	std::fill(mLines.begin(), mLines.end(), 0.f);
+	mFilters.reset();
+}
+
+void FDNReverb::process(float * const * outs, const float * in, int numFrames){
+	const int N = numLines();
+	const int minLength = *std::min_element(mLength.begin(), mLength.end());
+	const int chunk = std::min(int(CHUNK), minLength);
+	const float inGain = 1.f / sqrt(float(N));
+
+	for(int offset=0; offset<numFrames; offset+=chunk){
+		const int n = std::min(chunk, numFrames - offset);
+
+		// Read the oldest samples of each line
+		for(int d=0; d<N; ++d){
+			const float * l = line(d);
+			float * tap = mTapPtrs[d];
+			int first = std::min(n, mLength[d] - mPos[d]);
+			memcpy(tap, l + mPos[d], first * sizeof(float));
+			memcpy(tap + first, l, (n - first) * sizeof(float));
+		}
+
+		// Attenuate by the reverberation times
+		mFilters.process(&mTapPtrs[0], n);
+		for(int d=0; d<N; ++d){
+			float * tap = mTapPtrs[d];
+			const float g = mLineGain[d];
+			for(int i=0; i<n; ++i) tap[i] *= g;
+		}
+
+		for(int k=0; k<numOutputs(); ++k){
+			const float * tap = mTapPtrs[k];
+			float * out = outs[k] + offset;
+			for(int i=0; i<n; ++i) out[i] += tap[i] * mGain;
+		}
+
+		// Mix lines by the feedback matrix
+		memcpy(&mMix[0], &mTaps[0], N * CHUNK * sizeof(float));
+		float scale = 1.f;
+		if(mMatrix == FDN_HADAMARD){
+			// Fast Walsh-Hadamard transform, with frames innermost
+			for(int h=1; h<N; h*=2){
+				for(int j=0; j<N; j+=2*h){
+					for(int k=j; k<j+h; ++k){
+						float * a = &mMix[k * CHUNK];
+						float * b = &mMix[(k+h) * CHUNK];
+						for(int i=0; i<n; ++i){
+							float x = a[i], y = b[i];
+							a[i] = x + y;
+							b[i] = x - y;
+						}
+					}
+				}
+			}
+			scale = 1.f / sqrt(float(N));
+		}
+		else{
+			// I - 2/N 11^T
+			float sum[CHUNK] = {0};
+			for(int d=0; d<N; ++d){
+				const float * m = &mMix[d * CHUNK];
+				for(int i=0; i<n; ++i) sum[i] += m[i];
+			}
+			const float c = 2.f / N;
+			for(int d=0; d<N; ++d){
+				float * m = &mMix[d * CHUNK];
+				for(int i=0; i<n; ++i) m[i] -= c * sum[i];
+			}
+		}
+
+		// Write mixed outputs and input into the lines, alternating signs
+		// of the input to decorrelate the lines from the start
+		const float * x = in + offset;
+		for(int d=0; d<N; ++d){
+			const float * m = &mMix[d * CHUNK];
+			const float g = d & 1 ? -inGain : inGain;
+			float * l = line(d);
+			int first = std::min(n, mLength[d] - mPos[d]);
+			float * w = l + mPos[d];
+			for(int i=0; i<first; ++i) w[i] = m[i] * scale + x[i] * g;
+			for(int i=first; i<n; ++i) l[i - first] = m[i] * scale + x[i] * g;
+			mPos[d] = n > first ? n - first : mPos[d] + n;
+			if(mPos[d] == mLength[d]) mPos[d] = 0;
+		}
+	}
+}
+
+void FDNReverb::render(AudioIOData& io, const float * in, int numFrames){
+	for(int k=0; k<numOutputs(); ++k){
+		mOutPtrs[k] = io.outBuffer(mChannels[k]);
+	}
+	process(&mOutPtrs[0], in, numFrames);
+}
+
+} // al::
@@ -1,3 +1,5 @@
+#include <algorithm>
+
 #include "allocore/sound/al_Vbap.hpp"
 
 namespace al{
@@ -69,6 +71,8 @@ Vbap::Vbap(const SpeakerLayout &sl, bool is3D)
 		throw -1;
 	}
 
+	buildLookupGrid();
+
 }
 
 void Vbap::addTriple(const SpeakerTriple& st) {
@@ -401,11 +405,71 @@ void Vbap::compile(Listener& listener){
 
 void Vbap::renderBuffer(AudioIOData &io, const Pose &listeningPose, const float *samples, const int &numFrames)
 {
-	// FIMXE AC use cached index
-//	unsigned currentTripletIndex = src.cachedIndex();
-	unsigned currentTripletIndex = 0;
-	// unsigned currentTripletIndex = mCachedTripletIndex; // Cached source placement, so it starts searching from there.
+	int tripletIndex = -1;
+	renderBuffer(io, listeningPose, samples, numFrames, tripletIndex);
+}
+
+void Vbap::renderSourceBuffer(AudioIOData &io, const Pose &listeningPose, const float *samples, const int &numFrames, SoundSource &src)
+{
+	Vec3d vec = listeningPose.vec();
+
+	//Rotate vector according to listener-rotation
+	Quatd srcRot = listeningPose.quat();
+	vec = srcRot.rotate(vec);
+	vec = Vec4d(vec.x, vec.z, vec.y);
+
+	// The source keeps the output channel gains of the last block, followed
+	// by room for the gains of this block
+	const int numChannels = std::min(io.channelsOut(), numDeviceChannels());
+	bool firstBlock;
+	float * state = src.spatializerState(this, 2*numChannels, firstBlock);
+	if(!state){
+		renderBuffer(io, listeningPose, samples, numFrames);
+		return;
+	}
+	float * prevGains = state;
+	float * gains = state + numChannels;
+	for(int c = 0; c < numChannels; ++c) gains[c] = 0.f;
+
+	Vec3d tripletGains;
+	int tripletIndex = findTriplet(vec, tripletGains, src.cachedIndex());
+	if(tripletIndex >= 0){
+		src.cachedIndex(tripletIndex);
+		tripletGains.normalize();
+		channelGains(mTriplets[tripletIndex], tripletGains, gains, numChannels);
+	}
+	if(firstBlock){
+		for(int c = 0; c < numChannels; ++c) prevGains[c] = gains[c];
+	}
+
+	// Ramp from last block's gains so that moving sources don't step
+	for(int c = 0; c < numChannels; ++c){
+		if(prevGains[c] != 0.f || gains[c] != 0.f){
+			addRamped(io.outBuffer(c), samples, numFrames, prevGains[c], gains[c]);
+		}
+		prevGains[c] = gains[c];
+	}
+}
+
+void Vbap::channelGains(const SpeakerTriple& triple, const Vec3d& gains, float * chanGains, int numChannels) const
+{
+	const int chans[3] = {triple.s1Chan, triple.s2Chan, triple.s3Chan};
+	for(int k = 0; k < (mIs3D ? 3 : 2); ++k){
+		auto it = mPhantomChannels.find(chans[k]);
+		if(it != mPhantomChannels.end()){ // vertex is phantom
+			float splitGain = gains[k] / mPhantomChannels.size();
+			for(auto const &element : it->second){ // iterate across all assigned speakers
+				if(element < numChannels) chanGains[element] += splitGain * splitGain;
+			}
+		}
+		else if(chans[k] < numChannels){
+			chanGains[chans[k]] += gains[k];
+		}
+	}
+}
 
+void Vbap::renderBuffer(AudioIOData &io, const Pose &listeningPose, const float *samples, const int &numFrames, int &tripletIndex)
+{
 	Vec3d vec = listeningPose.vec();
 
 	//Rotate vector according to listener-rotation
@@ -416,78 +480,74 @@ void Vbap::renderBuffer(AudioIOData &io, const Pose &listeningPose, const float
 	//Silent by default
 	Vec3d gains;
 
-	// Search thru the triplets array in search of a match for the source position.
-	for (unsigned count = 0; count < mTriplets.size(); ++count) {
-		gains = computeGains(vec, mTriplets[currentTripletIndex]);
-		if ((gains[0] >= 0) && (gains[1] >= 0) && (!mIs3D || (gains[2] >= 0)) ){
-			gains.normalize();
+	tripletIndex = findTriplet(vec, gains, tripletIndex);
+	if(tripletIndex < 0) return;
 
-			SpeakerTriple triple = mTriplets[currentTripletIndex];
+	gains.normalize();
 
-			float * outBuff1 = io.outBuffer(triple.s1Chan);
-			float * outBuff2 = io.outBuffer(triple.s2Chan);
-			float * outBuff3 = nullptr;
-			if(mIs3D){
-				outBuff3 = io.outBuffer(triple.s3Chan);
-			}
+	const SpeakerTriple& triple = mTriplets[tripletIndex];
 
-			// Check if any of the triplets are phantom channels and
-			// reassign signal
-			auto it1 = mPhantomChannels.find(triple.s1Chan);
-			auto it2 = mPhantomChannels.find(triple.s2Chan);
-			auto it3 = mPhantomChannels.find(triple.s3Chan);
-
-			for(int i = 0; i < numFrames; ++i){
-				if (it1 != mPhantomChannels.end()) { // vertex 1 is phantom
-					float splitGain = gains[0] /mPhantomChannels.size();
-					float splitGainSQ = splitGain * splitGain;
-					for(auto const &element : it1->second) { // iterate across all assigned speakers
-						io.out(element, i) += samples[i]*splitGainSQ;
-					}
-				} else {
-					outBuff1[i] += samples[i]*gains[0];
-				}
-				if (it2 != mPhantomChannels.end()) { // vertex 2 is phantom
-					float splitGain = gains[1] /mPhantomChannels.size();
-					float splitGainSQ = splitGain * splitGain;
-					for(auto const &element : it2->second) {
-						io.out(element, i) += samples[i]*splitGainSQ;
-					}
-				} else {
-					outBuff2[i] += samples[i]*gains[1];
-				}
-				if(mIs3D){
-					if (it3 != mPhantomChannels.end()) {
-						float splitGain = gains[2] /mPhantomChannels.size();
-						float splitGainSQ = splitGain * splitGain;
-						for(auto const &element : it3->second) {
-							io.out(element, i) += samples[i]*splitGainSQ;
-						}
-					} else {
-						outBuff3[i] += samples[i]*gains[2];
-					}
-				}
+	float * outBuff1 = io.outBuffer(triple.s1Chan);
+	float * outBuff2 = io.outBuffer(triple.s2Chan);
+	float * outBuff3 = nullptr;
+	if(mIs3D){
+		outBuff3 = io.outBuffer(triple.s3Chan);
+	}
+
+	// Check if any of the triplets are phantom channels and
+	// reassign signal
+	auto it1 = mPhantomChannels.find(triple.s1Chan);
+	auto it2 = mPhantomChannels.find(triple.s2Chan);
+	auto it3 = mPhantomChannels.find(triple.s3Chan);
 
+	for(int i = 0; i < numFrames; ++i){
+		if (it1 != mPhantomChannels.end()) { // vertex 1 is phantom
+			float splitGain = gains[0] /mPhantomChannels.size();
+			float splitGainSQ = splitGain * splitGain;
+			for(auto const &element : it1->second) { // iterate across all assigned speakers
+				io.out(element, i) += samples[i]*splitGainSQ;
 			}
-			break;
+		} else {
+			outBuff1[i] += samples[i]*gains[0];
 		}
-
-		++currentTripletIndex;
-		if (currentTripletIndex >= mTriplets.size()){
-			currentTripletIndex = 0;
+		if (it2 != mPhantomChannels.end()) { // vertex 2 is phantom
+			float splitGain = gains[1] /mPhantomChannels.size();
+			float splitGainSQ = splitGain * splitGain;
+			for(auto const &element : it2->second) {
+				io.out(element, i) += samples[i]*splitGainSQ;
+			}
+		} else {
+			outBuff2[i] += samples[i]*gains[1];
+		}
+		if(mIs3D){
+			if (it3 != mPhantomChannels.end()) {
+				float splitGain = gains[2] /mPhantomChannels.size();
+				float splitGainSQ = splitGain * splitGain;
+				for(auto const &element : it3->second) {
+					io.out(element, i) += samples[i]*splitGainSQ;
+				}
+			} else {
+				outBuff3[i] += samples[i]*gains[2];
+			}
 		}
 	}
-	// FIXME AC store cached index
-//	src.cachedIndex(currentTripletIndex);
-	//mCachedTripletIndex = currentTripletIndex; // Store the new index
 }
 
 void Vbap::renderSample(AudioIOData &io, const Pose &listeningPose, const float &sample, const int &frameIndex)
 {
-	// FIXME AC use cached index
-//	unsigned currentTripletIndex = src.cachedIndex();
-	//unsigned currentTripletIndex = mCachedTripletIndex; // Cached source placement, so it starts searching from there.
-	unsigned currentTripletIndex = 0;
+	int tripletIndex = -1;
+	renderSample(io, listeningPose, sample, frameIndex, tripletIndex);
+}
+
+void Vbap::renderSourceSample(AudioIOData &io, const Pose &listeningPose, const float &sample, const int &frameIndex, SoundSource &src)
+{
+	int tripletIndex = src.cachedIndex();
+	renderSample(io, listeningPose, sample, frameIndex, tripletIndex);
+	if(tripletIndex >= 0) src.cachedIndex(tripletIndex);
+}
+
+void Vbap::renderSample(AudioIOData &io, const Pose &listeningPose, const float &sample, const int &frameIndex, int &tripletIndex)
+{
 	Vec3d vec = listeningPose.vec();
 
 	//Rotate vector according to listener-rotation
@@ -498,27 +558,13 @@ void Vbap::renderSample(AudioIOData &io, const Pose &listeningPose, const float
 	vec = Vec4d(vec.x, vec.z, vec.y);
 	//Silent by default
 	Vec3d gains;
-//	Vec3d gainsTemp;
-
-	// Search thru the triplets array in search of a match for the source position.
-	for (unsigned count = 0; count < mTriplets.size(); ++count) {
-		gains = computeGains(vec, mTriplets[currentTripletIndex]);
-		if ((gains[0] >= 0) && (gains[1] >= 0) && (!mIs3D || (gains[2] >= 0)) ){
-			gains.normalize();
-			break;
-		}
 
-		++currentTripletIndex;
-		if (currentTripletIndex >= mTriplets.size()){
-			currentTripletIndex = 0;
-		}
-	}
+	tripletIndex = findTriplet(vec, gains, tripletIndex);
+	if(tripletIndex < 0) return;
 
-	SpeakerTriple triple = mTriplets[currentTripletIndex];
+	gains.normalize();
 
-	//mCachedTripletIndex = currentTripletIndex; // Store the new index
-	// FIXME stored cached index
-//	src.cachedIndex(currentTripletIndex);
+	const SpeakerTriple& triple = mTriplets[tripletIndex];
 
 	// Check if any of the triplets are phantom channels and
 	// reassign signal
@@ -543,7 +589,7 @@ void Vbap::renderSample(AudioIOData &io, const Pose &listeningPose, const float
 		io.out(triple.s2Chan,frameIndex) += sample * gains[1];
 	}
 	if(mIs3D){
-		if (it2 != mPhantomChannels.end()) {
+		if (it3 != mPhantomChannels.end()) {
 			float splitGain = gains[2]* gains[2] /2.0;
 			io.out(triple.s1Chan,frameIndex) += sample*splitGain;
 			io.out(triple.s2Chan,frameIndex) += sample*splitGain;
@@ -554,6 +600,171 @@ void Vbap::renderSample(AudioIOData &io, const Pose &listeningPose, const float
 	}
 }
 
+int Vbap::findTripletLinear(const Vec3d& dir, Vec3d& gains){
+	for(unsigned i = 0; i < mTriplets.size(); ++i){
+		gains = computeGains(dir, mTriplets[i]);
+		if(contains(gains)) return i;
+	}
+	return -1;
+}
+
+int Vbap::findTriplet(const Vec3d& dir, Vec3d& gains, int hint){
+	if(hint >= 0 && hint < (int)mTriplets.size()){
+		gains = computeGains(dir, mTriplets[hint]);
+		if(contains(gains)) return hint;
+	}
+
+	if(mCellStart.empty()) return findTripletLinear(dir, gains);
+
+	// Every triplet overlapping the cell is a candidate, so if none contains
+	// the direction, no triplet does.
+	int cell = cellIndex(dir);
+	for(int i = mCellStart[cell]; i < mCellStart[cell+1]; ++i){
+		int t = mCellTriplets[i];
+		gains = computeGains(dir, mTriplets[t]);
+		if(contains(gains)) return t;
+	}
+	return -1;
+}
+
+// The grid is a cube map in 3D (LOOKUP_GRID_RES^2 cells per face) and a set
+// of azimuth sectors in 2D (4*LOOKUP_GRID_RES sectors).
+#define LOOKUP_GRID_RES 8
+
+int Vbap::numCells() const {
+	return mIs3D ? 6*LOOKUP_GRID_RES*LOOKUP_GRID_RES : 4*LOOKUP_GRID_RES;
+}
+
+int Vbap::cellIndex(const Vec3d& dir) const {
+	if(mIs3D){
+		// Project onto face of cube with largest component
+		double ax = fabs(dir.x), ay = fabs(dir.y), az = fabs(dir.z);
+		int face;
+		double u, v, m;
+		if(ax >= ay && ax >= az){ face = dir.x < 0 ? 1 : 0; m = ax; u = dir.y; v = dir.z; }
+		else if(ay >= az)       { face = dir.y < 0 ? 3 : 2; m = ay; u = dir.x; v = dir.z; }
+		else                    { face = dir.z < 0 ? 5 : 4; m = az; u = dir.x; v = dir.y; }
+		if(m == 0.) return 0;
+		int iu = int((u/m + 1.) * 0.5 * LOOKUP_GRID_RES);
+		int iv = int((v/m + 1.) * 0.5 * LOOKUP_GRID_RES);
+		if(iu >= LOOKUP_GRID_RES) iu = LOOKUP_GRID_RES-1;
+		if(iv >= LOOKUP_GRID_RES) iv = LOOKUP_GRID_RES-1;
+		return (face*LOOKUP_GRID_RES + iu)*LOOKUP_GRID_RES + iv;
+	}
+	else{
+		const int N = 4*LOOKUP_GRID_RES;
+		int i = int((atan2(dir.y, dir.x) + M_PI) / (2*M_PI) * N);
+		return i < 0 ? 0 : (i >= N ? N-1 : i);
+	}
+}
+
+// Whether the cones spanned by two sets of rays are separated by the plane
+// through the origin normal to axis. One cone may lie on the plane (the
+// plane may be one of its faces), but the other must be clear of it, so
+// that touching cones are not separated.
+static bool separated(const Vec3d& axis, const Vec3d * a, int na, const Vec3d * b, int nb){
+	const double onPlane = 1e-12;
+	const double clear = 1e-9;
+	double minA = 1e30, maxA = -1e30, minB = 1e30, maxB = -1e30;
+	for(int i = 0; i < na; ++i){
+		double d = axis.dot(a[i]);
+		minA = std::min(minA, d); maxA = std::max(maxA, d);
+	}
+	for(int i = 0; i < nb; ++i){
+		double d = axis.dot(b[i]);
+		minB = std::min(minB, d); maxB = std::max(maxB, d);
+	}
+	return	(maxA <= onPlane && minB > clear) || (minA >= -onPlane && maxB < -clear) ||
+			(maxB <= onPlane && minA > clear) || (minB >= -onPlane && maxA < -clear);
+}
+
+void Vbap::buildLookupGrid(){
+	const int Nc = numCells();
+	const int R = LOOKUP_GRID_RES;
+	mCellStart.resize(Nc+1);
+	mCellTriplets.clear();
+
+	for(int c = 0; c < Nc; ++c){
+		mCellStart[c] = mCellTriplets.size();
+
+		// Rays at the corners of the cell, in order around it
+		Vec3d cell[4];
+		int numCorners;
+		if(mIs3D){
+			static const int cu[4] = {0,1,1,0};
+			static const int cv[4] = {0,0,1,1};
+			int face = c / (R*R);
+			int iu = (c / R) % R;
+			int iv = c % R;
+			double w = (face & 1) ? -1. : 1.;
+			for(int k = 0; k < 4; ++k){
+				double u = double(iu + cu[k]) / R * 2. - 1.;
+				double v = double(iv + cv[k]) / R * 2. - 1.;
+				switch(face >> 1){
+				case 0: cell[k].set(w, u, v); break;
+				case 1: cell[k].set(u, w, v); break;
+				default:cell[k].set(u, v, w);
+				}
+				cell[k].normalize();
+			}
+			numCorners = 4;
+		}
+		else{
+			for(int k = 0; k < 2; ++k){
+				double a = double(c + k) / Nc * 2*M_PI - M_PI;
+				cell[k].set(cos(a), sin(a), 0.);
+			}
+			numCorners = 2;
+		}
+
+		// A triplet is a candidate unless a plane through the origin separates
+		// it from the cell. For two cones, it is enough to try the planes of
+		// their faces and the planes containing an edge of each.
+		for(unsigned t = 0; t < mTriplets.size(); ++t){
+			const SpeakerTriple& trip = mTriplets[t];
+			Vec3d tri[3];
+			int numRays = mIs3D ? 3 : 2;
+			for(int k = 0; k < numRays; ++k){
+				tri[k] = trip.vec[k];
+				if(!mIs3D) tri[k].z = 0.;
+				tri[k].normalize();
+			}
+
+			bool overlap = true;
+			if(mIs3D){
+				for(int i = 0; i < numCorners && overlap; ++i){
+					Vec3d axis = cross(cell[i], cell[(i+1)%numCorners]);
+					overlap = !separated(axis, cell, numCorners, tri, numRays);
+				}
+				for(int i = 0; i < numRays && overlap; ++i){
+					Vec3d axis = cross(tri[i], tri[(i+1)%numRays]);
+					overlap = !separated(axis, cell, numCorners, tri, numRays);
+				}
+				for(int i = 0; i < numCorners && overlap; ++i){
+					for(int j = 0; j < numRays && overlap; ++j){
+						Vec3d axis = cross(cell[i], tri[j]);
+						overlap = !separated(axis, cell, numCorners, tri, numRays);
+					}
+				}
+			}
+			else{
+				// In the plane, the separating lines contain one of the rays
+				for(int i = 0; i < numCorners && overlap; ++i){
+					Vec3d axis(-cell[i].y, cell[i].x, 0.);
+					overlap = !separated(axis, cell, numCorners, tri, numRays);
+				}
+				for(int i = 0; i < numRays && overlap; ++i){
+					Vec3d axis(-tri[i].y, tri[i].x, 0.);
+					overlap = !separated(axis, cell, numCorners, tri, numRays);
+				}
+			}
+
+			if(overlap) mCellTriplets.push_back(t);
+		}
+	}
+	mCellStart[Nc] = mCellTriplets.size();
+}
+
 ////Per buffer
 //void Vbap::perform(AudioIOData& io,SoundSource& src,Vec3d& relpos,const int& numFrames,float *samples){
 
@@ -579,6 +790,7 @@ void Vbap::makeTriple(int s1, int s2, int s3)
 	triple.s3 = s3;
 	triple.loadVectors(mSpeakers);
 	addTriple(triple);
+	buildLookupGrid();
 }
 std::vector<SpeakerTriple> Vbap::triplets() const
 {
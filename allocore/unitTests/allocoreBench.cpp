@@ -0,0 +1,338 @@
+/*
+Allocore benchmarks for spatial audio rendering
+
+Description:
+This renders an AudioScene into the buffers of an AudioIO using the dummy
+audio backend, so no audio device is opened. It runs over a grid of source
+counts, speaker counts, block sizes, spatializers and processing modes, and
+reports, for each combination:
+
+	ns/sample/src	median time to render one frame of one source
+	headroom		block duration over median render time; below 1, the
+					scene cannot be rendered in real time on one core
+	worst			block duration over the slowest render time
+
+The binaural spatializers, in direct and Ambisonic modes, render to two
+channels with a set of random HRIRs, so their speaker count is always 2.
+
+It then reports the cost of reading a source's delay line with each
+DelayInterpolation, in ns per sample, while the delay is swept.
+
+The results are also written as JSON so that they can be tracked over time.
+
+Usage:
+	allocoreBench [--quick] [--time seconds] [--json file]
+
+	--quick		run a reduced grid
+	--time		seconds to measure each combination (default 0.1)
+	--json		file to write results to (default allocoreBench.json)
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "allocore/io/al_AudioIO.hpp"
+#include "allocore/sound/al_AudioScene.hpp"
+#include "allocore/sound/al_Ambisonics.hpp"
+#include "allocore/sound/al_Binaural.hpp"
+#include "allocore/sound/al_Dbap.hpp"
+#include "allocore/sound/al_Vbap.hpp"
+#include "allocore/system/al_Time.h"
+
+using namespace al;
+
+static const double sampleRate = 44100;
+
+enum SpatializerType{ VBAP = 0, DBAP, AMBISONICS, BINAURAL, BINAURAL_AMBI, NUM_SPATIALIZERS };
+
+static const char * spatializerName(int type){
+	switch(type){
+	case VBAP:			return "vbap";
+	case DBAP:			return "dbap";
+	case AMBISONICS:	return "ambisonics";
+	case BINAURAL:		return "binaural";
+	case BINAURAL_AMBI:	return "bin-ambi";
+	default:			return "";
+	}
+}
+
+static bool isBinaural(int type){ return type == BINAURAL || type == BINAURAL_AMBI; }
+
+struct Result{
+	int spatializer;
+	bool perSample;
+	int numSources, numSpeakers, numFrames;
+	int numBlocks;
+	double medianNs, maxNs;	// render time of a block
+
+	double nsPerSampleSource() const { return medianNs / (double(numFrames) * numSources); }
+	double blockNs() const { return numFrames / sampleRate * 1e9; }
+	double headroom() const { return blockNs() / medianNs; }
+	double worstHeadroom() const { return blockNs() / maxNs; }
+};
+
+// Speakers spread evenly over the sphere
+static SpeakerLayout sphereLayout(int numSpeakers){
+	SpeakerLayout layout;
+	for(int s=0; s<numSpeakers; ++s){
+		float el = asin(2.f * (s + 0.5f) / numSpeakers - 1.f) * 57.29578f;
+		float az = fmod(s * 137.50776f, 360.f);
+		layout.addSpeaker(Speaker(s, az, el));
+	}
+	return layout;
+}
+
+// Random HRIRs of 256 samples at 512 directions spread over the sphere
+static const HRIRSet& benchHRIRs(){
+	static HRIRSet hrirs;
+	if(!hrirs.size()){
+		const int length = 256, numDirections = 512;
+		hrirs.clear(length, sampleRate);
+		std::vector<float> irs(2 * length);
+		for(int m=0; m<numDirections; ++m){
+			for(int i=0; i<2*length; ++i){
+				irs[i] = (float(rand()) / RAND_MAX - 0.5f) * exp(-(i % length) / 50.f);
+			}
+			float el = asin(2.f * (m + 0.5f) / numDirections - 1.f) * 57.29578f;
+			float az = fmod(m * 137.50776f, 360.f);
+			hrirs.add(az, el, &irs[0], &irs[length]);
+		}
+	}
+	return hrirs;
+}
+
+static Spatializer * makeSpatializer(int type, SpeakerLayout& layout){
+	switch(type){
+	case VBAP:			return new Vbap(layout, true);
+	case DBAP:			return new Dbap(layout);
+	case AMBISONICS:	return new AmbisonicsSpatializer(layout, 3, 3);
+	case BINAURAL:		return new BinauralSpatializer(benchHRIRs(), layout);
+	case BINAURAL_AMBI:{
+		BinauralSpatializer * b = new BinauralSpatializer(benchHRIRs(), layout);
+		b->mode(BINAURAL_AMBISONIC);
+		return b;
+	}
+	default:			return NULL;
+	}
+}
+
+static Result run(int type, bool perSample, int numSources, int numSpeakers, int numFrames, double seconds){
+	Result r;
+	r.spatializer = type;
+	r.perSample = perSample;
+	r.numSources = numSources;
+	r.numSpeakers = numSpeakers;
+	r.numFrames = numFrames;
+
+	// Ambisonics writes back into the layout, so each run gets its own
+	SpeakerLayout layout = isBinaural(type) ? HeadsetSpeakerLayout() : sphereLayout(numSpeakers);
+	Spatializer * spatializer = makeSpatializer(type, layout);
+
+	AudioIO io(numFrames, sampleRate, NULL, NULL, numSpeakers, 0);
+	AudioScene scene(numFrames);
+	scene.usePerSampleProcessing(perSample);
+	Listener * listener = scene.createListener(spatializer);
+	listener->pos(0, 0, 0);
+
+	// Delay line long enough for the most distant source
+	int delaySize = SoundSource::bufferSize(sampleRate, 340, 20) + numFrames + 4;
+	std::vector<SoundSource *> sources;
+	std::vector<Vec3d> centers;
+	for(int s=0; s<numSources; ++s){
+		SoundSource * src = new SoundSource(0.1, 20, ATTEN_INVERSE, DOPPLER_SYMMETRICAL, sampleRate, 0, delaySize);
+		sources.push_back(src);
+		scene.addSource(*src);
+		double az = s * 2.39996;
+		double el = asin(2. * (s + 0.5) / numSources - 1.);
+		double dist = 2. + 8. * s / numSources;
+		centers.push_back(Vec3d(cos(az)*cos(el), sin(el), sin(az)*cos(el)) * dist);
+	}
+
+	std::vector<double> times;
+	double elapsed = 0;
+	int block = 0;
+	const int warmupBlocks = 2;
+	while(block < warmupBlocks + 5 || (elapsed < seconds && block < 100000)){
+
+		// Move sources on small circles and fill their delay lines
+		double phase = block * numFrames / sampleRate;
+		for(int s=0; s<numSources; ++s){
+			SoundSource& src = *sources[s];
+			const Vec3d& c = centers[s];
+			src.pos(c.x + 0.5*cos(phase + s), c.y, c.z + 0.5*sin(phase + s));
+			for(int i=0; i<numFrames; ++i){
+				src.writeSample(float(rand()) / RAND_MAX - 0.5f);
+			}
+		}
+
+		al_nsec t0 = al_steady_time_nsec();
+		scene.render(io);
+		double dt = double(al_steady_time_nsec() - t0);
+
+		if(block >= warmupBlocks){
+			times.push_back(dt);
+			elapsed += dt * 1e-9;
+		}
+		++block;
+	}
+
+	std::sort(times.begin(), times.end());
+	r.numBlocks = times.size();
+	r.medianNs = times[times.size()/2];
+	r.maxNs = times.back();
+
+	for(unsigned s=0; s<sources.size(); ++s) delete sources[s];
+	delete spatializer;
+	return r;
+}
+
+struct InterpResult{
+	DelayInterpolation type;
+	double ns;	// time to read one sample
+};
+
+static const char * interpolationName(DelayInterpolation type){
+	switch(type){
+	case INTERP_LINEAR:	return "linear";
+	case INTERP_CUBIC:	return "cubic";
+	case INTERP_SINC8:	return "sinc8";
+	case INTERP_SINC16:	return "sinc16";
+	case INTERP_SINC32:	return "sinc32";
+	default:			return "";
+	}
+}
+
+static InterpResult runInterpolation(DelayInterpolation type, double seconds){
+	const int numFrames = 256;
+	SoundSource src(0.1, 20, ATTEN_INVERSE, DOPPLER_SYMMETRICAL, sampleRate, 0, 8192);
+	src.interpolation(type);
+	std::vector<float> buffer(numFrames);
+
+	// Keep the fastest block to reduce scheduling noise
+	double best = 1e30, elapsed = 0;
+	for(int block = 0; block < 5 || (elapsed < seconds && block < 100000); ++block){
+		for(int i=0; i<numFrames; ++i) src.writeSample(float(rand()) / RAND_MAX - 0.5f);
+		Pose relpos(Vec3d(0, 0, 2. + sin(block * 0.1)));
+		al_nsec t0 = al_steady_time_nsec();
+		src.getBuffer(relpos, &buffer[0], numFrames);
+		double dt = double(al_steady_time_nsec() - t0);
+		if(dt < best) best = dt;
+		elapsed += dt * 1e-9;
+	}
+
+	InterpResult r;
+	r.type = type;
+	r.ns = best / numFrames;
+	return r;
+}
+
+static bool writeJSON(const char * path, const std::vector<Result>& results, const std::vector<InterpResult>& interps){
+	FILE * f = fopen(path, "w");
+	if(!f) return false;
+
+	char date[64];
+	time_t now = time(NULL);
+	strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+	fprintf(f, "{\n");
+	fprintf(f, "\t\"benchmark\": \"allocoreBench\",\n");
+	fprintf(f, "\t\"date\": \"%s\",\n", date);
+	fprintf(f, "\t\"sampleRate\": %g,\n", sampleRate);
+	fprintf(f, "\t\"results\": [\n");
+	for(unsigned i=0; i<results.size(); ++i){
+		const Result& r = results[i];
+		fprintf(f,
+			"\t\t{\"spatializer\": \"%s\", \"mode\": \"%s\", \"sources\": %d, \"speakers\": %d, "
+			"\"blockSize\": %d, \"blocks\": %d, \"medianBlockNs\": %.0f, \"maxBlockNs\": %.0f, "
+			"\"nsPerSampleSource\": %.3f, \"headroom\": %.3f, \"worstHeadroom\": %.3f}%s\n",
+			spatializerName(r.spatializer), r.perSample ? "sample" : "buffer",
+			r.numSources, r.numSpeakers, r.numFrames, r.numBlocks, r.medianNs, r.maxNs,
+			r.nsPerSampleSource(), r.headroom(), r.worstHeadroom(),
+			i+1 < results.size() ? "," : ""
+		);
+	}
+	fprintf(f, "\t],\n");
+	fprintf(f, "\t\"interpolation\": [\n");
+	for(unsigned i=0; i<interps.size(); ++i){
+		fprintf(f, "\t\t{\"type\": \"%s\", \"nsPerSample\": %.3f}%s\n",
+			interpolationName(interps[i].type), interps[i].ns, i+1 < interps.size() ? "," : "");
+	}
+	fprintf(f, "\t]\n}\n");
+	fclose(f);
+	return true;
+}
+
+int main(int argc, char * argv[]){
+	bool quick = false;
+	double seconds = 0.1;
+	const char * jsonPath = "allocoreBench.json";
+
+	for(int i=1; i<argc; ++i){
+		if(!strcmp(argv[i], "--quick")) quick = true;
+		else if(!strcmp(argv[i], "--time") && i+1 < argc) seconds = atof(argv[++i]);
+		else if(!strcmp(argv[i], "--json") && i+1 < argc) jsonPath = argv[++i];
+		else{
+			printf("usage: %s [--quick] [--time seconds] [--json file]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	std::vector<int> sourceCounts, speakerCounts, blockSizes;
+	if(quick){
+		sourceCounts = {1, 32};
+		speakerCounts = {8, 32};
+		blockSizes = {64, 512};
+	}
+	else{
+		sourceCounts = {1, 16, 64, 256};
+		speakerCounts = {8, 32, 64};
+		blockSizes = {64, 256, 1024};
+	}
+
+	printf("%-11s %-6s %7s %8s %6s %14s %9s %9s\n",
+		"spatializer", "mode", "sources", "speakers", "block", "ns/sample/src", "headroom", "worst");
+
+	std::vector<Result> results;
+	for(int type=0; type<NUM_SPATIALIZERS; ++type){
+		for(int mode=0; mode<2; ++mode){
+			// Binaural output is always two channels
+			std::vector<int> speakers = isBinaural(type) ? std::vector<int>(1, 2) : speakerCounts;
+			for(int numSpeakers : speakers){
+				for(int numFrames : blockSizes){
+					for(int numSources : sourceCounts){
+						Result r = run(type, mode == 1, numSources, numSpeakers, numFrames, seconds);
+						results.push_back(r);
+						printf("%-11s %-6s %7d %8d %6d %14.2f %9.2f %9.2f\n",
+							spatializerName(type), r.perSample ? "sample" : "buffer",
+							numSources, numSpeakers, numFrames,
+							r.nsPerSampleSource(), r.headroom(), r.worstHeadroom());
+						fflush(stdout);
+					}
+				}
+			}
+		}
+	}
+
+	std::vector<InterpResult> interps;
+	printf("\n%-11s %14s %9s\n", "interp", "ns/sample", "relative");
+	const DelayInterpolation interpTypes[] = {INTERP_LINEAR, INTERP_CUBIC, INTERP_SINC8, INTERP_SINC16, INTERP_SINC32};
+	for(DelayInterpolation type : interpTypes){
+		interps.push_back(runInterpolation(type, seconds));
+	}
+	for(const InterpResult& r : interps){
+		printf("%-11s %14.2f %9.2f\n", interpolationName(r.type), r.ns, r.ns / interps[1].ns);
+	}
+
+	if(!writeJSON(jsonPath, results, interps)){
+		printf("Could not write %s\n", jsonPath);
+		return 1;
+	}
+	printf("Results written to %s\n", jsonPath);
+	return 0;
+}
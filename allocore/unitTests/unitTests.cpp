@@ -43,6 +43,9 @@ int main (int argc, char * const argv[]) {
 #ifndef ALLOCORE_TESTS_NO_AUDIO
 	RUNTEST(IOAudioIO);
 #endif
+	RUNTEST(IOAudioFileBackend);
+	RUNTEST(IOAudioProfiler);
+	RUNTEST(IOAudioIOBlocks);
 
 	RUNTEST(AudioScene);
 	RUNTEST(Ambisonics);
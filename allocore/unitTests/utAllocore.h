@@ -19,6 +19,9 @@ using namespace al;
 
 int utAudioScene();
 int utIOAudioIO();
+int utIOAudioFileBackend();
+int utIOAudioProfiler();
+int utIOAudioIOBlocks();
 int utIOSocket();
 int utIOWindowGL();
 int utMath();
@@ -64,8 +64,220 @@ void testFirstOrder2D() {
 	}
 }
 
+void testDecodeMatrix() {
+	// 2nd order 2D has 5 channels and 100 frames span two decode blocks
+	const int numFrames = 100;
+	const int numChannels = 5;
+	SpeakerLayout speakerLayout = OctalSpeakerLayout();
+	AmbiDecode decoder(2, 2, 8, 1);
+	decoder.setSpeakers(speakerLayout.speakers());
+
+	float ambiBuffer[numFrames*numChannels];
+	for (int i = 0; i < numFrames*numChannels; i++) {
+		ambiBuffer[i] = float(rand()) / RAND_MAX - 0.5f;
+	}
+
+	AmbiDecodeConfig config;
+	for (int pass = 0; pass < 2; pass++) {
+		if (pass == 1) {
+			config.discardNegativeWeights = true;
+			config.weightOffset = 0.1f;
+			decoder.setConfiguration(config);
+		}
+
+		float speakerSignals[numFrames*8];
+		memset(speakerSignals, 0, sizeof(speakerSignals));
+		decoder.decode(speakerSignals, ambiBuffer, numFrames);
+
+		for (int spkr = 0; spkr < 8; spkr++) {
+			for (int i = 0; i < numFrames; i++) {
+				float expected = 0;
+				for (int c = 0; c < numChannels; c++) {
+					float w = decoder.decodeWeight(spkr, c) + config.weightOffset;
+					if (config.discardNegativeWeights && w < 0) w = 0;
+					expected += ambiBuffer[c * numFrames + i] * w;
+				}
+				assert(almostEqual(speakerSignals[spkr * numFrames + i], expected));
+			}
+		}
+	}
+}
+
+void testEncoderBatch() {
+	const int numFrames = 16;
+	const int numSources = 6;
+	const int numChannels = AmbiEncoder<5>::numChannels;
+	assert(numChannels == 36);
+
+	// Runtime encoder of same order gives same weights
+	AmbiEncode encode(3, 5);
+	assert(encode.channels() == numChannels);
+
+	Vec3f dirs[numSources];
+	float inputs[numSources][numFrames];
+	const float * inputPtrs[numSources];
+	float ambiBatch[numChannels*numFrames];
+	float ambiSingle[numChannels*numFrames];
+	memset(ambiBatch, 0, sizeof(ambiBatch));
+	memset(ambiSingle, 0, sizeof(ambiSingle));
+
+	for (int j = 0; j < numSources; j++) {
+		dirs[j] = Vec3f(rand(), rand(), rand() - RAND_MAX/2).normalize();
+		for (int i = 0; i < numFrames; i++) {
+			inputs[j][i] = float(rand()) / RAND_MAX - 0.5f;
+		}
+		inputPtrs[j] = inputs[j];
+
+		float ws[numChannels];
+		AmbiEncoder<5>::encodeWeights(ws, dirs[j].x, dirs[j].y, dirs[j].z);
+		encode.direction(dirs[j].x, dirs[j].y, dirs[j].z);
+		for (int c = 0; c < numChannels; c++) {
+			assert(almostEqual(ws[c], encode.weights()[c]));
+		}
+		encode.encode(ambiSingle, inputs[j], numFrames);
+	}
+
+	// Sources encoded together, four and then two at a time
+	AmbiEncoder<5>::encode(ambiBatch, dirs, inputPtrs, numSources, numFrames);
+	for (int i = 0; i < numChannels*numFrames; i++) {
+		assert(almostEqual(ambiBatch[i], ambiSingle[i]));
+	}
+
+	// Decoding 5th order, the speaker in the source direction is loudest
+	SpeakerLayout speakerLayout;
+	for (int s = 0; s < 32; s++) {
+		float el = asin(2.f * (s + 0.5f) / 32 - 1.f) * 57.29578f;
+		speakerLayout.addSpeaker(Speaker(s, s * 137.50776f, el));
+	}
+	AmbiDecode decoder(3, 5, 32, 3);
+	decoder.setSpeakers(speakerLayout.speakers());
+	double az = 11 * 137.50776 * M_PI / 180.;
+	double el = asin(2. * 11.5 / 32 - 1.);
+	AmbiEncoder<5> encoder;
+	encoder.direction(cos(az) * cos(el), sin(az) * cos(el), sin(el));
+	float one = 1;
+	float ambiFrame[numChannels];
+	float speakerFrame[32];
+	memset(ambiFrame, 0, sizeof(ambiFrame));
+	memset(speakerFrame, 0, sizeof(speakerFrame));
+	encoder.encode(ambiFrame, &one, 1);
+	decoder.decode(speakerFrame, ambiFrame, 1);
+	for (int s = 0; s < 32; s++) {
+		if (s != 11) assert(speakerFrame[s] < speakerFrame[11]);
+	}
+}
+
+// Rotation matrix in the Ambisonic coordinate frame
+static Mat3d rotationMatrix(const Quatd& q) {
+	Mat3d rot;
+	for (int j = 0; j < 3; j++) {
+		Vec3d axis(0, 0, 0);
+		axis[j] = 1;
+		Vec3d v = q.rotate(axis);
+		for (int i = 0; i < 3; i++) rot(i, j) = v[i];
+	}
+	return rot;
+}
+
+void testRotate(int dim, int order, const Quatd& q) {
+	AmbiRotate rotator(dim, order);
+	rotator.rotation(rotationMatrix(q));
+	const int numChannels = rotator.channels();
+
+	// Rotating encoded directions is the same as encoding rotated directions
+	for (int t = 0; t < 20; t++) {
+		Vec3d dir(rand() - RAND_MAX/2, rand() - RAND_MAX/2, dim == 3 ? rand() - RAND_MAX/2 : 0);
+		dir.normalize();
+		Vec3d rotDir = q.rotate(dir);
+		float ws[36], rotWs[36];
+		AmbiBase::encodeWeightsFuMa(ws, dim, order, dir.x, dir.y, dir.z);
+		AmbiBase::encodeWeightsFuMa(rotWs, dim, order, rotDir.x, rotDir.y, rotDir.z);
+
+		for (int o = 0; o < numChannels; o++) {
+			float v = 0;
+			for (int i = 0; i < numChannels; i++) v += rotator.coef(o, i) * ws[i];
+			assert(fabs(v - rotWs[o]) < 1e-4);
+		}
+	}
+}
+
+void testRotateBlock() {
+	const int numFrames = 8;
+	AmbiRotate rotator(3, 2, numFrames);
+	const int numChannels = rotator.channels();
+	Quatd q1 = Quatd().fromAxisAngle(M_PI/3, 0, 0, 1);
+	Quatd q2 = Quatd().fromAxisAngle(M_PI/3, 0.6, 0, 0.8);
+	Vec3d dir = Vec3d(0.2, 0.5, 0.3).normalize();
+
+	float ws[9];
+	AmbiBase::encodeWeightsFuMa(ws, 3, 2, dir.x, dir.y, dir.z);
+	float ambi[9*numFrames];
+	for (int c = 0; c < numChannels; c++) {
+		for (int i = 0; i < numFrames; i++) ambi[c*numFrames + i] = ws[c];
+	}
+
+	// First block is rotated with no interpolation
+	rotator.rotation(rotationMatrix(q1));
+	rotator.rotate(ambi, numFrames);
+	Vec3d d1 = q1.rotate(dir);
+	float ws1[9];
+	AmbiBase::encodeWeightsFuMa(ws1, 3, 2, d1.x, d1.y, d1.z);
+	for (int c = 0; c < numChannels; c++) {
+		for (int i = 0; i < numFrames; i++) {
+			assert(fabs(ambi[c*numFrames + i] - ws1[c]) < 1e-4);
+		}
+	}
+
+	// Next block reaches the new rotation on the last frame
+	for (int c = 0; c < numChannels; c++) {
+		for (int i = 0; i < numFrames; i++) ambi[c*numFrames + i] = ws[c];
+	}
+	rotator.rotation(rotationMatrix(q2));
+	rotator.rotate(ambi, numFrames);
+	Vec3d d2 = q2.rotate(dir);
+	float ws2[9];
+	AmbiBase::encodeWeightsFuMa(ws2, 3, 2, d2.x, d2.y, d2.z);
+	for (int c = 0; c < numChannels; c++) {
+		float mid = 0.5f * (ws1[c] + ws2[c]);
+		assert(fabs(ambi[c*numFrames + numFrames/2 - 1] - mid) < 1e-4);
+		assert(fabs(ambi[c*numFrames + numFrames - 1] - ws2[c]) < 1e-4);
+	}
+}
+
+void testRotateOrientation() {
+	AmbiRotate rotator(3, 3);
+	const int numChannels = rotator.channels();
+	Quatd q = Quatd().fromAxisAngle(0.9, Vec3d(-0.2, 0.7, 0.4).normalize());
+	rotator.orientation(q);
+
+	// A world direction, rotated to a listener with orientation q, is heard
+	// in the direction relative to the listener
+	for (int t = 0; t < 20; t++) {
+		Vec3d dir(rand() - RAND_MAX/2, rand() - RAND_MAX/2, rand() - RAND_MAX/2);
+		dir.normalize();
+		Vec3d rel = q.recip().rotate(dir);
+		float ws[16], relWs[16];
+		AmbiBase::encodeWeightsFuMa(ws, 3, 3, dir.x, -dir.z, dir.y);
+		AmbiBase::encodeWeightsFuMa(relWs, 3, 3, rel.x, -rel.z, rel.y);
+
+		for (int o = 0; o < numChannels; o++) {
+			float v = 0;
+			for (int i = 0; i < numChannels; i++) v += rotator.coef(o, i) * ws[i];
+			assert(fabs(v - relWs[o]) < 1e-4);
+		}
+	}
+}
+
 int utAmbisonics() {
 	testFirstOrder2D();
+	testDecodeMatrix();
+	testEncoderBatch();
+	for (int order = 1; order <= 5; order++) {
+		testRotate(3, order, Quatd().fromAxisAngle(0.7, Vec3d(0.3, -0.5, 0.8).normalize()));
+		testRotate(2, order, Quatd().fromAxisAngle(-1.1, 0, 0, 1));
+	}
+	testRotateBlock();
+	testRotateOrientation();
 
 	return 0;
 }
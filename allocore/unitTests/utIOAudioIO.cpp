@@ -67,3 +67,218 @@ int utIOAudioIO(){
 	//printf("\nPress 'enter' to quit...\n"); getchar();
 	return 0;
 }
+
+
+static void noiseCB(AudioIOData& io){
+	while(io()){
+		for(int c=0; c<io.channelsOut(); ++c){
+			io.out(c) = float(rand()) / RAND_MAX - 0.5f;
+		}
+	}
+}
+
+static void throughCB(AudioIOData& io){
+	while(io()){
+		for(int c=0; c<io.channelsOut(); ++c){
+			io.out(c) = io.in(c);
+		}
+	}
+}
+
+static std::vector<char> readFile(const char * path){
+	std::vector<char> data;
+	FILE * f = fopen(path, "rb");
+	if(f){
+		char buf[4096];
+		size_t n;
+		while((n = fread(buf, 1, sizeof(buf), f)) > 0) data.insert(data.end(), buf, buf+n);
+		fclose(f);
+	}
+	return data;
+}
+
+int utIOAudioFileBackend(){
+	const char * paths[] = {"/tmp/al_render_a.wav", "/tmp/al_render_b.wav", "/tmp/al_render_c.wav", "/tmp/al_render_d.au"};
+	const int headerSize = 104;
+	const int numFrames = 72000; // not a whole number of blocks
+
+	// Renders with the same seed are identical
+	for(int i=0; i<2; ++i){
+		AudioIO io(256, 48000, noiseCB, 0, 3, 0);
+		auto backend = std::make_shared<AudioFileBackend>(paths[i], 1.5);
+		backend->seed(7);
+		io.backend(backend);
+		assert(io.channelsOutDevice() == 3);
+		assert(backend->render(io));
+		assert(backend->framesRendered() == numFrames);
+		assert(fabs(io.time() - 1.5) < 1e-9);
+		// The header is up to date before closing
+		std::vector<char> data = readFile(paths[i]);
+		assert(data.size() == headerSize + numFrames * 3 * sizeof(float));
+		uint32_t dataBytes;
+		memcpy(&dataBytes, &data[headerSize - 4], 4); // little endian host
+		assert(dataBytes == numFrames * 3 * sizeof(float));
+		io.close();
+	}
+	std::vector<char> a = readFile(paths[0]);
+	std::vector<char> b = readFile(paths[1]);
+	assert(a.size() == headerSize + numFrames * 3 * sizeof(float));
+	assert(!memcmp(&a[0], "RIFF", 4) && !memcmp(&a[8], "WAVE", 4));
+	assert(a == b);
+
+	// Input fed from a file, rendered on the backend's thread until it ends
+	{
+		AudioIO io(100, 48000, throughCB, 0, 3, 3);
+		auto backend = std::make_shared<AudioFileBackend>(paths[2]);
+		backend->inputPath(paths[0]);
+		io.backend(backend);
+		assert(io.start());
+		backend->wait();
+		assert(!io.backend()->isRunning());
+		assert(backend->framesRendered() == numFrames);
+		io.close();
+	}
+	std::vector<char> c = readFile(paths[2]);
+	assert(c == a);
+
+	// Sun/NeXT files are big endian
+	{
+		AudioIO io(64, 48000, throughCB, 0, 1, 1);
+		auto backend = std::make_shared<AudioFileBackend>(paths[3]);
+		backend->inputPath(paths[0]);
+		io.backend(backend);
+		assert(backend->render(io));
+		io.close();
+	}
+	std::vector<char> d = readFile(paths[3]);
+	assert(d.size() == 24 + numFrames * sizeof(float));
+	assert(!memcmp(&d[0], ".snd", 4));
+	for(int i=0; i<4; ++i) assert(d[24 + i] == a[headerSize + 3 - i]);
+
+	// Without a duration or an input file, render() would never return
+	{
+		AudioIO io(64, 48000, noiseCB, 0, 1, 0);
+		auto backend = std::make_shared<AudioFileBackend>(paths[3]);
+		io.backend(backend);
+		assert(!backend->render(io));
+		assert(backend->error());
+	}
+
+	for(auto path : paths) remove(path);
+	return 0;
+}
+
+static void spin(double sec){
+	al_nsec end = al_steady_time_nsec() + al_nsec(sec * 1e9);
+	while(al_steady_time_nsec() < end){}
+}
+
+int utIOAudioProfiler(){
+	// Only the spinning blocks and the gap before the last one are slow enough
+	// to count; the others have a period long enough to never overrun
+	const double period = 10e-3;
+	const double longPeriod = 1;
+
+	{
+		AudioProfiler p;
+		for(int i=0; i<20; ++i){ p.beginBlock(); p.endBlock(longPeriod); }
+		for(int i=0; i<2; ++i){ p.beginBlock(); spin(2*period); p.endBlock(period); }
+		spin(3*period);
+		p.beginBlock(); p.endBlock(period);
+
+		assert(p.blocks() == 23);
+		assert(p.overruns() == 2);
+		assert(p.late() == 1);
+		assert(p.maxLoad() >= 2);
+		assert(p.percentile(0.5) < 0.5);
+		assert(p.percentile(1) == p.maxLoad());
+		assert(p.percentile(0.95) >= 2);
+
+		uint64_t n = 0;
+		for(int i=0; i<AudioProfiler::NUM_BINS; ++i) n += p.histogram(i);
+		assert(n == p.blocks());
+
+		p.reset();
+		assert(p.blocks() == 0 && p.percentile(0.99) == 0);
+
+		// Disabled blocks are not timed
+		p.enabled(false);
+		p.beginBlock(); p.endBlock(period);
+		assert(p.blocks() == 0);
+	}
+
+	// AudioIO times every block it processes
+	{
+		AudioIO io(100, 48000, noiseCB, 0, 2, 0);
+		auto backend = std::make_shared<AudioFileBackend>("/tmp/al_render_e.wav", 0.5);
+		io.backend(backend);
+		assert(backend->render(io));
+		assert(io.profiler().blocks() == 240);
+		assert(io.profiler().late() == 0);
+		assert(io.profiler().maxLoad() > 0);
+		io.close();
+	}
+	remove("/tmp/al_render_e.wav");
+
+	return 0;
+}
+
+static int rampFrame = 0;
+static int rampBlock = 0;
+
+static float ramp(int i){ return float(i % 997) / 997.f; }
+
+// Ramp on output 0, input 0 on output 1
+static void rampCB(AudioIOData& io){
+	assert(io.framesPerBuffer() == rampBlock);
+	while(io()){
+		io.out(0) = ramp(rampFrame++);
+		if(io.channelsOut() > 1) io.out(1) = io.in(0);
+	}
+}
+
+int utIOAudioIOBlocks(){
+	const char * paths[] = {"/tmp/al_blocks_in.wav", "/tmp/al_blocks_out.wav"};
+	const int headerSize = 104;
+
+	// Device buffer and block sizes, and the latency expected
+	const int sizes[][3] = {
+		{100, 64, 60}, {64, 256, 192}, {256, 64, 0}, {128, 128, 0}, {1024, 48, 32}
+	};
+
+	{
+		AudioIO io(100, 48000, rampCB, 0, 1, 0);
+		io.backend(std::make_shared<AudioFileBackend>(paths[0], 0.1));
+		rampFrame = 0; rampBlock = 100;
+		assert(std::static_pointer_cast<AudioFileBackend>(io.backend())->render(io));
+		assert(io.blockLatency() == 0);
+		io.close();
+	}
+
+	for(auto& size : sizes){
+		AudioIO io(size[0], 48000, rampCB, 0, 2, 1);
+		auto backend = std::make_shared<AudioFileBackend>(paths[1], 0.1);
+		backend->inputPath(paths[0]);
+		io.backend(backend);
+		io.framesPerBlock(size[1]);
+		assert(io.framesPerBlock() == size[1]);
+		assert(io.blockLatency() == size[2]);
+		rampFrame = 0; rampBlock = size[1];
+		assert(backend->render(io));
+		io.close();
+
+		// Both outputs are the ramp, delayed by the latency
+		std::vector<char> data = readFile(paths[1]);
+		const float * out = (const float *)&data[headerSize];
+		const int numFrames = (data.size() - headerSize) / (2 * sizeof(float));
+		assert(numFrames == 4800);
+		for(int i=0; i<numFrames; ++i){
+			float expected = i < size[2] ? 0.f : ramp(i - size[2]);
+			assert(out[2*i] == expected);
+			assert(out[2*i+1] == expected);
+		}
+	}
+
+	for(auto path : paths) remove(path);
+	return 0;
+}
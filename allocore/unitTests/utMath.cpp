@@ -281,6 +281,18 @@ int utMath(){
 			assert(eq(m*inv, Mat<3,double>::identity()));
 		}
 
+		{
+			Mat<3,double> m(
+				1,2,0,
+				3,1,2,
+				0,4,1
+			);
+
+			Mat<3,double> inv = m;
+			assert(invert(inv));
+			assert(eq(m*inv, Mat<3,double>::identity()));
+		}
+
 		#undef CHECK
 	}
 
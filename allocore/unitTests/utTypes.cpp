@@ -303,6 +303,33 @@ int utTypes(){
 		assert(a.fill() == 0);
 	}
 
+	{
+		TripleBuffer<int> a(2);
+		assert(a.size() == 2);
+		assert(!a.update());
+
+		a.back()[0] = 1; a.back()[1] = 2;
+		a.publish();
+		assert(a.update());
+		assert(a.front()[0] == 1 && a.front()[1] == 2);
+		assert(!a.update());
+
+		// Only the latest snapshot is picked up
+		a.back()[0] = 3; a.publish();
+		a.back()[0] = 4; a.publish();
+		assert(a.update());
+		assert(a.front()[0] == 4);
+
+		// The writer never writes to the reader's snapshot
+		a.back()[0] = 5;
+		assert(a.front()[0] == 4);
+		a.publish();
+		a.back()[0] = 6;
+		assert(a.front()[0] == 4);
+		assert(a.update());
+		assert(a.front()[0] == 5);
+	}
+
 	return 0;
 }
 